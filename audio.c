@@ -0,0 +1,528 @@
+/*
+ * audio.c
+ *
+ * Wavetable synthesiser - see audio.h
+ *
+ * The voices are only changed by the main loop with interrupts off, so
+ * the interrupt handler can use them (and its statistics) without
+ * volatile getting in the way of the code it compiles to.
+ *
+ * Interrupt handler timing (8MHz, avr-gcc -Os - count the instructions
+ * again with avr-objdump -d after changing it): getting into the
+ * handler and saving the registers takes about 40 cycles, each voice
+ * about 30 (phase step, LPM, MULSU, add to the mix), the mix and the
+ * PWM write about 12 and the control tick test and the timing about 30.
+ * Restoring the registers and returning takes about 35. A sample
+ * therefore costs about 210 of the 1000 cycles between samples (21% of
+ * the CPU while sound is playing). The worst case is the control tick
+ * in which a voice reaches the end of a repeating tune and loads its
+ * first note again - about 120 cycles more, 330 in all - which happens
+ * at most 3 times in every AUDIO_CONTROL_SAMPLES samples. TCNT2 counts
+ * microseconds from the compare match, so reading it at the end of the
+ * handler measures the time taken on the board (all but the restore
+ * and return) - see audio_report().
+ */
+
+#define F_CPU 8000000UL	// 8MHz
+#include <stdio.h>
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#include "audio.h"
+#include "profile.h"
+#include "timer0.h"
+
+#if AUDIO_SAMPLE_RATE != 8000
+#error "noteSteps[] is worked out for 8000 samples a second"
+#endif
+#if AUDIO_VOICES != 3
+#error "The interrupt handler mixes three voices"
+#endif
+
+// Timer 2 counts (microseconds) between samples, and CPU cycles in
+// each count
+#define SAMPLE_PERIOD	(F_CPU / 8 / AUDIO_SAMPLE_RATE)
+#define CYCLES_PER_US	(F_CPU / 1000000)
+
+// Control tick slot in which the interrupt handler adds up its timing
+#define FOLD_SLOT		AUDIO_VOICES
+
+// Wavetables
+#define WAVE_SINE		0
+#define WAVE_TRIANGLE	1
+#define WAVE_SQUARE		2
+#define WAVE_SAWTOOTH	3
+#define WAVE_NOISE		4
+#define NUM_WAVES		5
+
+// Notes are MIDI note numbers, e.g. NOTE(A, 4) is 440Hz. noteSteps[]
+// covers NOTE(C, 2) (65Hz) to NOTE(DS, 7) (2.5kHz).
+#define NOTE_C		0
+#define NOTE_CS		1
+#define NOTE_D		2
+#define NOTE_DS		3
+#define NOTE_E		4
+#define NOTE_F		5
+#define NOTE_FS		6
+#define NOTE_G		7
+#define NOTE_GS		8
+#define NOTE_A		9
+#define NOTE_AS		10
+#define NOTE_B		11
+#define NOTE(name, octave)	(12 * ((octave) + 1) + NOTE_##name)
+#define NOTE_LOWEST			NOTE(C, 2)
+
+typedef struct {
+	uint8_t	note;		// NOTE(...) value
+	uint8_t	length;		// control ticks, 0 at the end of the tune
+	uint8_t	wave;		// WAVE_... value
+	uint8_t	level;		// envelope level at the start of the note
+	uint8_t	decay;		// level lost each control tick
+} AudioNote;
+
+// A silent note, the end of a tune, and the end of a tune which carries
+// on from the note with the given index
+#define REST(length)	{ NOTE_LOWEST, (length), WAVE_SINE, 0, 0 }
+#define TUNE_END		{ 0, 0, 0, 0, 0 }
+#define TUNE_REPEAT		0xFF
+#define TUNE_REPEAT_FROM(index)	{ (index), 0, TUNE_REPEAT, 0, 0 }
+
+typedef struct {
+	const AudioNote*	tune;
+	uint8_t				voice;
+} AudioSound;
+
+typedef struct {
+	uint16_t			phase;
+	uint16_t			step;		// phase added each sample (0 for silence)
+	uint8_t				table;		// high byte of the wavetable's address
+	uint8_t				level;
+	uint8_t				decay;
+	uint8_t				ticksLeft;	// of the current note, 0 if not playing
+	const AudioNote*	next;		// note after the current one
+	const AudioNote*	tune;		// first note of the sound being played
+} Voice;
+
+// Each wavetable starts on a 256 byte boundary, so the high byte of a
+// sample's address is the table and the low byte the top of the phase
+static const int8_t waves[NUM_WAVES][256] PROGMEM __attribute__((aligned(256))) = {
+	{	// sine
+		0, 3, 6, 9, 12, 16, 19, 22, 25, 28, 31, 34, 37, 40, 43, 46,
+		49, 51, 54, 57, 60, 63, 65, 68, 71, 73, 76, 78, 81, 83, 85, 88,
+		90, 92, 94, 96, 98, 100, 102, 104, 106, 107, 109, 111, 112, 113, 115, 116,
+		117, 118, 120, 121, 122, 122, 123, 124, 125, 125, 126, 126, 126, 127, 127, 127,
+		127, 127, 127, 127, 126, 126, 126, 125, 125, 124, 123, 122, 122, 121, 120, 118,
+		117, 116, 115, 113, 112, 111, 109, 107, 106, 104, 102, 100, 98, 96, 94, 92,
+		90, 88, 85, 83, 81, 78, 76, 73, 71, 68, 65, 63, 60, 57, 54, 51,
+		49, 46, 43, 40, 37, 34, 31, 28, 25, 22, 19, 16, 12, 9, 6, 3,
+		0, -3, -6, -9, -12, -16, -19, -22, -25, -28, -31, -34, -37, -40, -43, -46,
+		-49, -51, -54, -57, -60, -63, -65, -68, -71, -73, -76, -78, -81, -83, -85, -88,
+		-90, -92, -94, -96, -98, -100, -102, -104, -106, -107, -109, -111, -112, -113, -115, -116,
+		-117, -118, -120, -121, -122, -122, -123, -124, -125, -125, -126, -126, -126, -127, -127, -127,
+		-127, -127, -127, -127, -126, -126, -126, -125, -125, -124, -123, -122, -122, -121, -120, -118,
+		-117, -116, -115, -113, -112, -111, -109, -107, -106, -104, -102, -100, -98, -96, -94, -92,
+		-90, -88, -85, -83, -81, -78, -76, -73, -71, -68, -65, -63, -60, -57, -54, -51,
+		-49, -46, -43, -40, -37, -34, -31, -28, -25, -22, -19, -16, -12, -9, -6, -3
+	},
+	{	// triangle
+		0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30,
+		32, 34, 36, 38, 40, 42, 44, 46, 48, 50, 52, 54, 56, 58, 60, 62,
+		64, 66, 68, 70, 72, 74, 76, 78, 80, 82, 84, 86, 88, 90, 92, 94,
+		96, 98, 100, 102, 104, 106, 108, 110, 112, 114, 116, 118, 120, 122, 124, 126,
+		127, 126, 124, 122, 120, 118, 116, 114, 112, 110, 108, 106, 104, 102, 100, 98,
+		96, 94, 92, 90, 88, 86, 84, 82, 80, 78, 76, 74, 72, 70, 68, 66,
+		64, 62, 60, 58, 56, 54, 52, 50, 48, 46, 44, 42, 40, 38, 36, 34,
+		32, 30, 28, 26, 24, 22, 20, 18, 16, 14, 12, 10, 8, 6, 4, 2,
+		0, -2, -4, -6, -8, -10, -12, -14, -16, -18, -20, -22, -24, -26, -28, -30,
+		-32, -34, -36, -38, -40, -42, -44, -46, -48, -50, -52, -54, -56, -58, -60, -62,
+		-64, -66, -68, -70, -72, -74, -76, -78, -80, -82, -84, -86, -88, -90, -92, -94,
+		-96, -98, -100, -102, -104, -106, -108, -110, -112, -114, -116, -118, -120, -122, -124, -126,
+		-127, -126, -124, -122, -120, -118, -116, -114, -112, -110, -108, -106, -104, -102, -100, -98,
+		-96, -94, -92, -90, -88, -86, -84, -82, -80, -78, -76, -74, -72, -70, -68, -66,
+		-64, -62, -60, -58, -56, -54, -52, -50, -48, -46, -44, -42, -40, -38, -36, -34,
+		-32, -30, -28, -26, -24, -22, -20, -18, -16, -14, -12, -10, -8, -6, -4, -2
+	},
+	{	// square
+		100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100,
+		100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100,
+		100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100,
+		100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100,
+		100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100,
+		100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100,
+		100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100,
+		100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100, 100,
+		-100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100,
+		-100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100,
+		-100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100,
+		-100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100,
+		-100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100,
+		-100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100,
+		-100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100,
+		-100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100, -100
+	},
+	{	// sawtooth
+		-127, -127, -126, -125, -124, -123, -122, -121, -120, -119, -118, -117, -116, -115, -114, -113,
+		-112, -111, -110, -109, -108, -107, -106, -105, -104, -103, -102, -101, -100, -99, -98, -97,
+		-96, -95, -94, -93, -92, -91, -90, -89, -88, -87, -86, -85, -84, -83, -82, -81,
+		-80, -79, -78, -77, -76, -75, -74, -73, -72, -71, -70, -69, -68, -67, -66, -65,
+		-64, -63, -62, -61, -60, -59, -58, -57, -56, -55, -54, -53, -52, -51, -50, -49,
+		-48, -47, -46, -45, -44, -43, -42, -41, -40, -39, -38, -37, -36, -35, -34, -33,
+		-32, -31, -30, -29, -28, -27, -26, -25, -24, -23, -22, -21, -20, -19, -18, -17,
+		-16, -15, -14, -13, -12, -11, -10, -9, -8, -7, -6, -5, -4, -3, -2, -1,
+		0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+		16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31,
+		32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47,
+		48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 63,
+		64, 65, 66, 67, 68, 69, 70, 71, 72, 73, 74, 75, 76, 77, 78, 79,
+		80, 81, 82, 83, 84, 85, 86, 87, 88, 89, 90, 91, 92, 93, 94, 95,
+		96, 97, 98, 99, 100, 101, 102, 103, 104, 105, 106, 107, 108, 109, 110, 111,
+		112, 113, 114, 115, 116, 117, 118, 119, 120, 121, 122, 123, 124, 125, 126, 127
+	},
+	{	// noise
+		70, -2, 1, -21, -53, 123, 98, 123, -44, 118, 61, 95, -4, -100, 97, 7,
+		-127, 63, -79, 94, -42, -14, -113, -57, -25, -26, 7, -39, 42, 8, -68, -39,
+		106, -42, -109, -5, 82, 5, 33, 88, -68, -44, -43, -81, -73, 46, -27, -37,
+		90, -126, -7, 24, 76, 99, -102, -10, 14, -33, 89, 25, 15, -97, -65, -74,
+		110, -61, -8, -51, -115, 122, 62, 38, 90, 100, 6, 14, 92, -87, -19, -50,
+		127, -42, 97, -16, -96, 123, 15, 49, -40, -123, 16, 69, -119, 92, -45, 77,
+		42, -69, -56, 25, -46, 83, -46, 29, -122, 31, 106, 53, 66, -122, -109, 24,
+		-55, 50, -127, -98, 44, -78, 8, -79, 28, -46, -58, 21, -15, -74, 15, -41,
+		118, -71, -99, -106, 122, 8, -12, 117, 24, -4, -105, -36, -63, 59, -19, -15,
+		14, -113, -16, -39, 71, -127, -101, -81, -77, -67, 17, 64, -99, 37, -115, -115,
+		43, -77, 13, -2, -34, 15, -66, 102, -24, -12, 38, -70, 49, 67, 19, -111,
+		40, -28, 71, 91, 74, 96, -32, 97, 115, 63, -119, -127, -25, 34, 99, -91,
+		32, -95, -79, 7, 85, -30, 69, 40, -49, -2, -82, -119, -21, 20, 31, 48,
+		-19, 41, 30, -38, -117, -58, -16, 0, 54, 79, -57, -116, 38, 37, -86, 88,
+		44, 123, 32, 107, 55, -7, -92, -14, -93, 18, -56, 0, 69, 38, 39, 5,
+		55, 87, 12, 16, 100, 43, -29, -60, -46, -26, 99, 28, -77, -91, 121, -34
+	}
+};
+
+// Phase step for each note from NOTE_LOWEST - 65536 * frequency /
+// AUDIO_SAMPLE_RATE
+static const uint16_t noteSteps[] PROGMEM = {
+	536, 568, 601, 637, 675, 715, 758, 803,
+	851, 901, 955, 1011, 1072, 1135, 1203, 1274,
+	1350, 1430, 1515, 1606, 1701, 1802, 1909, 2023,
+	2143, 2271, 2406, 2549, 2700, 2861, 3031, 3211,
+	3402, 3604, 3819, 4046, 4286, 4541, 4811, 5098,
+	5401, 5722, 6062, 6422, 6804, 7209, 7638, 8092,
+	8573, 9083, 9623, 10195, 10801, 11444, 12124, 12845,
+	13609, 14418, 15275, 16184, 17146, 18165, 19246, 20390
+};
+
+// The start jingle and the bass line which follows it
+static const AudioNote tuneMusic[] PROGMEM = {
+	{ NOTE(C, 5), 12, WAVE_SQUARE, 72, 4 },
+	{ NOTE(E, 5), 12, WAVE_SQUARE, 72, 4 },
+	{ NOTE(G, 5), 12, WAVE_SQUARE, 72, 4 },
+	{ NOTE(C, 6), 36, WAVE_SQUARE, 72, 2 },
+	REST(24),
+	{ NOTE(A, 2), 15, WAVE_TRIANGLE, 112, 3 },
+	{ NOTE(A, 2), 15, WAVE_TRIANGLE, 96, 3 },
+	{ NOTE(E, 3), 15, WAVE_TRIANGLE, 96, 3 },
+	{ NOTE(A, 2), 15, WAVE_TRIANGLE, 96, 3 },
+	{ NOTE(F, 2), 15, WAVE_TRIANGLE, 112, 3 },
+	{ NOTE(F, 2), 15, WAVE_TRIANGLE, 96, 3 },
+	{ NOTE(C, 3), 15, WAVE_TRIANGLE, 96, 3 },
+	{ NOTE(F, 2), 15, WAVE_TRIANGLE, 96, 3 },
+	{ NOTE(G, 2), 15, WAVE_TRIANGLE, 112, 3 },
+	{ NOTE(G, 2), 15, WAVE_TRIANGLE, 96, 3 },
+	{ NOTE(D, 3), 15, WAVE_TRIANGLE, 96, 3 },
+	{ NOTE(G, 2), 15, WAVE_TRIANGLE, 96, 3 },
+	{ NOTE(E, 2), 15, WAVE_TRIANGLE, 112, 3 },
+	{ NOTE(E, 2), 15, WAVE_TRIANGLE, 96, 3 },
+	{ NOTE(B, 2), 15, WAVE_TRIANGLE, 96, 3 },
+	{ NOTE(GS, 2), 15, WAVE_TRIANGLE, 96, 3 },
+	TUNE_REPEAT_FROM(5)
+};
+
+static const AudioNote tuneFire[] PROGMEM = {
+	{ NOTE(A, 6), 2, WAVE_SQUARE, 120, 32 },
+	{ NOTE(E, 6), 3, WAVE_SQUARE, 96, 24 },
+	TUNE_END
+};
+
+static const AudioNote tuneHit[] PROGMEM = {
+	{ NOTE(C, 3), 3, WAVE_NOISE, 160, 16 },
+	{ NOTE(C, 2), 8, WAVE_NOISE, 112, 14 },
+	TUNE_END
+};
+
+static const AudioNote tuneLifeLost[] PROGMEM = {
+	{ NOTE(E, 4), 12, WAVE_SAWTOOTH, 128, 6 },
+	{ NOTE(DS, 4), 12, WAVE_SAWTOOTH, 128, 6 },
+	{ NOTE(D, 4), 12, WAVE_SAWTOOTH, 128, 6 },
+	{ NOTE(CS, 4), 48, WAVE_SAWTOOTH, 128, 2 },
+	TUNE_END
+};
+
+static const AudioNote tuneGameOver[] PROGMEM = {
+	{ NOTE(G, 4), 20, WAVE_SINE, 144, 3 },
+	{ NOTE(E, 4), 20, WAVE_SINE, 144, 3 },
+	{ NOTE(C, 4), 20, WAVE_SINE, 144, 3 },
+	{ NOTE(G, 3), 80, WAVE_SINE, 160, 2 },
+	TUNE_END
+};
+
+// Indexed by AUDIO_SOUND_...
+static const AudioSound sounds[AUDIO_NUM_SOUNDS] PROGMEM = {
+	{ tuneMusic, 0 },
+	{ tuneFire, 1 },
+	{ tuneHit, 2 },
+	{ tuneLifeLost, 2 },
+	{ tuneGameOver, 0 }
+};
+
+static Voice voices[AUDIO_VOICES];
+
+// Sample number within the control tick
+static uint8_t controlCount;
+
+// Timing of the interrupt handler (timer 2 counts - microseconds). The
+// time for the samples since the last FOLD_SLOT is added up in
+// busyBlock and moved into busyTotal once every control tick.
+static uint16_t busyBlock;
+static uint8_t busyMax;
+static uint32_t busyTotal;
+static uint32_t samples;
+// Part of busyTotal added to the profiling counter
+static uint32_t busyProfiled;
+
+// The next sample of a voice, scaled by its envelope level
+static inline int8_t voice_sample(Voice* v) __attribute__((always_inline));
+static inline int8_t voice_sample(Voice* v) {
+	uint16_t phase = v->phase + v->step;
+	int8_t sample;
+
+	v->phase = phase;
+	sample = (int8_t)pgm_read_byte(((uint16_t)v->table << 8) | (phase >> 8));
+	return ((int16_t)sample * v->level) >> 8;
+}
+
+// Turn the sample interrupt off if no voice is playing, leaving the
+// output half way
+static inline void stop_if_silent(void) __attribute__((always_inline));
+static inline void stop_if_silent(void) {
+	if(!(voices[0].ticksLeft | voices[1].ticksLeft | voices[2].ticksLeft)) {
+		TIMSK2 &= ~(1 << OCIE2A);
+		OCR1BL = 0x80;
+	}
+}
+
+// Move a voice's envelope and tune on by a control tick
+static inline void voice_control(Voice* v) __attribute__((always_inline));
+static inline void voice_control(Voice* v) {
+	const AudioNote* note;
+	uint8_t length;
+
+	if(v->level > v->decay) {
+		v->level -= v->decay;
+	} else {
+		v->level = 0;
+	}
+	if(v->ticksLeft == 0 || --v->ticksLeft) {
+		return;
+	}
+
+	// The note has finished - start the next one
+	note = v->next;
+	length = pgm_read_byte(&note->length);
+	if(length == 0) {
+		if(pgm_read_byte(&note->wave) != TUNE_REPEAT) {
+			v->level = 0;
+			stop_if_silent();
+			return;
+		}
+		note = v->tune + pgm_read_byte(&note->note);
+		length = pgm_read_byte(&note->length);
+	}
+	v->next = note + 1;
+	v->ticksLeft = length;
+	v->step = pgm_read_word(&noteSteps[pgm_read_byte(&note->note) - NOTE_LOWEST]);
+	v->table = (uint8_t)((uint16_t)(uintptr_t)waves >> 8) + pgm_read_byte(&note->wave);
+	v->level = pgm_read_byte(&note->level);
+	v->decay = pgm_read_byte(&note->decay);
+}
+
+ISR(TIMER2_COMPA_vect) {
+	int16_t mix;
+	uint8_t control, time;
+
+	// Written out for each voice, so each voice is found at a fixed
+	// address
+	mix = voice_sample(&voices[0]);
+	mix += voice_sample(&voices[1]);
+	mix += voice_sample(&voices[2]);
+
+	// Halve, clip to 8 bits and make silence half way
+	mix >>= 1;
+	if(mix > INT8_MAX) {
+		mix = INT8_MAX;
+	} else if(mix < INT8_MIN) {
+		mix = INT8_MIN;
+	}
+	OCR1BL = (uint8_t)mix ^ 0x80;
+
+	// One voice is moved on in each of the first samples of a control
+	// tick
+	control = (controlCount + 1) & (AUDIO_CONTROL_SAMPLES - 1);
+	controlCount = control;
+	if(control < AUDIO_VOICES) {
+		voice_control(&voices[control]);
+	}
+
+	time = TCNT2;
+	busyBlock += time;
+	if(time > busyMax) {
+		busyMax = time;
+	}
+	if(control == FOLD_SLOT) {
+		busyTotal += busyBlock;
+		busyBlock = 0;
+		samples += AUDIO_CONTROL_SAMPLES;
+	}
+}
+
+// With the sample interrupt off, add the samples since the last
+// FOLD_SLOT to the totals, and start the next control tick there
+static void fold_stopped(void) {
+	busyTotal += busyBlock;
+	busyBlock = 0;
+	samples += (uint8_t)(controlCount - FOLD_SLOT) & (AUDIO_CONTROL_SAMPLES - 1);
+	controlCount = FOLD_SLOT;
+}
+
+void audio_init(void) {
+	for(uint8_t i = 0; i < AUDIO_VOICES; i++) {
+		voices[i].step = 0;
+		voices[i].level = 0;
+		voices[i].decay = 0;
+		voices[i].ticksLeft = 0;
+		voices[i].table = (uint8_t)((uint16_t)(uintptr_t)waves >> 8);
+	}
+	controlCount = FOLD_SLOT;
+
+	// Timer 1 - 8 bit fast PWM, not prescaled (31.25kHz). OC1B is
+	// cleared on compare match and set at the bottom (non-inverting).
+	OCR1B = 0x80;
+	TCCR1A = (1 << COM1B1) | (1 << WGM10);
+	TCCR1B = (1 << WGM12) | (1 << CS10);
+
+	// Timer 2 - clear on compare match, counting at 1MHz (clock / 8),
+	// a compare match every sample. The interrupt is turned on while a
+	// sound is playing.
+	TCNT2 = 0;
+	OCR2A = SAMPLE_PERIOD - 1;
+	TCCR2A = (1 << WGM21);
+	TCCR2B = (1 << CS21);
+	TIMSK2 &= ~(1 << OCIE2A);
+}
+
+void audio_play(uint8_t sound) {
+	const AudioSound* s = &sounds[sound];
+	Voice* v = &voices[pgm_read_byte(&s->voice)];
+	uint8_t interrupts_were_enabled = bit_is_set(SREG, SREG_I);
+
+	cli();
+	v->tune = (const AudioNote*)pgm_read_word(&s->tune);
+	v->next = v->tune;
+	v->ticksLeft = 1;
+	if(!(TIMSK2 & (1 << OCIE2A))) {
+		fold_stopped();
+		TCNT2 = 0;
+		TIFR2 = (1 << OCF2A);
+		TIMSK2 |= (1 << OCIE2A);
+	}
+	if(interrupts_were_enabled) {
+		sei();
+	}
+}
+
+void audio_stop(uint8_t voice) {
+	uint8_t interrupts_were_enabled = bit_is_set(SREG, SREG_I);
+	cli();
+	voices[voice].ticksLeft = 0;
+	voices[voice].level = 0;
+	stop_if_silent();
+	if(interrupts_were_enabled) {
+		sei();
+	}
+}
+
+uint8_t audio_playing(uint8_t voice) {
+	uint8_t playing;
+	uint8_t interrupts_were_enabled = bit_is_set(SREG, SREG_I);
+	cli();
+	playing = voices[voice].ticksLeft != 0;
+	if(interrupts_were_enabled) {
+		sei();
+	}
+	return playing;
+}
+
+void audio_task(void) {
+	uint32_t busy;
+	uint16_t counts;
+	uint8_t interrupts_were_enabled = bit_is_set(SREG, SREG_I);
+
+	cli();
+	if(!(TIMSK2 & (1 << OCIE2A))) {
+		fold_stopped();
+	}
+	busy = busyTotal - busyProfiled;
+	if(interrupts_were_enabled) {
+		sei();
+	}
+	if(busy < FAST_TIME_US_PER_COUNT) {
+		return;
+	}
+	// Anything too long for one record is left for the next
+	counts = busy / FAST_TIME_US_PER_COUNT > UINT16_MAX ?
+			UINT16_MAX : busy / FAST_TIME_US_PER_COUNT;
+	busyProfiled += FAST_TIME_TO_US(counts);
+	PROFILE_RECORD(PROFILE_AUDIO_ISR, counts);
+}
+
+void audio_reset_stats(void) {
+	uint8_t interrupts_were_enabled = bit_is_set(SREG, SREG_I);
+	cli();
+	busyBlock = 0;
+	busyMax = 0;
+	busyTotal = 0;
+	samples = 0;
+	busyProfiled = 0;
+	if(!(TIMSK2 & (1 << OCIE2A))) {
+		controlCount = FOLD_SLOT;
+	}
+	if(interrupts_were_enabled) {
+		sei();
+	}
+}
+
+void audio_report(void) {
+	uint32_t busy, count, cycles, permille;
+	uint8_t worst;
+	uint8_t interrupts_were_enabled = bit_is_set(SREG, SREG_I);
+
+	cli();
+	if(!(TIMSK2 & (1 << OCIE2A))) {
+		fold_stopped();
+	}
+	busy = busyTotal;
+	count = samples;
+	worst = busyMax;
+	if(interrupts_were_enabled) {
+		sei();
+	}
+	if(count == 0) {
+		return;
+	}
+	// Each timer 2 count is a microsecond - CYCLES_PER_US cycles
+	cycles = busy / count * CYCLES_PER_US + (busy % count) * CYCLES_PER_US / count;
+	permille = cycles * 1000 / (CYCLES_PER_US * SAMPLE_PERIOD);
+	printf_P(PSTR("audio: %lu samples, mean=%lu cycles worst=%lu cycles, %lu.%lu%% of the CPU while playing\n"),
+			count, cycles, (uint32_t)worst * CYCLES_PER_US, permille / 10, permille % 10);
+}
@@ -0,0 +1,83 @@
+/*
+ * audio.h
+ *
+ * Sound, made by a wavetable (DDS) synthesiser. Timer 2 interrupts
+ * AUDIO_SAMPLE_RATE times a second and the interrupt handler works out
+ * the next sample of each of the AUDIO_VOICES voices, mixes them and
+ * writes the result to the PWM output (timer 1 in 8 bit fast PWM mode,
+ * 31.25kHz, on OC1B - port D pin 4 - which wants a simple RC low pass
+ * filter before the amplifier or speaker).
+ *
+ * Each voice has a 16 bit phase accumulator which is stepped on by the
+ * pitch of the note being played. The top 8 bits of the phase index a
+ * 256 sample wavetable (sine, triangle, square, sawtooth or noise) kept
+ * in program memory, and the sample is scaled by the voice's envelope
+ * level. A note starts at its own level and loses its decay every
+ * control tick (AUDIO_CONTROL_SAMPLES samples, 8ms).
+ *
+ * The voices play sounds (see audio_play()) - tunes of notes kept in
+ * program memory, which the interrupt handler moves through itself, so
+ * they carry on playing while the main loop is busy or blocked. Voice 0
+ * plays the music and voices 1 and 2 the effects, so music and effects
+ * overlap. The timer 2 interrupt is turned off whenever no voice is
+ * playing, so sound costs nothing when it is silent.
+ *
+ * The time the interrupt handler takes is measured on every sample (see
+ * audio_report()) and added to the PROFILE_AUDIO_ISR profiling counter
+ * by audio_task().
+ */
+
+#ifndef AUDIO_H_
+#define AUDIO_H_
+
+#include <stdint.h>
+
+// Samples per second. The note pitch table in audio.c is worked out
+// for this rate.
+#define AUDIO_SAMPLE_RATE		8000
+
+// Number of voices - the interrupt handler is written out for three
+#define AUDIO_VOICES			3
+
+// Samples in each control tick, when the envelopes and tunes are moved
+// on (one voice in each of the first AUDIO_VOICES samples of the tick).
+// Must be a power of 2.
+#define AUDIO_CONTROL_SAMPLES	64
+
+// Sounds
+#define AUDIO_SOUND_MUSIC		0		// start jingle, then a bass line over and over
+#define AUDIO_SOUND_FIRE		1
+#define AUDIO_SOUND_HIT			2
+#define AUDIO_SOUND_LIFE_LOST	3
+#define AUDIO_SOUND_GAME_OVER	4
+#define AUDIO_NUM_SOUNDS		5
+
+// Set up timer 1 (PWM output) and timer 2 (sample clock), with all
+// voices silent. OC1B (port D pin 4) must be made an output for the
+// sound to be heard.
+void audio_init(void);
+
+// Start playing a sound (one of the AUDIO_SOUND_... values) on its
+// voice, in place of whatever the voice was playing. It starts at the
+// voice's next control tick.
+void audio_play(uint8_t sound);
+
+// Silence a voice
+void audio_stop(uint8_t voice);
+
+// Returns 1 if the voice is playing a sound, 0 if not
+uint8_t audio_playing(uint8_t voice);
+
+// Add the time spent in the interrupt handler since the last call to
+// the PROFILE_AUDIO_ISR profiling counter. Call once a frame.
+void audio_task(void);
+
+// Clear the statistics
+void audio_reset_stats(void);
+
+// Print the samples played and the time the interrupt handler takes
+// for each sample (mean and worst case) and its share of the CPU to
+// standard output
+void audio_report(void);
+
+#endif /* AUDIO_H_ */
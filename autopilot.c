@@ -0,0 +1,311 @@
+/*
+ * autopilot.c
+ *
+ * The computer player - see autopilot.h
+ *
+ * The search is a depth first search of every line of moves, each ply
+ * worked out on a copy of the node before it (kept on the stack). Moves
+ * which would do the same as doing nothing (moving into the edge of the
+ * field, firing where there is already a projectile) aren't tried.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+#include "autopilot.h"
+#include "game.h"
+#include "entity.h"
+#include "profile.h"
+#include "timer0.h"
+
+// What things are worth to the player
+#define HIT_VALUE		64		// each asteroid cell hit
+#define SOONER_VALUE	8		// and for each ply sooner it is hit
+#define LIFE_VALUE		512		// each life lost
+#define AIM_VALUE		2		// for each column closer to an asteroid to shoot
+#define THREAT_VALUE	8		// each asteroid cell just above the base
+#define THREAT_ROWS		4		// how far above the base asteroids are a threat
+
+typedef struct {
+	FieldRowMask	asteroids[FIELD_HEIGHT];
+	FieldRowMask	projectiles[FIELD_HEIGHT];
+	int8_t			base;
+	uint16_t		projectileOwed;
+	uint16_t		asteroidOwed;
+} SearchNode;
+
+// The moves, in the order they are tried. The first of the best moves
+// is chosen, so the autopilot stays put unless moving is better.
+static const uint8_t moves[] = {
+	AUTOPILOT_NONE, AUTOPILOT_FIRE, AUTOPILOT_LEFT, AUTOPILOT_RIGHT
+};
+#define NUM_MOVES (sizeof(moves) / sizeof(moves[0]))
+
+// The decision being made - the step periods and ply length, and the
+// nodes which can still be searched (outOfNodes is set when they run
+// out and the search is abandoned)
+static uint16_t		projectilePeriod;
+static uint16_t		asteroidPeriod;
+static uint16_t		ply;
+static uint16_t		nodesLeft;
+static uint8_t		outOfNodes;
+
+// Statistics
+static uint32_t		decisions;
+static uint32_t		nodesSearched;
+static uint32_t		depthTotal;
+static uint32_t		timeTotal;		// timer counts
+static uint16_t		timeMax;		// timer counts
+
+static uint8_t count_cells(FieldRowMask mask) {
+	uint8_t count = 0;
+	while(mask) {
+		mask &= mask - 1;
+		count++;
+	}
+	return count;
+}
+
+// The positions in a row covered by the hit zone of a base at column x
+static FieldRowMask base_zone(int8_t x) {
+	FieldRowMask zone = FIELD_COLUMN_BIT(x);
+	if(x > 0) {
+		zone |= FIELD_COLUMN_BIT(x - 1);
+	}
+	return (zone | (zone << 1)) & FIELD_ROW_MASK;
+}
+
+// Move every projectile up a row. Returns the number of asteroid cells
+// hit.
+static uint8_t step_projectiles(SearchNode* node) {
+	FieldRowMask moving, hits;
+	uint8_t count = 0;
+	node->projectiles[FIELD_HEIGHT - 1] = 0;
+	for(uint8_t y = FIELD_HEIGHT - 1; y-- > 0; ) {
+		moving = node->projectiles[y];
+		node->projectiles[y] = 0;
+		if(y + 1 == FIELD_HEIGHT - 1) {
+			// Gone off the top
+			continue;
+		}
+		hits = moving & node->asteroids[y + 1];
+		if(hits) {
+			node->asteroids[y + 1] &= ~hits;
+			count += count_cells(hits);
+		}
+		node->projectiles[y + 1] = moving & ~hits;
+	}
+	return count;
+}
+
+// Move every asteroid down a row. Returns the number of projectiles
+// hit, and sets *livesLost to the number of asteroid cells which
+// reached the base's hit zone.
+static uint8_t step_asteroids(SearchNode* node, uint8_t* livesLost) {
+	FieldRowMask moving, hits;
+	uint8_t count = 0;
+	for(uint8_t y = 0; y < FIELD_HEIGHT - 1; y++) {
+		moving = node->asteroids[y + 1];
+		hits = moving & node->projectiles[y];
+		if(hits) {
+			node->projectiles[y] &= ~hits;
+			count += count_cells(hits);
+		}
+		node->asteroids[y] = moving & ~hits;
+	}
+	node->asteroids[FIELD_HEIGHT - 1] = 0;
+	*livesLost = count_cells(node->asteroids[1] & base_zone(node->base));
+	// Asteroids reaching the bottom row are taken away (to go back to
+	// the top, in the game)
+	node->asteroids[0] = 0;
+	return count;
+}
+
+// Returns 1 if the move would change anything, 0 if not
+static uint8_t move_useful(const SearchNode* node, uint8_t move) {
+	switch(move) {
+		case AUTOPILOT_LEFT:
+			return node->base > 0;
+		case AUTOPILOT_RIGHT:
+			return node->base < FIELD_WIDTH - 1;
+		case AUTOPILOT_FIRE:
+			return !(node->projectiles[2] & FIELD_COLUMN_BIT(node->base));
+		default:
+			return 1;
+	}
+}
+
+// Make the move and run the steps due during the ply, with depth plies
+// left to search (counting this one). Returns the value of what
+// happened.
+static int16_t play_ply(SearchNode* node, uint8_t move, uint8_t depth) {
+	int16_t hitValue = HIT_VALUE + SOONER_VALUE * depth;
+	int16_t value = 0;
+	uint8_t livesLost;
+	FieldRowMask column = FIELD_COLUMN_BIT(node->base);
+
+	switch(move) {
+		case AUTOPILOT_LEFT:
+			node->base--;
+			break;
+		case AUTOPILOT_RIGHT:
+			node->base++;
+			break;
+		case AUTOPILOT_FIRE:
+			if(node->asteroids[2] & column) {
+				// Fired straight into an asteroid
+				node->asteroids[2] &= ~column;
+				value += hitValue;
+			} else {
+				node->projectiles[2] |= column;
+			}
+			break;
+	}
+
+	// The projectile steps are run before the asteroid steps, as in the
+	// main loop
+	node->projectileOwed += ply;
+	while(node->projectileOwed >= projectilePeriod) {
+		node->projectileOwed -= projectilePeriod;
+		value += hitValue * step_projectiles(node);
+	}
+	node->asteroidOwed += ply;
+	while(node->asteroidOwed >= asteroidPeriod) {
+		node->asteroidOwed -= asteroidPeriod;
+		value += hitValue * step_asteroids(node, &livesLost);
+		value -= LIFE_VALUE * livesLost;
+	}
+	return value;
+}
+
+// Value of the position in a node at the end of the search
+static int16_t evaluate(const SearchNode* node) {
+	int16_t value = 0;
+	FieldRowMask zone = base_zone(node->base);
+	FieldRowMask targets = 0, targeted = 0;
+	uint8_t y, distance;
+
+	// Asteroids close above the base, the closest counting the most
+	for(y = 2; y < 2 + THREAT_ROWS && y < FIELD_HEIGHT; y++) {
+		value -= THREAT_VALUE * (2 + THREAT_ROWS - y) *
+				count_cells(node->asteroids[y] & zone);
+	}
+
+	// Columns with asteroids in them which no projectile is on its way
+	// to, and how far the base is from the nearest
+	for(y = 2; y < FIELD_HEIGHT; y++) {
+		targets |= node->asteroids[y];
+		targeted |= node->projectiles[y];
+	}
+	targets &= ~targeted;
+	for(distance = 0; distance < FIELD_WIDTH; distance++) {
+		if(node->base >= distance &&
+				(targets & FIELD_COLUMN_BIT(node->base - distance))) {
+			break;
+		}
+		if(node->base + distance < FIELD_WIDTH &&
+				(targets & FIELD_COLUMN_BIT(node->base + distance))) {
+			break;
+		}
+	}
+	value += AIM_VALUE * (FIELD_WIDTH - distance);
+	return value;
+}
+
+// Value of the best line of play from the node over depth plies. If
+// bestMove isn't 0, the first move of the line is put in it. Returns 0
+// with outOfNodes set if the nodes run out.
+static int16_t search(const SearchNode* node, uint8_t depth, uint8_t* bestMove) {
+	SearchNode child;
+	int16_t value, best = INT16_MIN;
+
+	if(depth == 0) {
+		return evaluate(node);
+	}
+	for(uint8_t i = 0; i < NUM_MOVES; i++) {
+		if(!move_useful(node, moves[i])) {
+			continue;
+		}
+		if(nodesLeft == 0) {
+			outOfNodes = 1;
+			return 0;
+		}
+		nodesLeft--;
+		child = *node;
+		value = play_ply(&child, moves[i], depth);
+		value += search(&child, depth - 1, 0);
+		if(outOfNodes) {
+			return 0;
+		}
+		if(value > best) {
+			best = value;
+			if(bestMove) {
+				*bestMove = moves[i];
+			}
+		}
+	}
+	return best;
+}
+
+uint8_t autopilot_decide(uint8_t player, const GameTimers* timers, uint16_t plyMs) {
+	SearchNode root;
+	uint8_t move = AUTOPILOT_NONE, depthMove, depth;
+	uint16_t start = get_fast_time();
+	uint16_t elapsed;
+
+	game_copy_board(ENTITY_ASTEROID, root.asteroids);
+	game_copy_board(ENTITY_PROJECTILE, root.projectiles);
+	root.base = game_base_position(player);
+	root.projectileOwed = timers->projectileOwed;
+	root.asteroidOwed = timers->asteroidOwed;
+	projectilePeriod = timers->projectilePeriod ? timers->projectilePeriod : 1;
+	asteroidPeriod = timers->asteroidPeriod ? timers->asteroidPeriod : 1;
+	ply = plyMs;
+
+	// Search one ply deeper each time, until the nodes run out
+	nodesLeft = AUTOPILOT_MAX_NODES;
+	outOfNodes = 0;
+	for(depth = 1; depth <= AUTOPILOT_MAX_DEPTH; depth++) {
+		depthMove = AUTOPILOT_NONE;
+		search(&root, depth, &depthMove);
+		if(outOfNodes) {
+			break;
+		}
+		move = depthMove;
+	}
+
+	elapsed = get_fast_time() - start;
+	decisions++;
+	nodesSearched += AUTOPILOT_MAX_NODES - nodesLeft;
+	depthTotal += depth - 1;
+	timeTotal += elapsed;
+	if(elapsed > timeMax) {
+		timeMax = elapsed;
+	}
+	PROFILE_RECORD(PROFILE_AUTOPILOT, elapsed);
+	return move;
+}
+
+void autopilot_reset_stats(void) {
+	decisions = 0;
+	nodesSearched = 0;
+	depthTotal = 0;
+	timeTotal = 0;
+	timeMax = 0;
+}
+
+void autopilot_report(void) {
+	uint32_t ms = FAST_TIME_TO_US(timeTotal) / 1000;
+	uint32_t nodesPerSecond = 0;
+	if(decisions == 0) {
+		return;
+	}
+	if(ms) {
+		nodesPerSecond = nodesSearched / ms * 1000 + (nodesSearched % ms) * 1000 / ms;
+	}
+	printf_P(PSTR("autopilot: %lu decisions, depth %lu.%lu, %lu nodes (%lu/s), mean=%luus max=%luus\n"),
+			decisions, depthTotal / decisions, depthTotal * 10 / decisions % 10,
+			nodesSearched, nodesPerSecond,
+			FAST_TIME_TO_US(timeTotal / decisions), FAST_TIME_TO_US(timeMax));
+}
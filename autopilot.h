@@ -0,0 +1,74 @@
+/*
+ * autopilot.h
+ *
+ * A computer player. Each time it is asked, it looks at the game field
+ * and decides what a player should do next - move their base left or
+ * right, fire or do nothing. It can play the game on its own (as an
+ * attract mode, or to give the board a steady, repeatable load while
+ * its performance is measured) or in place of one of the players of a
+ * linked game.
+ *
+ * The decision is made by searching the next few moves ahead. The
+ * asteroid and projectile bitboards (see game_copy_board()) and the
+ * base position are copied into a search node, and each of the moves
+ * the player could make is tried on a copy of the node. A ply is
+ * the time between decisions - the projectile and asteroid steps due
+ * during it are run on the bitboards, using the game's step timers, so
+ * the search knows which steps happen in which ply. The model is
+ * simpler than the game - each step moves everything one row, large
+ * asteroids lose only the cells which are hit and asteroids which reach
+ * the bottom don't come back - but is good enough to see a few steps
+ * ahead. Nodes are valued by the asteroids hit and lives lost on the
+ * way to them, less the asteroids close above the three columns of the
+ * base, plus a little for being close to a column with an asteroid in
+ * it which no projectile is on its way to.
+ *
+ * The search deepens one ply at a time until AUTOPILOT_MAX_NODES nodes
+ * have been searched or AUTOPILOT_MAX_DEPTH is reached, and uses the
+ * best move from the deepest search which finished. The budget is
+ * counted in nodes rather than time so that the same game state always
+ * gives the same move - each node takes roughly the same number of
+ * cycles, so this also bounds the time a decision takes (see
+ * autopilot_report()).
+ */
+
+#ifndef AUTOPILOT_H_
+#define AUTOPILOT_H_
+
+#include <stdint.h>
+#include "game.h"
+
+// Time between decisions (ms) - the length of a ply
+#define AUTOPILOT_PERIOD_MS		100
+
+// Search limits for each decision. Each ply deeper puts another search
+// node (2 * FIELD_HEIGHT * sizeof(FieldRowMask) + 5 bytes) on the
+// stack.
+#ifndef AUTOPILOT_MAX_DEPTH
+#define AUTOPILOT_MAX_DEPTH		5
+#endif
+#ifndef AUTOPILOT_MAX_NODES
+#define AUTOPILOT_MAX_NODES		384
+#endif
+
+// Moves (the same values as the NETPLAY_INPUT_... inputs - see netplay.h)
+#define AUTOPILOT_NONE			0x00
+#define AUTOPILOT_LEFT			0x01
+#define AUTOPILOT_RIGHT			0x02
+#define AUTOPILOT_FIRE			0x04
+
+// Decide the next move for the given player, with the steps due in
+// the coming plies of plyMs ms worked out from timers (the main loop's
+// step periods and the time already owed to each step). Returns one of
+// the AUTOPILOT_... moves.
+uint8_t autopilot_decide(uint8_t player, const GameTimers* timers, uint16_t plyMs);
+
+// Clear the statistics
+void autopilot_reset_stats(void);
+
+// Print the number of decisions, the mean depth searched, the nodes
+// searched per second and the time taken by each decision to standard
+// output
+void autopilot_report(void);
+
+#endif /* AUTOPILOT_H_ */
@@ -7,6 +7,8 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include "buttons.h"
+#include "latency.h"
+#include "profile.h"
 
 // Global variable to keep track of the last button state so that we 
 // can detect changes when an interrupt fires. The lower 4 bits (0 to 3)
@@ -69,8 +71,13 @@ int8_t button_pushed(void) {
 	return return_value;
 }
 
+int8_t button_push_available(void) {
+	return (queue_length > 0);
+}
+
 // Interrupt handler for a change on buttons
 ISR(PCINT1_vect) {
+	PROFILE_BEGIN(PROFILE_BUTTON_ISR);
 	// Get the current state of the buttons. We'll compare this with
 	// the last state to see what has changed.
 	uint8_t button_state = PINB & 0x0F;
@@ -87,9 +94,11 @@ ISR(PCINT1_vect) {
 			// Add the button push to the queue (and update the
 			// length of the queue
 			button_queue[queue_length++] = pin;
+			latency_input_event(LATENCY_SOURCE_BUTTON);
 		}
 	}
 	
 	// Remember this button state
 	last_button_state = button_state;
+	PROFILE_END(PROFILE_BUTTON_ISR);
 }
\ No newline at end of file
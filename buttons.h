@@ -30,5 +30,10 @@ void init_button_interrupts(void);
 
 int8_t button_pushed(void);
 
+/* Return 1 if there are button pushes waiting to be returned by
+ * button_pushed(), 0 otherwise. The queue is not changed.
+ */
+int8_t button_push_available(void);
+
 
 #endif /* BUTTONS_H_ */
\ No newline at end of file
@@ -0,0 +1,139 @@
+/*
+ * coroutine.h
+ *
+ * Stackless coroutines (protothreads) for flows which would otherwise be
+ * blocking loops - a screen waiting for a button push, an animation with
+ * pauses between its frames. A coroutine is a function which is called
+ * over and over (e.g. from the main loop) and carries on from where it
+ * stopped last time, so whatever calls it can get on with other things
+ * (input, sound, scrolling text) in between. Its state is a Coroutine -
+ * where to carry on from and when to wake up, 6 bytes - rather than a
+ * stack of its own.
+ *
+ * Where to carry on from is the line number of the macro which stopped
+ * the coroutine, and the body is a switch statement on it (the case
+ * labels are put in by the CORO_ macros), so:
+ * - local variables are not kept while the coroutine is stopped - keep
+ *   anything needed afterwards in static or global variables
+ * - a switch statement in the body can't contain one of the macros which
+ *   stop the coroutine
+ * - only one of those macros can be used on each line
+ *
+ * e.g.
+ *		uint8_t blink_task(Coroutine* c) {
+ *			CORO_BEGIN(c);
+ *			while(1) {
+ *				led_on();
+ *				CORO_SLEEP_MS(c, 500);
+ *				led_off();
+ *				CORO_WAIT_UNTIL(c, button_pushed() != NO_BUTTON_PUSHED);
+ *			}
+ *			CORO_END(c);
+ *		}
+ *
+ * Each call returns what the coroutine is doing, so the caller knows
+ * when to call it again: CORO_YIELDED as soon as possible,
+ * CORO_SLEEPING at the time in its deadline, CORO_WAITING when
+ * something has happened (e.g. input has arrived) and CORO_DONE never.
+ */
+
+#ifndef COROUTINE_H_
+#define COROUTINE_H_
+
+#include <stdint.h>
+#include "timer0.h"
+
+// What a coroutine is doing when it returns
+#define CORO_WAITING	0
+#define CORO_YIELDED	1
+#define CORO_SLEEPING	2
+#define CORO_DONE		3
+
+typedef struct {
+	uint16_t	line;		// where to carry on from (0 at the start)
+	uint32_t	deadline;	// time to wake up (see get_current_time())
+} Coroutine;
+
+// A coroutine function - returns one of the CORO_ states above
+typedef uint8_t (*CoroutineTask)(Coroutine* c);
+
+// Line of a coroutine which has finished
+#define CORO_LINE_DONE	0xFFFF
+
+// Make the coroutine start from the beginning when it is next called
+static inline void coro_init(Coroutine* c) {
+	c->line = 0;
+}
+
+// Start and end the body of a coroutine function. Once the end has been
+// reached, calling it again just returns CORO_DONE.
+#define CORO_BEGIN(c) \
+		switch((c)->line) { \
+			case CORO_LINE_DONE: \
+				return CORO_DONE; \
+			case 0:
+
+#define CORO_END(c) \
+		} \
+		(c)->line = CORO_LINE_DONE; \
+		return CORO_DONE
+
+// Finish the coroutine early
+#define CORO_EXIT(c) \
+		do { \
+			(c)->line = CORO_LINE_DONE; \
+			return CORO_DONE; \
+		} while(0)
+
+// Stop until the next call
+#define CORO_YIELD(c) \
+		do { \
+			(c)->line = __LINE__; \
+			return CORO_YIELDED; \
+			case __LINE__:; \
+		} while(0)
+
+// Stop until the condition is true. It is tested straight away, then
+// on each call.
+#define CORO_WAIT_UNTIL(c, condition) \
+		do { \
+			(c)->line = __LINE__; \
+			case __LINE__: \
+			if(!(condition)) { \
+				return CORO_WAITING; \
+			} \
+		} while(0)
+
+// Stop until the given time (as returned by get_current_time()), or for
+// ms milliseconds
+#define CORO_SLEEP_UNTIL(c, time) \
+		do { \
+			(c)->deadline = (time); \
+			(c)->line = __LINE__; \
+			case __LINE__: \
+			if((int32_t)(get_current_time() - (c)->deadline) < 0) { \
+				return CORO_SLEEPING; \
+			} \
+		} while(0)
+
+#define CORO_SLEEP_MS(c, ms) \
+		CORO_SLEEP_UNTIL(c, get_current_time() + (ms))
+
+// Run another coroutine from the beginning to the end - call is the call
+// of its function with child, e.g. CORO_RUN(c, &visual,
+// game_visual_task(&visual)). While it is stopped, this coroutine stops
+// in the same way (with the same deadline).
+#define CORO_RUN(c, child, call) \
+		do { \
+			coro_init(child); \
+			(c)->line = __LINE__; \
+			case __LINE__: { \
+				uint8_t coro_state = (call); \
+				if(coro_state != CORO_DONE) { \
+					(c)->deadline = (child)->deadline; \
+					return coro_state; \
+				} \
+			} \
+		} while(0)
+
+#endif /* COROUTINE_H_ */
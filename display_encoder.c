@@ -0,0 +1,242 @@
+/*
+ * display_encoder.c
+ *
+ * Choosing the cheapest SPI commands to update the LED matrix - see
+ * display_encoder.h
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+#include "display_encoder.h"
+#include "framebuffer.h"
+#include "ledmatrix.h"
+
+/* Ways of sending the changed pixels */
+#define PLAN_ALL		0
+#define PLAN_COLUMNS	1
+#define PLAN_ROWS		2
+
+/* Shifts of the display considered. After SHIFT_LEFT column x of the
+ * display shows what was in column x+1.
+ */
+#define SHIFT_NONE		0
+#define SHIFT_LEFT		1
+#define SHIFT_RIGHT		(-1)
+
+/* Byte counts since the last reset. bytesPixelOnly is what would have
+ * been sent using a pixel update for each changed pixel.
+ */
+static uint32_t bytesSent;
+static uint32_t bytesPixelOnly;
+static uint16_t mostSaved;
+static uint16_t flushes;
+static uint16_t shifts;
+static uint16_t fullUpdates;
+
+static uint8_t count_bits(MatrixColumnMask bits) {
+	uint8_t count = 0;
+	for(; bits; bits >>= 1) {
+		count += bits & 1;
+	}
+	return count;
+}
+
+/* Return a mask with bit y set for each row y in which the two packed
+ * columns differ
+ */
+static MatrixColumnMask diff_column(uint8_t* a, uint8_t* b) {
+	MatrixColumnMask mask = 0;
+	MatrixColumnMask bit = 1;
+	for(uint8_t i = 0; i < FRAME_BYTES_PER_COLUMN; i++) {
+		uint8_t difference = a[i] ^ b[i];
+		for(uint8_t p = 0; p < FRAME_PIXELS_PER_BYTE; p++) {
+			if(difference & (FRAME_PALETTE_SIZE - 1)) {
+				mask |= bit;
+			}
+			difference >>= FRAME_BITS_PER_PIXEL;
+			bit <<= 1;
+		}
+	}
+	return mask;
+}
+
+/* Work out which pixels of each column would still be wrong after the
+ * given shift. The column shifted in is treated as entirely wrong - as
+ * is the column shifted in to each panel, since panels shift on their
+ * own.
+ */
+static void find_changes(PackedFrame shown, PackedFrame next, int8_t shift,
+		MatrixColumnMask changed[MATRIX_NUM_COLUMNS]) {
+	for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+		int16_t shownX = x + shift;
+		if(shownX < 0 || shownX >= MATRIX_NUM_COLUMNS ||
+				!LEDMATRIX_SAME_PANEL_COLUMN(x, shownX)) {
+			changed[x] = (MatrixColumnMask)~0;
+		} else {
+			changed[x] = diff_column(shown[shownX], next[x]);
+		}
+	}
+}
+
+/* Number of pixels changed in row y */
+static uint8_t row_changes(MatrixColumnMask changed[MATRIX_NUM_COLUMNS], uint8_t y) {
+	uint8_t count = 0;
+	for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+		count += (changed[x] >> y) & 1;
+	}
+	return count;
+}
+
+/* Bytes needed to send the changes using pixel or column updates for
+ * each column
+ */
+static uint16_t column_plan_cost(MatrixColumnMask changed[MATRIX_NUM_COLUMNS]) {
+	uint16_t cost = 0;
+	for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+		uint16_t pixelCost = count_bits(changed[x]) * LEDMATRIX_PIXEL_BYTES;
+		cost += pixelCost < LEDMATRIX_COLUMN_BYTES ? pixelCost : LEDMATRIX_COLUMN_BYTES;
+	}
+	return cost;
+}
+
+/* Bytes needed to send the changes using pixel or row updates for
+ * each row
+ */
+static uint16_t row_plan_cost(MatrixColumnMask changed[MATRIX_NUM_COLUMNS]) {
+	uint16_t cost = 0;
+	for(uint8_t y = 0; y < MATRIX_NUM_ROWS; y++) {
+		uint16_t pixelCost = row_changes(changed, y) * LEDMATRIX_PIXEL_BYTES;
+		cost += pixelCost < LEDMATRIX_ROW_BYTES ? pixelCost : LEDMATRIX_ROW_BYTES;
+	}
+	return cost;
+}
+
+static void send_pixel(PackedFrame next, FramePalette palette, uint8_t x, uint8_t y) {
+	ledmatrix_update_pixel(x, y, palette[PACKED_PIXEL(next, x, y)]);
+}
+
+static void send_columns(PackedFrame next, FramePalette palette,
+		MatrixColumnMask changed[MATRIX_NUM_COLUMNS]) {
+	for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+		if(count_bits(changed[x]) * LEDMATRIX_PIXEL_BYTES > LEDMATRIX_COLUMN_BYTES) {
+			ledmatrix_update_column_packed(x, next, palette);
+		} else {
+			for(uint8_t y = 0; y < MATRIX_NUM_ROWS; y++) {
+				if(changed[x] & ((MatrixColumnMask)1 << y)) {
+					send_pixel(next, palette, x, y);
+				}
+			}
+		}
+	}
+}
+
+static void send_rows(PackedFrame next, FramePalette palette,
+		MatrixColumnMask changed[MATRIX_NUM_COLUMNS]) {
+	for(uint8_t y = 0; y < MATRIX_NUM_ROWS; y++) {
+		if(row_changes(changed, y) * LEDMATRIX_PIXEL_BYTES > LEDMATRIX_ROW_BYTES) {
+			ledmatrix_update_row_packed(y, next, palette);
+		} else {
+			for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+				if(changed[x] & ((MatrixColumnMask)1 << y)) {
+					send_pixel(next, palette, x, y);
+				}
+			}
+		}
+	}
+}
+
+void display_encoder_flush(PackedFrame shown, PackedFrame next, FramePalette palette) {
+	MatrixColumnMask changed[MATRIX_NUM_COLUMNS];
+	uint16_t pixelOnlyCost = 0;
+	uint16_t bestCost = LEDMATRIX_ALL_BYTES;
+	uint8_t bestPlan = PLAN_ALL;
+	int8_t bestShift = SHIFT_NONE;
+
+	find_changes(shown, next, SHIFT_NONE, changed);
+	for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+		pixelOnlyCost += count_bits(changed[x]) * LEDMATRIX_PIXEL_BYTES;
+	}
+	if(pixelOnlyCost == 0) {
+		// Nothing to send
+		return;
+	}
+
+	// Try each shift (including none) with each plan for the fix-ups
+	static const int8_t shiftsToTry[3] = { SHIFT_NONE, SHIFT_LEFT, SHIFT_RIGHT };
+	for(uint8_t i = 0; i < 3; i++) {
+		uint16_t shiftCost = 0;
+		if(shiftsToTry[i] != SHIFT_NONE) {
+			find_changes(shown, next, shiftsToTry[i], changed);
+			shiftCost = LEDMATRIX_SHIFT_BYTES;
+		}
+		uint16_t cost = shiftCost + column_plan_cost(changed);
+		if(cost < bestCost) {
+			bestCost = cost;
+			bestPlan = PLAN_COLUMNS;
+			bestShift = shiftsToTry[i];
+		}
+		cost = shiftCost + row_plan_cost(changed);
+		if(cost < bestCost) {
+			bestCost = cost;
+			bestPlan = PLAN_ROWS;
+			bestShift = shiftsToTry[i];
+		}
+	}
+
+	if(bestPlan == PLAN_ALL) {
+		ledmatrix_update_all_packed(next, palette);
+		fullUpdates++;
+	} else {
+		if(bestShift == SHIFT_LEFT) {
+			ledmatrix_shift_display_left();
+			shifts++;
+		} else if(bestShift == SHIFT_RIGHT) {
+			ledmatrix_shift_display_right();
+			shifts++;
+		}
+		find_changes(shown, next, bestShift, changed);
+		if(bestPlan == PLAN_COLUMNS) {
+			send_columns(next, palette, changed);
+		} else {
+			send_rows(next, palette, changed);
+		}
+	}
+	frame_copy(next, shown);
+
+	flushes++;
+	bytesSent += bestCost;
+	bytesPixelOnly += pixelOnlyCost;
+	if(pixelOnlyCost - bestCost > mostSaved) {
+		mostSaved = pixelOnlyCost - bestCost;
+	}
+}
+
+uint32_t display_encoder_bytes_sent(void) {
+	return bytesSent;
+}
+
+void display_encoder_reset(void) {
+	bytesSent = 0;
+	bytesPixelOnly = 0;
+	mostSaved = 0;
+	flushes = 0;
+	shifts = 0;
+	fullUpdates = 0;
+	ledmatrix_reset_counts();
+}
+
+void display_encoder_report(void) {
+	uint32_t saved = bytesPixelOnly - bytesSent;
+	printf_P(PSTR("Display: %u updates, %lu bytes sent, %lu saved (mean %lu, max %u per update), %u shifts, %u full\n"),
+			flushes, bytesSent, saved, flushes ? saved / flushes : 0,
+			mostSaved, shifts, fullUpdates);
+	// SPI is slow enough to be the limit on larger displays - show how
+	// much of it each panel takes
+	for(uint8_t panel = 0; panel < LEDMATRIX_NUM_PANELS; panel++) {
+		uint32_t bytes = ledmatrix_panel_bytes(panel);
+		printf_P(PSTR("Panel %u: %lu bytes (mean %lu per update)\n"),
+				panel, bytes, flushes ? bytes / flushes : 0);
+	}
+}
@@ -0,0 +1,40 @@
+/*
+ * display_encoder.h
+ *
+ * Sends the changes between what is shown on the LED matrix and the
+ * next frame using the cheapest mix of SPI commands. The cost of each
+ * command (see LEDMATRIX_..._BYTES in ledmatrix.h) is used to choose
+ * between
+ *  - pixel and column updates (per column),
+ *  - pixel and row updates (per row),
+ *  - a single update of the whole display, and
+ *  - shifting the display left or right by one column first (e.g. when
+ *    all of the asteroids have moved down one row), then fixing up
+ *    whatever the shift got wrong. The column shifted in is always
+ *    rewritten since the LED matrix may not have cleared it.
+ *
+ * The number of bytes sent, and how many that saved compared to
+ * sending a pixel update for each changed pixel, can be printed over
+ * serial with display_encoder_report().
+ */
+
+#ifndef DISPLAY_ENCODER_H_
+#define DISPLAY_ENCODER_H_
+
+#include <stdint.h>
+#include "ledmatrix.h"
+
+// Send whatever is needed to change the display from "shown" (what is
+// on the LED matrix now) to "next". "shown" is updated to match "next".
+void display_encoder_flush(PackedFrame shown, PackedFrame next, FramePalette palette);
+
+// Total bytes sent by display_encoder_flush() since the last reset
+uint32_t display_encoder_bytes_sent(void);
+
+// Reset the byte counts
+void display_encoder_reset(void);
+
+// Print the byte counts to standard output
+void display_encoder_report(void);
+
+#endif /* DISPLAY_ENCODER_H_ */
@@ -0,0 +1,120 @@
+/*
+ * eeprom_queue.c
+ *
+ * EEPROM write-behind queue - see eeprom_queue.h
+ *
+ * The EEPROM ready interrupt fires whenever the EEPROM isn't busy and
+ * EERIE is set, so it is enabled while there is anything in the queue
+ * and disabled by the handler when the queue is empty.
+ */
+
+#include <stdint.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+
+#include "eeprom_queue.h"
+
+typedef struct {
+	uint16_t		address;
+	const uint8_t*	data;
+	uint16_t		length;
+} EepromWrite;
+
+/* queue - the writes waiting (or in progress), starting at queueHead.
+ * queueCount is the number of them. The write at the head is updated
+ * as each of its bytes is written.
+ */
+static EepromWrite		queue[EEPROM_QUEUE_SIZE];
+static volatile uint8_t	queueHead;
+static volatile uint8_t	queueCount;
+
+static volatile uint16_t bytesWritten;
+static volatile uint16_t bytesSkipped;
+
+uint8_t eeprom_queue_write(uint16_t address, const void* data, uint16_t length) {
+	uint8_t queued = 0;
+	uint8_t interruptsOn = bit_is_set(SREG, SREG_I);
+	cli();
+	if(queueCount < EEPROM_QUEUE_SIZE) {
+		EepromWrite* write = &queue[(queueHead + queueCount) % EEPROM_QUEUE_SIZE];
+		write->address = address;
+		write->data = data;
+		write->length = length;
+		queueCount++;
+		// Start (or carry on) writing
+		EECR |= (1<<EERIE);
+		queued = 1;
+	}
+	if(interruptsOn) {
+		sei();
+	}
+	return queued;
+}
+
+uint8_t eeprom_queue_pending(void) {
+	return queueCount;
+}
+
+uint16_t eeprom_queue_bytes_written(void) {
+	uint16_t count;
+	uint8_t interruptsOn = bit_is_set(SREG, SREG_I);
+	cli();
+	count = bytesWritten;
+	if(interruptsOn) {
+		sei();
+	}
+	return count;
+}
+
+uint16_t eeprom_queue_bytes_skipped(void) {
+	uint16_t count;
+	uint8_t interruptsOn = bit_is_set(SREG, SREG_I);
+	cli();
+	count = bytesSkipped;
+	if(interruptsOn) {
+		sei();
+	}
+	return count;
+}
+
+void eeprom_queue_reset_counts(void) {
+	uint8_t interruptsOn = bit_is_set(SREG, SREG_I);
+	cli();
+	bytesWritten = 0;
+	bytesSkipped = 0;
+	if(interruptsOn) {
+		sei();
+	}
+}
+
+/* The EEPROM has finished the last byte (or was idle). Start writing
+ * the next byte which is different from what the EEPROM holds, or
+ * disable the interrupt if there isn't one.
+ */
+ISR(EE_READY_vect) {
+	while(queueCount) {
+		EepromWrite* write = &queue[queueHead];
+		while(write->length) {
+			uint16_t address = write->address++;
+			uint8_t value = *(write->data++);
+			write->length--;
+			// Reading is quick (and the EEPROM isn't busy)
+			if(eeprom_read_byte((const uint8_t*)(uintptr_t)address) == value) {
+				bytesSkipped++;
+				continue;
+			}
+			EEAR = address;
+			EEDR = value;
+			// Setting EEPE must follow EEMPE within 4 clock cycles
+			EECR |= (1<<EEMPE);
+			EECR |= (1<<EEPE);
+			bytesWritten++;
+			return;
+		}
+		queueHead = (queueHead + 1) % EEPROM_QUEUE_SIZE;
+		queueCount--;
+	}
+	EECR &= ~(1<<EERIE);
+}
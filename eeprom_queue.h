@@ -0,0 +1,38 @@
+/*
+ * eeprom_queue.h
+ *
+ * Write-behind queue for the EEPROM. Each byte written to the EEPROM
+ * takes about 3.3ms, so rather than waiting for each one the data is
+ * written from the EEPROM ready interrupt: a byte is started, and when
+ * it has finished the interrupt fires and starts the next one. The main
+ * loop carries on in the meantime.
+ *
+ * Bytes which already hold the value being written are skipped, which
+ * saves time and wear on the EEPROM.
+ */
+
+#ifndef EEPROM_QUEUE_H_
+#define EEPROM_QUEUE_H_
+
+#include <stdint.h>
+
+// Number of writes which can be waiting at once
+#define EEPROM_QUEUE_SIZE 4
+
+// Queue a write of length bytes from data (in RAM) to the EEPROM,
+// starting at the given EEPROM address. Returns 1 if the write was
+// queued, 0 if the queue is full. The data is not copied - each byte is
+// read from RAM when it is written, so the data should not change until
+// the write has finished (see eeprom_queue_pending()).
+uint8_t eeprom_queue_write(uint16_t address, const void* data, uint16_t length);
+
+// Number of queued writes which haven't finished yet
+uint8_t eeprom_queue_pending(void);
+
+// Number of bytes written to the EEPROM and skipped (because they
+// already held the right value) since the counts were reset
+uint16_t eeprom_queue_bytes_written(void);
+uint16_t eeprom_queue_bytes_skipped(void);
+void eeprom_queue_reset_counts(void);
+
+#endif /* EEPROM_QUEUE_H_ */
@@ -0,0 +1,108 @@
+/*
+ * entity.c
+ *
+ * The entity table - see entity.h
+ */
+
+#include <stdint.h>
+
+#include "entity.h"
+#include "game_state.h"
+
+const uint8_t entityBase[ENTITY_TYPES] = {
+	[ENTITY_ASTEROID] = ENTITY_BASE_ASTEROID,
+	[ENTITY_PROJECTILE] = ENTITY_BASE_PROJECTILE
+};
+
+static const uint8_t entityLimit[ENTITY_TYPES] = {
+	[ENTITY_ASTEROID] = MAX_ASTEROIDS,
+	[ENTITY_PROJECTILE] = MAX_PROJECTILES
+};
+
+/* The handles of the table in play (see EntityTable) */
+#define slotHandle	(gameState->entities.slotHandle)
+#define handleSlot	(gameState->entities.handleSlot)
+#define freeHandles	(gameState->entities.freeHandles)
+
+/* Return the type of entity the given slot is for */
+static uint8_t slot_type(uint8_t slot) {
+	uint8_t type = ENTITY_TYPES - 1;
+	while(type > 0 && slot < entityBase[type]) {
+		type--;
+	}
+	return type;
+}
+
+void entity_clear(void) {
+	for(uint8_t type = 0; type < ENTITY_TYPES; type++) {
+		entityCount[type] = 0;
+	}
+	for(uint8_t handle = 0; handle < MAX_ENTITIES; handle++) {
+		handleSlot[handle] = handle + 1 < MAX_ENTITIES ? handle + 1 : NO_ENTITY;
+	}
+	freeHandles = 0;
+}
+
+uint8_t entity_add(uint8_t type, uint8_t x, uint16_t y, uint16_t speed) {
+	if(entity_full(type)) {
+		return NO_ENTITY;
+	}
+	uint8_t slot = ENTITY_END(type);
+	EntityHandle handle = freeHandles;
+	freeHandles = handleSlot[handle];
+	handleSlot[handle] = slot;
+	slotHandle[slot] = handle;
+	entityX[slot] = x;
+	entityY[slot] = y;
+	entitySpeed[slot] = speed;
+	entitySize[slot] = 1;
+	entityCount[type]++;
+	return slot;
+}
+
+void entity_remove(uint8_t slot) {
+	uint8_t type = slot_type(slot);
+	uint8_t last = ENTITY_END(type) - 1;
+	EntityHandle handle = slotHandle[slot];
+
+	// Put the handle back on the free list
+	handleSlot[handle] = freeHandles;
+	freeHandles = handle;
+
+	// Move the last entity of this type into the slot
+	if(slot != last) {
+		entityX[slot] = entityX[last];
+		entityY[slot] = entityY[last];
+		entitySpeed[slot] = entitySpeed[last];
+		entitySize[slot] = entitySize[last];
+		slotHandle[slot] = slotHandle[last];
+		handleSlot[slotHandle[slot]] = slot;
+	}
+	entityCount[type]--;
+}
+
+uint8_t entity_count(uint8_t type) {
+	return entityCount[type];
+}
+
+uint8_t entity_full(uint8_t type) {
+	return entityCount[type] >= entityLimit[type];
+}
+
+EntityHandle entity_handle(uint8_t slot) {
+	return slotHandle[slot];
+}
+
+uint8_t entity_slot(EntityHandle handle) {
+	if(handle >= MAX_ENTITIES) {
+		return NO_ENTITY;
+	}
+	uint8_t slot = handleSlot[handle];
+	// A free handle holds the next free handle rather than a slot, so
+	// check the slot is in use and belongs to this handle
+	if(slot >= MAX_ENTITIES || slot >= ENTITY_END(slot_type(slot)) ||
+			slotHandle[slot] != handle) {
+		return NO_ENTITY;
+	}
+	return slot;
+}
@@ -0,0 +1,104 @@
+/*
+ * entity.h
+ *
+ * The table of objects (entities) on the game field - asteroids and
+ * projectiles. Each kind of entity (type) has its own part of the
+ * table, large enough for the most entities of that type that can be
+ * on the field at once (see MAX_ASTEROIDS etc. in game.h). The entities
+ * of a type are kept together at the start of their part of the table,
+ * so they can be gone through with
+ *		for(slot = ENTITY_FIRST(type); slot < ENTITY_END(type); slot++)
+ * without looking at any other entities.
+ *
+ * The table is a structure of arrays - entityX[slot] is the column of
+ * the entity in the given slot, entityY[slot] its row and so on. Rows
+ * and speeds are 8.8 fixed point numbers (see game.c). entitySize is
+ * the size of the entity's shape (1 for a single cell). Each game has
+ * its own table (see GameState in game_state.h) - entityX and so on,
+ * and the functions below, are for the table of the game in play.
+ *
+ * Removing an entity moves the last entity of the same type into its
+ * slot, so slot numbers change. Each entity also has a handle which
+ * stays the same for as long as the entity exists - entity_slot()
+ * gives the entity's current slot. Free handles are kept in a list.
+ *
+ * A new kind of entity (e.g. a power-up) needs an ENTITY_ type number,
+ * a limit and its part of the table (ENTITY_BASE_...).
+ */
+
+#ifndef ENTITY_H_
+#define ENTITY_H_
+
+#include <stdint.h>
+#include "game.h"
+
+// Entity types
+#define ENTITY_ASTEROID		0
+#define ENTITY_PROJECTILE	1
+#define ENTITY_TYPES		2
+
+// Where each type's part of the table starts
+#define ENTITY_BASE_ASTEROID	0
+#define ENTITY_BASE_PROJECTILE	(ENTITY_BASE_ASTEROID + MAX_ASTEROIDS)
+#define MAX_ENTITIES			(ENTITY_BASE_PROJECTILE + MAX_PROJECTILES)
+
+// (NO_ENTITY, 0xFF, is never a slot or a handle)
+#if MAX_ENTITIES > 254
+#error "Slots and handles are 8 bits - at most 254 entities"
+#endif
+
+typedef uint8_t EntityHandle;
+#define NO_ENTITY			0xFF
+
+// A table. slotHandle is the handle of the entity in each slot.
+// handleSlot is the slot of the entity with each handle or, for a
+// handle which isn't in use, the next free handle (NO_ENTITY at the end
+// of the list). freeHandles is the first free handle.
+typedef struct {
+	uint8_t			x[MAX_ENTITIES];
+	uint16_t		y[MAX_ENTITIES];
+	uint16_t		speed[MAX_ENTITIES];
+	uint8_t			size[MAX_ENTITIES];
+	uint8_t			count[ENTITY_TYPES];
+	EntityHandle	slotHandle[MAX_ENTITIES];
+	uint8_t			handleSlot[MAX_ENTITIES];
+	EntityHandle	freeHandles;
+} EntityTable;
+
+// The table of the game in play (files using these include
+// game_state.h)
+#define entityX			(gameState->entities.x)
+#define entityY			(gameState->entities.y)
+#define entitySpeed		(gameState->entities.speed)
+#define entitySize		(gameState->entities.size)
+#define entityCount		(gameState->entities.count)
+extern const uint8_t entityBase[ENTITY_TYPES];
+
+// The slots used by entities of the given type are ENTITY_FIRST(type)
+// up to (but not including) ENTITY_END(type)
+#define ENTITY_FIRST(type)	(entityBase[type])
+#define ENTITY_END(type)	(entityBase[type] + entityCount[type])
+
+// Remove every entity
+void entity_clear(void);
+
+// Add an entity of the given type, of size 1. Returns its slot (which
+// is ENTITY_END(type) before it was added), or NO_ENTITY if there are
+// already as many entities of that type as there is room for.
+uint8_t entity_add(uint8_t type, uint8_t x, uint16_t y, uint16_t speed);
+
+// Remove the entity in the given slot, which must be in use. The last
+// entity of the same type takes its place.
+void entity_remove(uint8_t slot);
+
+// The number of entities of the given type, and whether there is room
+// for another one
+uint8_t entity_count(uint8_t type);
+uint8_t entity_full(uint8_t type);
+
+// Convert between slots and handles. entity_slot() returns NO_ENTITY
+// for a handle which isn't in use.
+EntityHandle entity_handle(uint8_t slot);
+uint8_t entity_slot(EntityHandle handle);
+
+#endif /* ENTITY_H_ */
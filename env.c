@@ -0,0 +1,122 @@
+/*
+ * env.c
+ *
+ * Training environments - see env.h
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+#include "env.h"
+#include "game.h"
+#include "game_state.h"
+#include "score.h"
+#include "timer0.h"
+
+void env_init(GameEnv* env, GameState* game) {
+	env->game = game ? game : &boardGame;
+	game_start_timers(&env->timers);
+	env->score = 0;
+	env->lives = 0;
+	env->done = 1;
+	env->steps = 0;
+}
+
+void env_reset(GameEnv* env, uint32_t seed) {
+	game_use(env->game);
+	game_set_quiet(1);
+	game_over(0);
+	init_score();
+	init_lives();
+	game_seed_random(seed);
+	game_set_players(1);
+	initialise_game();
+	game_start_timers(&env->timers);
+	env->score = 0;
+	env->lives = get_lives();
+	env->done = 0;
+	env->steps = 0;
+}
+
+int16_t env_step(GameEnv* env, uint8_t action) {
+	uint32_t score;
+	int8_t lives;
+	int16_t reward;
+
+	if(env->done) {
+		return 0;
+	}
+	game_use(env->game);
+	game_set_quiet(1);
+	if(action & ENV_ACTION_LEFT) {
+		move_base(MOVE_LEFT);
+	}
+	if(action & ENV_ACTION_RIGHT) {
+		move_base(MOVE_RIGHT);
+	}
+	if(action & ENV_ACTION_FIRE) {
+		fire_projectile();
+	}
+	game_run_steps(&env->timers, ENV_STEP_MS, 0);
+
+	score = get_score();
+	lives = get_lives();
+	reward = (int16_t)(score - env->score) + ENV_LIFE_REWARD * (env->lives - lives);
+	env->score = score;
+	env->lives = lives;
+	env->done = is_game_over();
+	env->steps++;
+	return reward;
+}
+
+void env_step_many(GameEnv* envs, uint8_t count, const uint8_t* actions,
+		int16_t* rewards) {
+	for(uint8_t i = 0; i < count; i++) {
+		rewards[i] = env_step(&envs[i], actions[i]);
+	}
+}
+
+const FieldRowMask* env_observation(const GameEnv* env, uint8_t type) {
+	return env->game->boards[type];
+}
+
+int8_t env_base_position(const GameEnv* env) {
+	return env->game->basePosition[0];
+}
+
+void env_close(void) {
+	game_use(0);
+	game_set_quiet(0);
+}
+
+void env_benchmark(GameEnv* envs, uint8_t count, uint32_t steps,
+		uint32_t (*now)(void)) {
+	uint32_t random = 1;
+	uint32_t start, ms, total, perSecond = 0;
+	uint16_t resets = 0;
+	uint8_t i;
+
+	for(i = 0; i < count; i++) {
+		env_reset(&envs[i], i + 1);
+	}
+	start = now();
+	for(uint32_t step = 0; step < steps; step++) {
+		for(i = 0; i < count; i++) {
+			if(envs[i].done) {
+				env_reset(&envs[i], count + ++resets);
+			}
+			// A separate generator, so the games' own random numbers
+			// aren't disturbed
+			random = random * 1103515245 + 12345;
+			env_step(&envs[i], (uint8_t)(random >> 16) & 0x07);
+		}
+	}
+	ms = now() - start;
+	total = steps * count;
+	if(ms) {
+		perSecond = total / ms * 1000 + (total % ms) * 1000 / ms;
+	}
+	printf_P(PSTR("env: %lu steps of %u environments in %lums (%lu steps/s), %u resets\n"),
+			steps, count, ms, perSecond, resets);
+}
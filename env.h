@@ -0,0 +1,88 @@
+/*
+ * env.h
+ *
+ * Training environments for game playing programs, in the style of the
+ * OpenAI Gym interface - env_reset() starts an episode (a game) and
+ * env_step() applies an action and moves the game on by ENV_STEP_MS,
+ * returning the reward. The game is run with game_run_steps(), so it
+ * follows exactly the same rules as in the main loop and linked games,
+ * and quietly (see game_set_quiet()) so nothing is drawn.
+ *
+ * Each environment plays its own game (see game_state.h) - stepping
+ * one only points the game functions at its game with game_use(), so
+ * environments can be stepped in any order for the same cost. After a
+ * step or reset the game functions are left playing that environment's
+ * game.
+ *
+ * Observations are the environment's own bitboards (see game_board())
+ * and base position, read in place rather than copied.
+ *
+ * The module only uses the game, so the same code runs on the board
+ * (where there is only room for boardGame) and on a PC (where many
+ * environments can be run side by side).
+ */
+
+#ifndef ENV_H_
+#define ENV_H_
+
+#include <stdint.h>
+#include "game.h"
+#include "game_state.h"
+
+// Game time per step (ms)
+#define ENV_STEP_MS			20
+
+// Actions (any combination) - the same as the NETPLAY_INPUT_ inputs and
+// AUTOPILOT_ moves
+#define ENV_ACTION_LEFT		0x01
+#define ENV_ACTION_RIGHT	0x02
+#define ENV_ACTION_FIRE		0x04
+
+// Reward for each life lost (each point scored is worth 1)
+#define ENV_LIFE_REWARD		(-10)
+
+typedef struct {
+	GameState*	game;			// see env_init()
+	GameTimers	timers;
+	uint32_t	score;			// at the end of the last step
+	int8_t		lives;
+	uint8_t		done;			// 1 once the game is over
+	uint32_t	steps;			// since the reset
+} GameEnv;
+
+// Set up an environment to play the given game, or boardGame (the game
+// on the LED matrix) if game is 0. Each environment in use must have a
+// game of its own.
+void env_init(GameEnv* env, GameState* game);
+
+// Start a new game in the environment from the given random number
+// seed
+void env_reset(GameEnv* env, uint32_t seed);
+
+// Apply the action and move the game on by ENV_STEP_MS. Returns the
+// reward - the points scored, plus ENV_LIFE_REWARD for each life lost.
+// Once env->done is set the game doesn't move on and the reward is 0.
+int16_t env_step(GameEnv* env, uint8_t action);
+
+// Step each of count environments with the corresponding action, and
+// put their rewards in rewards
+void env_step_many(GameEnv* envs, uint8_t count, const uint8_t* actions,
+		int16_t* rewards);
+
+// The observation - the environment's asteroid (type 0) or projectile
+// (type 1) bitboard, and the column of its base
+const FieldRowMask* env_observation(const GameEnv* env, uint8_t type);
+int8_t env_base_position(const GameEnv* env);
+
+// Finish with the environments - boardGame is played again and is
+// drawn again
+void env_close(void);
+
+// Step count environments (each of which must be set up) through
+// steps steps each with pseudo-random actions, resetting those whose
+// games end, then print the steps per second to standard output.
+// now() gives the time in ms.
+void env_benchmark(GameEnv* envs, uint8_t count, uint32_t steps,
+		uint32_t (*now)(void));
+
+#endif /* ENV_H_ */
@@ -0,0 +1,108 @@
+/*
+ * frame_timing.c
+ *
+ * Timing of the stages of the main game loop - see frame_timing.h
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <avr/pgmspace.h>
+
+#include "frame_timing.h"
+#include "timer0.h"
+
+/* Duration (us) of each stage in the frame in progress and in the
+ * previous frame. Late steps are noticed in the frame after the one
+ * which delayed them, so both are needed to decide what to blame.
+ */
+static uint32_t stage_time[FRAME_NUM_STAGES];
+static uint32_t last_stage_time[FRAME_NUM_STAGES];
+
+/* Longest duration seen for each stage and the number of overruns
+ * blamed on each stage.
+ */
+static uint32_t stage_max[FRAME_NUM_STAGES];
+static uint16_t stage_overruns[FRAME_NUM_STAGES];
+
+static uint32_t frames;
+static uint16_t overrun_frames;
+static uint16_t late_steps_total;
+static uint16_t dropped_steps_total;
+
+/* Stage in progress (-1 if none) and when it started */
+static int8_t current_stage = -1;
+static uint32_t stage_start_time;
+
+static PGM_P const stage_names[FRAME_NUM_STAGES] PROGMEM = {
+	"input", "projectiles", "asteroids", "sound", "joystick"
+};
+
+static void finish_current_stage(void) {
+	if(current_stage >= 0) {
+		stage_time[current_stage] += get_current_time_us() - stage_start_time;
+		current_stage = -1;
+	}
+}
+
+void frame_timing_reset(void) {
+	for(uint8_t i = 0; i < FRAME_NUM_STAGES; i++) {
+		stage_time[i] = 0;
+		last_stage_time[i] = 0;
+		stage_max[i] = 0;
+		stage_overruns[i] = 0;
+	}
+	frames = 0;
+	overrun_frames = 0;
+	late_steps_total = 0;
+	dropped_steps_total = 0;
+	current_stage = -1;
+}
+
+void frame_stage_begin(uint8_t stage) {
+	finish_current_stage();
+	current_stage = stage;
+	stage_start_time = get_current_time_us();
+}
+
+void frame_end(uint8_t late_steps, uint8_t dropped_steps) {
+	uint8_t i;
+	finish_current_stage();
+	frames++;
+
+	if(late_steps || dropped_steps) {
+		// Blame the slowest stage since the last frame that ran on
+		// time - i.e. the stages of the previous frame plus the input
+		// stage of this one.
+		uint8_t slowest = FRAME_STAGE_INPUT;
+		uint32_t slowest_time = stage_time[FRAME_STAGE_INPUT];
+		for(i = 0; i < FRAME_NUM_STAGES; i++) {
+			if(last_stage_time[i] > slowest_time) {
+				slowest = i;
+				slowest_time = last_stage_time[i];
+			}
+		}
+		stage_overruns[slowest]++;
+		overrun_frames++;
+		late_steps_total += late_steps;
+		dropped_steps_total += dropped_steps;
+	}
+
+	for(i = 0; i < FRAME_NUM_STAGES; i++) {
+		if(stage_time[i] > stage_max[i]) {
+			stage_max[i] = stage_time[i];
+		}
+		last_stage_time[i] = stage_time[i];
+		stage_time[i] = 0;
+	}
+}
+
+void frame_timing_report(void) {
+	printf_P(PSTR("Frames: %lu overruns=%u late steps=%u dropped steps=%u\n"),
+			frames, overrun_frames, late_steps_total, dropped_steps_total);
+	for(uint8_t i = 0; i < FRAME_NUM_STAGES; i++) {
+		printf_P(PSTR("  %-12S max=%luus overruns=%u\n"),
+				(PGM_P)pgm_read_word(&stage_names[i]), stage_max[i],
+				stage_overruns[i]);
+	}
+}
@@ -0,0 +1,41 @@
+/*
+ * frame_timing.h
+ *
+ * Timing of the stages of each pass through the main game loop (a
+ * "frame"). The main loop marks the start of each stage; when the
+ * frame is finished it says whether the frame overran (i.e. a
+ * simulation step was late). Overruns are blamed on the slowest stage
+ * of the frame that caused them.
+ */
+
+#ifndef FRAME_TIMING_H_
+#define FRAME_TIMING_H_
+
+#include <stdint.h>
+
+// Stages of a frame
+#define FRAME_STAGE_INPUT		0
+#define FRAME_STAGE_PROJECTILES	1
+#define FRAME_STAGE_ASTEROIDS	2
+#define FRAME_STAGE_SOUND		3
+#define FRAME_STAGE_JOYSTICK	4
+#define FRAME_NUM_STAGES		5
+
+// Clear all frame statistics
+void frame_timing_reset(void);
+
+// Mark the start of the given stage of the current frame. This also
+// marks the end of the previous stage (if any).
+void frame_stage_begin(uint8_t stage);
+
+// Mark the end of the current frame. late_steps is the number of
+// simulation steps which had to be caught up in this frame because
+// they were late (0 if everything ran on time) and dropped_steps is
+// the number which were abandoned because we were too far behind.
+// The previous frame is blamed for any late steps in this one.
+void frame_end(uint8_t late_steps, uint8_t dropped_steps);
+
+// Print the frame statistics to standard output
+void frame_timing_report(void);
+
+#endif /* FRAME_TIMING_H_ */
@@ -0,0 +1,101 @@
+/*
+ * framebuffer.c
+ *
+ * Drawing on packed frames - see framebuffer.h
+ */
+
+#include <stdint.h>
+
+#include "framebuffer.h"
+
+/* Mask for the bits of one pixel (at the least significant end) */
+#define PIXEL_MASK (FRAME_PALETTE_SIZE - 1)
+
+/* Return a byte with every pixel in it set to the given index, e.g.
+ * 0x33 for index 3 with 4 bits per pixel.
+ */
+static uint8_t replicate(uint8_t index) {
+	uint8_t pixels = 0;
+	index &= PIXEL_MASK;
+	for(uint8_t p = 0; p < FRAME_PIXELS_PER_BYTE; p++) {
+		pixels = (pixels << FRAME_BITS_PER_PIXEL) | index;
+	}
+	return pixels;
+}
+
+void frame_fill(PackedFrame frame, uint8_t index) {
+	uint8_t pixels = replicate(index);
+	for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+		for(uint8_t i = 0; i < FRAME_BYTES_PER_COLUMN; i++) {
+			frame[x][i] = pixels;
+		}
+	}
+}
+
+void frame_copy(PackedFrame from, PackedFrame to) {
+	for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+		for(uint8_t i = 0; i < FRAME_BYTES_PER_COLUMN; i++) {
+			to[x][i] = from[x][i];
+		}
+	}
+}
+
+void frame_set_pixel(PackedFrame frame, uint8_t x, uint8_t y, uint8_t index) {
+	if(x >= MATRIX_NUM_COLUMNS || y >= MATRIX_NUM_ROWS) {
+		return;
+	}
+	uint8_t shift = (y % FRAME_PIXELS_PER_BYTE) * FRAME_BITS_PER_PIXEL;
+	uint8_t* pixels = &frame[x][y / FRAME_PIXELS_PER_BYTE];
+	*pixels = (*pixels & ~(PIXEL_MASK << shift)) | ((index & PIXEL_MASK) << shift);
+}
+
+uint8_t frame_get_pixel(PackedFrame frame, uint8_t x, uint8_t y) {
+	if(x >= MATRIX_NUM_COLUMNS || y >= MATRIX_NUM_ROWS) {
+		return 0;
+	}
+	return PACKED_PIXEL(frame, x, y);
+}
+
+void frame_fill_column(PackedFrame frame, uint8_t x, uint8_t index) {
+	if(x >= MATRIX_NUM_COLUMNS) {
+		return;
+	}
+	uint8_t pixels = replicate(index);
+	for(uint8_t i = 0; i < FRAME_BYTES_PER_COLUMN; i++) {
+		frame[x][i] = pixels;
+	}
+}
+
+void frame_fill_row(PackedFrame frame, uint8_t y, uint8_t index) {
+	if(y >= MATRIX_NUM_ROWS) {
+		return;
+	}
+	// The row is the same pixel in every column so the byte, mask and
+	// new value are the same for each column
+	uint8_t i = y / FRAME_PIXELS_PER_BYTE;
+	uint8_t shift = (y % FRAME_PIXELS_PER_BYTE) * FRAME_BITS_PER_PIXEL;
+	uint8_t keep = ~(PIXEL_MASK << shift);
+	uint8_t value = (index & PIXEL_MASK) << shift;
+	for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+		frame[x][i] = (frame[x][i] & keep) | value;
+	}
+}
+
+void frame_blit_column(PackedFrame frame, uint8_t x, MatrixColumnMask mask, uint8_t index) {
+	if(x >= MATRIX_NUM_COLUMNS) {
+		return;
+	}
+	uint8_t pixels = replicate(index);
+	for(uint8_t i = 0; i < FRAME_BYTES_PER_COLUMN && mask; i++) {
+		// Expand the bits of the mask for this byte's pixels into a
+		// mask of whole pixels, then update those pixels in one go
+		uint8_t bits = 0;
+		for(uint8_t p = 0; p < FRAME_PIXELS_PER_BYTE; p++) {
+			if(mask & (1 << p)) {
+				bits |= PIXEL_MASK << (p * FRAME_BITS_PER_PIXEL);
+			}
+		}
+		frame[x][i] = (frame[x][i] & ~bits) | (pixels & bits);
+		mask >>= FRAME_PIXELS_PER_BYTE;
+	}
+}
@@ -0,0 +1,41 @@
+/*
+ * framebuffer.h
+ *
+ * Drawing on packed frames (see PackedFrame in ledmatrix.h). Pixels
+ * are palette indices rather than colours, so a frame takes 64 bytes
+ * (4 bits per pixel) or 32 bytes (2 bits per pixel) for each panel
+ * rather than the 128 bytes of a MatrixData. Where possible the
+ * functions work on whole bytes (several pixels) at a time.
+ *
+ * As for the LED matrix functions, x is the column number (0 to
+ * MATRIX_NUM_COLUMNS-1) and y is the row number (0 to
+ * MATRIX_NUM_ROWS-1). Requests with invalid x or y values are ignored.
+ */
+
+#ifndef FRAMEBUFFER_H_
+#define FRAMEBUFFER_H_
+
+#include <stdint.h>
+#include "ledmatrix.h"
+
+// Set every pixel in the frame to the given palette index
+void frame_fill(PackedFrame frame, uint8_t index);
+
+// Copy one frame to another
+void frame_copy(PackedFrame from, PackedFrame to);
+
+// Set/get the palette index of a single pixel. frame_get_pixel()
+// returns 0 for an invalid position.
+void frame_set_pixel(PackedFrame frame, uint8_t x, uint8_t y, uint8_t index);
+uint8_t frame_get_pixel(PackedFrame frame, uint8_t x, uint8_t y);
+
+// Set every pixel in a column/row to the given palette index
+void frame_fill_column(PackedFrame frame, uint8_t x, uint8_t index);
+void frame_fill_row(PackedFrame frame, uint8_t y, uint8_t index);
+
+// Set the pixels in column x for which the corresponding bit of mask
+// is 1 (bit 0 is row 0) to the given palette index. Other pixels are
+// left unchanged.
+void frame_blit_column(PackedFrame frame, uint8_t x, MatrixColumnMask mask, uint8_t index);
+
+#endif /* FRAMEBUFFER_H_ */
@@ -7,7 +7,9 @@
 
 
 #include <stdlib.h>
+#include <string.h>
 #include <util/delay.h>
+#include <util/crc16.h>
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <avr/pgmspace.h>
@@ -22,11 +24,20 @@
 #include "score.h"
 #include "pixel_colour.h"
 #include "game.h"
+#include "latency.h"
+#include "profile.h"
+#include "frame_timing.h"
+#include "framebuffer.h"
+#include "sprite.h"
+#include "display_encoder.h"
+#include "entity.h"
+#include "game_state.h"
 #include "ledmatrix.h"
 #include "pixel_colour.h"
+#include "audio.h"
+#include "coroutine.h"
 
 #include <util/delay.h>
-/* Stdlib needed for random() - random number generator */
 
 ///////////////////////////////////////////////////////////
 // Colours
@@ -35,143 +46,455 @@
 #define COLOUR_BASE			COLOUR_YELLOW
 
 ///////////////////////////////////////////////////////////
-// Game positions (x,y) where x is 0 to 7 and y is 0 to 15
-// are represented in a single 8 bit unsigned integer where the most
-// significant 4 bits are the x value and the least significant 4 bits
-// are the y value. The following macros allow the extraction of x and y
+// Palette indices. The game field is drawn into a packed frame (see
+// framebuffer.h) holding an index into gamePalette for each pixel.
+// With only 2 bits per pixel there is no room for separate explosion
+// and life lost colours so these reuse entries with the same (or a
+// similar) colour.
+#define PALETTE_BLACK		0
+#define PALETTE_ASTEROID	1
+#define PALETTE_PROJECTILE	2
+#define PALETTE_BASE		3
+#if FRAME_PALETTE_SIZE > 4
+#define PALETTE_EXPLOSION	4
+#define PALETTE_LIFE_LOST	5
+#define PALETTE_VISUAL		6
+#else
+#define PALETTE_EXPLOSION	PALETTE_BASE
+#define PALETTE_LIFE_LOST	PALETTE_PROJECTILE
+#define PALETTE_VISUAL		PALETTE_BASE
+#endif
+#define PALETTE_HUD			PALETTE_VISUAL
+
+///////////////////////////////////////////////////////////
+// Game positions (x,y) where x is 0 to FIELD_WIDTH-1 and y is 0 to
+// FIELD_HEIGHT-1 are represented in a single unsigned integer where the
+// most significant half is the x value and the least significant half
+// is the y value - 4 bits each for fields up to 16 by 16, otherwise 8
+// bits each. The following macros allow the extraction of x and y
 // values from a combined position value and the construction of a combined 
 // position value from separate x, y values. Values are assumed to be in
-// valid ranges. Invalid positions are any where the least significant
-// bit is 1 (i.e. x value greater than 7). We can use all 1's (255) to 
-// represent this.
-#define GAME_POSITION(x,y)		( ((x) << 4)|((y) & 0x0F) )
-#define GET_X_POSITION(posn)	((posn) >> 4)
-#define GET_Y_POSITION(posn)	((posn) & 0x0F)
-#define INVALID_POSITION		255
+// valid ranges. We use all 1's to represent an invalid position.
+#if FIELD_WIDTH > 16 || FIELD_HEIGHT > 16
+typedef uint16_t GamePosition;
+#define GAME_POSITION_BITS		8
+#else
+typedef uint8_t GamePosition;
+#define GAME_POSITION_BITS		4
+#endif
+#define GAME_POSITION_MASK		((1 << GAME_POSITION_BITS) - 1)
+#define GAME_POSITION(x,y)		( ((GamePosition)(x) << GAME_POSITION_BITS)|((y) & GAME_POSITION_MASK) )
+#define GET_X_POSITION(posn)	((posn) >> GAME_POSITION_BITS)
+#define GET_Y_POSITION(posn)	((posn) & GAME_POSITION_MASK)
+#define INVALID_POSITION		((GamePosition)~0)
 
 ///////////////////////////////////////////////////////////
 // Macros to convert game position to LED matrix position
-// Note that the row number (y value) in the game (0 to 15 from the bottom) 
-// corresponds to x values on the LED matrix (0 to 15).
-// Column numbers (x values) in the game (0 to 7 from the left) correspond
-// to LED matrix y values rom 7 to 0
+// Note that the row number (y value) in the game (0 to FIELD_HEIGHT-1
+// from the bottom) corresponds to x values on the LED matrix.
+// Column numbers (x values) in the game (0 to FIELD_WIDTH-1 from the
+// left) correspond to LED matrix y values from FIELD_WIDTH-1 to 0
 //
 // Note that these macros result in two expressions that are comma separated - suitable
 // as use for the first two arguments to ledmatrix_update_pixel().
-#define LED_MATRIX_POSN_FROM_XY(gameX, gameY)		(gameY) , (7-(gameX))
+#define LED_MATRIX_POSN_FROM_XY(gameX, gameY)		(gameY) , (FIELD_WIDTH-1-(gameX))
 #define LED_MATRIX_POSN_FROM_GAME_POSN(posn)		\
 		LED_MATRIX_POSN_FROM_XY(GET_X_POSITION(posn), GET_Y_POSITION(posn))
 
+///////////////////////////////////////////////////////////
+// Fixed point positions and speeds. Asteroid and projectile y
+// positions are 8.8 fixed point numbers - the upper 8 bits are the row
+// (cell) and the lower 8 bits how far up that row the object is (in
+// 256ths of a row). Speeds are in rows per step, in the same format.
+// Objects are drawn in the row they are in, so an object only appears
+// to move when it crosses into another row.
+#define FIXED_ONE			256
+#define FIXED_HALF			128
+#define FIXED(cell)			((uint16_t)(cell) << 8)
+#define CELL(fixed)			((uint8_t)((fixed) >> 8))
+
+// Asteroids fall at a random speed from 0.75 to 1.25 rows per asteroid
+// step. Projectiles move up PROJECTILE_SPEED rows per projectile step.
+#define ASTEROID_SPEED_MIN	(FIXED_ONE - FIXED_ONE/4)
+#define ASTEROID_SPEED_RANGE	(FIXED_HALF + 1)
+#define PROJECTILE_SPEED	FIXED_ONE
+
+// Snapshots store speeds as a byte above ASTEROID_SPEED_MIN
+#if ASTEROID_SPEED_RANGE > 256 || PROJECTILE_SPEED - ASTEROID_SPEED_MIN > 255
+#error "Speeds don't fit in a snapshot"
+#endif
+
+// Impacts are planned (see impactTarget) on asteroids moving less than
+// 2 rows per step, so a projectile's target (above row 2) can't fall to
+// the bottom row and be replaced at the top before it hits
+#if ASTEROID_SPEED_MIN + ASTEROID_SPEED_RANGE - 1 >= 2 * FIXED_ONE
+#error "Asteroids are too fast for the planned impacts"
+#endif
+
+// Attempts at finding room for a large asteroid at the start of the
+// game
+#define PLACE_TRIES		64
+
+// How long the life lost sprite is shown for, and the gap before it can
+// be shown again
+#define LIFE_LOST_FLASH_MS	450
+
+// Time between the steps of the game over animation
+#define VISUAL_STEP_MS		150
+
+// Time each step of an explosion is shown for
+#define EXPLOSION_STEP_MS	150
+
 ///////////////////////////////////////////////////////////
 // Global variables.
 //
-// basePosition - stores the x position of the centre point of the 
-// base station. The base station is three positions wide, but is
-// permitted to partially move off the game field so that the centre
-// point can take on any position from 0 to 7 inclusive.
+// The game in play - its bases, score, lives, asteroids, projectiles
+// and random number generator (see game_state.h). Everything here acts
+// on the game gameState points to, which is boardGame unless
+// game_use() has been called with another one.
 //
-// numProjectiles - The number of projectiles currently in flight. Must
-// be less than or equal to MAX_PROJECTILES.
+// The asteroids and projectiles are kept in the entity table (see
+// entity.h) - entityX, entityY and entitySpeed are the column, fixed
+// point row and fixed point speed of each one. The asteroids are in
+// slots ENTITY_FIRST(ENTITY_ASTEROID) to ENTITY_END(ENTITY_ASTEROID)-1
+// and the projectiles in the projectile slots. Slots are in no
+// particular order - when an entity is removed the last one of the same
+// type takes its place.
 //
-// projectiles - x,y positions of the projectiles that are currently
-// in flight. The upper 4 bits represent the x position; the lower 4
-// bits represent the y position. The array is indexed by projectile
-// number from 0 to numProjectiles - 1.
-//
-// numAsteroids - The number of asteroids currently on the game field.
-// Must be less than or equal to MAX_ASTEROIDS.
-//
-// asteroids - x,y positions of the asteroids on the field. The upper
-// 4 bits represent the x position; the lower 4 bits represent the 
-// y position. The array is indexed by asteroid number from 0 to 
-// numAsteroids - 1.
+// The boards are worked out from the table (see index_entities()) and
+// are used to find room for asteroids and to draw the field without
+// searching the table.
+
+GameState	boardGame = { .numPlayers = 1, .random = 1 };
+GameState*	gameState = &boardGame;
+
+// quiet - 1 while steps are being run again after a rollback (see
+// game_set_quiet()), when nothing is drawn or shown. quietScore and
+// quietLives are the score and lives shown when it was turned on.
+static uint8_t		quiet;
+static uint32_t		quietScore;
+static uint8_t		quietLives;
+
+// Hits found during a step, as game positions. The explosions are
+// started once every object has been moved (see show_hits()).
+static GamePosition	pendingHits[MAX_PROJECTILES];
+static uint8_t		numPendingHits;
+
+// Hits whose explosions are being shown, and the frames of the
+// explosion sprite shown (from explosionFirst to explosionLast). The
+// explosions are shown by a coroutine (see explosion_task()) run by
+// game_task() - hits made meanwhile wait until they have finished.
+static GamePosition	explosions[MAX_PROJECTILES];
+static uint8_t		numExplosions;
+static uint8_t		explosionFirst;
+static uint8_t		explosionLast;
+static GamePosition	waitingHits[MAX_PROJECTILES];
+static uint8_t		numWaitingHits;
+static Coroutine	explosion;
+static uint8_t		explosionState;
+
+// Players whose life lost sprite is still to be shown, and those whose
+// sprite is being shown (one bit for each player). The sprite is shown
+// by a coroutine (see flash_task()) run by game_task(), so the game
+// carries on meanwhile.
+static uint8_t		lifeLostPending;
+static uint8_t		lifeLostShown;
+static Coroutine	flash;
+static uint8_t		flashState;
+
+// SPI bytes sent by asteroid steps, and the bytes that erasing and
+// redrawing each asteroid would have taken
+static uint16_t		asteroidSteps;
+static uint32_t		asteroidStepBytes;
+static uint32_t		asteroidStepBytesPerAsteroid;
+
+// Planned impacts. Projectiles only move up and asteroids only move
+// down, each at its own speed, so the asteroid a projectile will hit is
+// the lowest one (by fixed point row - see asteroid_before()) covering
+// its column and not wholly below it. impactTarget is the handle of that
+// asteroid for each projectile (by PROJECTILE_INDEX() of its slot), or
+// NO_ENTITY if there isn't one, so each step only compares the rows of
+// a projectile and its target. impactReplan is the number of asteroid
+// steps until another asteroid in the column falls past the target, or
+// 0 if none does before the target reaches the projectile. A plan is
+// made again (see plan_columns()) when the projectile is fired, when an
+// asteroid is added to or removed from its column, and when its
+// target is overtaken.
+#define PROJECTILE_INDEX(slot)	((slot) - ENTITY_BASE_PROJECTILE)
+
+// 1 while the hits of an asteroid step are being found. An asteroid can
+// still hit a projectile it has fallen past in the step then, so plans
+// made meanwhile also count the rows the asteroids have just left.
+static uint8_t		asteroidsFalling;
+
+// Collision tests made (asteroids looked at when planning, and targets
+// checked each step), and the tests that checking every projectile
+// against every asteroid each step would have taken. In Debug builds
+// the impacts are also checked against sweeping each object along the
+// path it has moved, and any disagreements are counted.
+static GameCollisionStats	collisions;
 
-int8_t		basePosition;
-int8_t		numProjectiles;
-uint8_t		projectiles[MAX_PROJECTILES];
-int8_t		numAsteroids;
-uint8_t		asteroids[MAX_ASTEROIDS];
-volatile int8_t		terminate;
+// gameFrame - the game field as palette indices. Drawing only changes
+// gameFrame - it is sent to the LED matrix by flush_display().
+// shownFrame - copy of what is on the LED matrix, as palette indices.
+// gamePalette - colour of each palette index.
+static PackedFrame	gameFrame;
+static PackedFrame	shownFrame;
+static FramePalette	gamePalette = {
+	[PALETTE_BLACK] = COLOUR_BLACK,
+	[PALETTE_ASTEROID] = COLOUR_ASTEROID,
+	[PALETTE_PROJECTILE] = COLOUR_PROJECTILE,
+	[PALETTE_BASE] = COLOUR_BASE,
+#if FRAME_PALETTE_SIZE > 4
+	[PALETTE_EXPLOSION] = COLOUR_ORANGE,
+	[PALETTE_LIFE_LOST] = COLOUR_RED,
+	[PALETTE_VISUAL] = COLOUR_YELLOW,
+#endif
+};
 
 
 ///////////////////////////////////////////////////////////
-// Prototypes for internal information functions 
+// Prototypes for internal information functions
 //  - not available outside this module.
 
-// Is there is an asteroid/projectile at the given position?. 
-// Returns -1 if no, asteroid/projectile index number if yes.
-// (The index number is the array index in the asteroids/
-// projectiles array above.)
+// Is there is a projectile at the given position?.
+// Returns NO_ENTITY if no, the projectile's slot in the entity table
+// if yes.
+static uint8_t projectile_at(uint8_t x, uint8_t y);
 
-static int8_t asteroid_at(uint8_t x, uint8_t y);
-static int8_t projectile_at(uint8_t x, uint8_t y);
+// Which player's base covers the given position? Returns the player,
+// or -1 if no base does.
+static int8_t base_at(uint8_t x, uint8_t y);
 
-// Remove the asteroid/projectile at the given index number. If
-// the index is not valid, then no removal is performed. This 
-// enables the functions to be used like:
-//		remove_asteroid(asteroid_at(x,y));
-static void remove_asteroid(int8_t asteroidIndex);
-static void remove_projectile(int8_t projectileIndex);
+// Find the lowest entity of the given type covering column x in rows
+// fromY to toY inclusive. Returns NO_ENTITY if there isn't one,
+// otherwise its slot (and, if foundY isn't null, sets *foundY to the
+// row).
+static uint8_t find_entity(uint8_t type, uint8_t x, uint8_t fromY, uint8_t toY,
+		uint8_t* foundY);
+
+#ifndef NDEBUG
+// Find the highest projectile in the positions the asteroid in the
+// given slot passed through when its bottom row moved down from row
+// fromY to row toY. Returns the projectile's slot and sets *hitY to its
+// row, or returns NO_ENTITY and sets *hitY to 0 if there isn't one.
+// (Only used to check the planned impacts.)
+static uint8_t sweep_asteroid(uint8_t slot, uint8_t fromY, uint8_t toY,
+		uint8_t* hitY);
+#endif
+
+// Plan the impacts of the projectiles in the given columns (see
+// impactTarget)
+static void plan_columns(FieldRowMask columns);
+
+// Put the slots of the asteroids covering column x in asteroids, and
+// return how many there are
+static uint8_t column_asteroids(uint8_t x, uint8_t* asteroids);
+
+// Plan the impact of the projectile in the given slot, given the count
+// asteroids covering its column
+static void plan_impact(uint8_t slot, const uint8_t* asteroids, uint8_t count);
+
+// Is any of the asteroid in slot a at or above row y (or was it, before
+// the step - see asteroidsFalling)? Returns 1 if yes, 0 if no.
+static uint8_t asteroid_above(uint8_t a, uint8_t y);
+
+// Should the asteroid in slot a, at fixed point row aY, be hit before
+// the one in slot b, at row bY? Returns 1 if yes, 0 if no. The lower
+// one is hit first, then the faster one (so asteroids at the same row
+// don't change places next step), and the rest only decide between
+// asteroids which are the same in every way but slot.
+static uint8_t asteroid_before(uint8_t a, uint16_t aY, uint8_t b, uint16_t bY);
+
+// Number of asteroid steps until the asteroid in slot other comes
+// before the one in slot target (see asteroid_before()), or 0 if it
+// doesn't before the target's bottom row reaches row y
+static uint8_t steps_to_overtake(uint8_t target, uint8_t other, uint8_t y);
+
+// Remove the projectile in the given slot, moving its planned impact
+// with the projectile which takes its place
+static void remove_projectile(uint8_t slot);
+
+// The positions in the given row of the shape of the given size with
+// its bottom left corner in column x (row is relative to the bottom of
+// the shape), and the columns the shape covers in any row
+static FieldRowMask shape_row(uint8_t size, uint8_t x, uint8_t row);
+static FieldRowMask shape_columns(uint8_t size, uint8_t x);
+
+// Does the entity in the given slot cover position (x,y)? Returns 1 if
+// yes, 0 if no.
+static uint8_t entity_covers(uint8_t slot, uint8_t x, uint8_t y);
+
+// Work out the board for the given type from the table
+static void index_entities(uint8_t type);
+
+// Add an asteroid of the given size and speed with its bottom left
+// corner in column x and at fixed point row y, or of a random size and
+// speed at the top of the field. Returns the columns it covers, where
+// the impacts need planning again (0 if there's no room for it).
+static FieldRowMask add_asteroid(uint8_t x, uint16_t y, uint8_t size, uint16_t speed);
+static FieldRowMask add_asteroid_at_top(void);
+
+// Could an asteroid of the given size go at (x,y) without covering
+// another asteroid or a projectile? Returns 1 if yes, 0 if no.
+static uint8_t asteroid_fits(uint8_t x, uint8_t y, uint8_t size);
+
+// Pick a random column for an asteroid of the given size at the top of
+// the field, not covering any of the columns in the avoid mask (if
+// possible)
+static uint8_t random_top_column(FieldRowMask avoid, uint8_t size);
+static uint8_t random_asteroid_size(void);
+static uint16_t random_asteroid_speed(void);
+static uint32_t game_random(void);
+
+// An asteroid of the given size in column x has reached the base row.
+// A large asteroid costs at most one life, so only the first of its
+// columns over a base is returned (as a mask), or 0 if none is.
+static FieldRowMask base_reached(uint8_t x, uint8_t size);
+
+// Projectile in slot projectileSlot has hit the asteroid in slot
+// asteroidSlot at row hitY (of the projectile's column)
+static void projectile_hit_asteroid(uint8_t projectileSlot, uint8_t asteroidSlot,
+		uint8_t hitY);
+
+// Show the explosions for the hits found during a step
+static void show_hits(void);
 void advance_asteroids(void);
 
-// Redraw functions
+// Redraw functions. The colour to use is given as a palette index
+// (PALETTE_...)
+static void draw_cell(int8_t x, int8_t y, uint8_t paletteIndex);
+static void flush_display(void);
+static void clear_display(void);
+static void render_field(void);
 static void redraw_whole_display(void);
-static void redraw_base(uint8_t colour);
-static void redraw_all_asteroids(void);
-static void redraw_asteroid(uint8_t asteroidNumber, uint8_t colour);
-static void redraw_all_projectiles(void);
-static void redraw_projectile(uint8_t projectileNumber, uint8_t colour);
+static void redraw_base(uint8_t player, uint8_t paletteIndex);
+
+// Coroutines which flash the life lost sprites and show the explosions
+// (see coroutine.h)
+static uint8_t flash_task(Coroutine* c);
+static uint8_t explosion_task(Coroutine* c);
 
 ///////////////////////////////////////////////////////////
 //prototype the methods which checks lives of the player
 void check_lives(uint8_t x, uint8_t y);
-void game_animation(uint8_t x, uint8_t y);
 
- 
+
 // Initialise game field:
-// (1) base starts in the centre (x=3)
+// (1) base starts in the centre (x=3 for a field 8 wide), or with two
+//     players the bases start a quarter of the way in from each side
 // (2) no projectiles initially
-// (3) the maximum number of asteroids, randomly distributed.
+// (3) NUM_ASTEROIDS asteroids of random sizes, randomly distributed.
 void initialise_game(void) {
-	uint8_t x, y, i;
-	
-    basePosition = 3;
-	numProjectiles = 0;
-	numAsteroids = 0;
+	uint8_t x, y, i, size, tries;
+
+	if(gameState->numPlayers == 1) {
+		gameState->basePosition[0] = FIELD_WIDTH/2 - 1;
+	} else {
+		gameState->basePosition[0] = FIELD_WIDTH/4;
+		gameState->basePosition[1] = FIELD_WIDTH - 1 - FIELD_WIDTH/4;
+	}
+	entity_clear();
+	numPendingHits = 0;
+	numWaitingHits = 0;
+	numExplosions = 0;
+	lifeLostPending = 0;
+	lifeLostShown = 0;
+	index_entities(ENTITY_ASTEROID);
+	index_entities(ENTITY_PROJECTILE);
+	asteroidSteps = 0;
+	asteroidStepBytes = 0;
+	asteroidStepBytesPerAsteroid = 0;
+	memset(&collisions, 0, sizeof(collisions));
 	PORTC |= 0x78;
-	
-	
-	PORTA = 0b01111100;
-	
 
-	for(i=0; i < MAX_ASTEROIDS ; i++) {
-		// Generate random position that does not already
-		// have an asteroid.
+
+	// (The rest of port A may be slave selects - see ledmatrix.h)
+	PORTA |= 0b01111100;
+
+
+	for(i=0; i < NUM_ASTEROIDS ; i++) {
+		// Generate random position for the asteroid's bottom left
+		// corner that does not overlap an existing asteroid.
+		size = random_asteroid_size();
+		tries = 0;
 		do {
+			// The field may have no room left for a large asteroid
+			// - make it a single cell if it hasn't fitted after a
+			// while
+			if(++tries > PLACE_TRIES) {
+				size = 1;
+			}
 			// Generate random x position - somewhere from 0
-			// to FIELD_WIDTH - 1
-			x = (uint8_t)(random() % FIELD_WIDTH);
+			// to FIELD_WIDTH - size
+			x = (uint8_t)(game_random() % (FIELD_WIDTH - size + 1));
 			// Generate random y position - somewhere from 3
-			// to FIELD_HEIGHT - 1 (i.e., not in the lowest
+			// to FIELD_HEIGHT - size (i.e., not in the lowest
 			// three rows)
-			y = (uint8_t)(3 + (random() % (FIELD_HEIGHT-3)));
-		} while(asteroid_at(x,y) != -1);
+			y = (uint8_t)(3 + (game_random() % (FIELD_HEIGHT - size - 2)));
+		} while(!asteroid_fits(x, y, size));
 		// If we get here, we've now found an x,y location without
 		// an existing asteroid - record the position
-		asteroids[i] = GAME_POSITION(x,y);
-		numAsteroids++;
+		add_asteroid(x, FIXED(y) + FIXED_HALF, size, random_asteroid_speed());
+	}
+	if(!quiet) {
+		redraw_whole_display();
+	}
+
+}
+
+void game_set_players(uint8_t players) {
+	if(players < 1) {
+		players = 1;
+	}
+	gameState->numPlayers = players < GAME_MAX_PLAYERS ? players : GAME_MAX_PLAYERS;
+}
+
+void game_use(GameState* state) {
+	gameState = state ? state : &boardGame;
+}
+
+void game_seed_random(uint32_t seed) {
+	// Xorshift gets stuck at 0
+	gameState->random = seed ? seed : 1;
+}
+
+void game_set_quiet(uint8_t on) {
+	if(on && !quiet) {
+		quietScore = get_score();
+		quietLives = get_lives();
 	}
-	redraw_whole_display();
+	if(!on && quiet) {
+		quiet = 0;
+		numPendingHits = 0;
+		render_field();
+		flush_display();
+		if(get_score() != quietScore || get_lives() != quietLives) {
+			score_show();
+		}
+	}
+	quiet = on;
+}
 
+uint8_t game_is_quiet(void) {
+	return quiet;
 }
 
-// Attempt to move the base station to the left or right. 
+int8_t move_base(int8_t direction) {
+	return move_player_base(0, direction);
+}
+
+int8_t fire_projectile(void) {
+	return fire_player_projectile(0);
+}
+
+// Attempt to move a player's base station to the left or right.
 // The direction argument has the value MOVE_LEFT or
-// MOVE_RIGHT. The move succeeds if the base isn't all 
+// MOVE_RIGHT. The move succeeds if the base isn't all
 // the way to one side, e.g., not permitted to move
 // left if basePosition is already 0.
 // Returns 1 if move successful, 0 otherwise.
-int8_t move_base(int8_t direction) {	
+int8_t move_player_base(uint8_t player, int8_t direction) {
 	// The initial version of this function just moves
 	// the base one position to the left, no matter where
 	// the base station is now or what the direction argument
@@ -179,421 +502,1141 @@ int8_t move_base(int8_t direction) {
 	// (and eventually wrap around - e.g. subtracting 1 from
 	// basePosition 256 times will eventually bring it back to
 	// same value.
-	
+
 	switch(direction){
 		case (MOVE_LEFT):
 			//checking if the position is within the bound limit,
 			// if so We erase the base from its current position first
 			// and Redraw the base. Other wise we do nothing.
-			if(basePosition > 0){
-				redraw_base(COLOUR_BLACK);
-				basePosition--;
-				redraw_base(COLOUR_BASE);
+			if(gameState->basePosition[player] > 0){
+				latency_tag_state_change();
+				redraw_base(player, PALETTE_BLACK);
+				gameState->basePosition[player]--;
+				redraw_base(player, PALETTE_BASE);
 			}
 			break;
 
 		default:
-			if(basePosition < 7){
-				redraw_base(COLOUR_BLACK);
-				basePosition++;
-				redraw_base(COLOUR_BASE);
+			if(gameState->basePosition[player] < FIELD_WIDTH-1){
+				latency_tag_state_change();
+				redraw_base(player, PALETTE_BLACK);
+				gameState->basePosition[player]++;
+				redraw_base(player, PALETTE_BASE);
 			}
 		}
+	if(gameState->numPlayers > 1 || lifeLostShown || numExplosions) {
+		// Erasing the base may have erased part of another one or of
+		// an explosion, and the life lost sprite moves with it
+		render_field();
+	}
+	// Only the pixels which changed are sent
+	flush_display();
 
 	return 1;
 }
 
 
-// Fire projectile - add it immediately above the base
+// Fire projectile - add it immediately above a player's base
 // station, provided there is not already a projectile
 // there. We are also limited in the number of projectiles
 // we can have in flight (to MAX_PROJECTILES).
 // Returns 1 if projectile fired, 0 otherwise.
-int8_t fire_projectile(void) {
-	uint8_t newProjectileNumber;
-	if(numProjectiles < MAX_PROJECTILES && 
-			projectile_at(basePosition, 2) == -1) {
+int8_t fire_player_projectile(uint8_t player) {
+	uint8_t newProjectileSlot, asteroidSlot;
+	uint8_t x = gameState->basePosition[player];
+	if(!entity_full(ENTITY_PROJECTILE) &&
+			projectile_at(x, 2) == NO_ENTITY) {
 		// Have space to add projectile - add it at the x position of
 		// the base, in row 2(y=2)
-		newProjectileNumber = numProjectiles++;
-		projectiles[newProjectileNumber] = GAME_POSITION(basePosition, 2);
-		redraw_projectile(newProjectileNumber, COLOUR_PROJECTILE);
+		newProjectileSlot = entity_add(ENTITY_PROJECTILE, x,
+				FIXED(2), PROJECTILE_SPEED);
+		latency_tag_state_change();
+		plan_columns(FIELD_COLUMN_BIT(x));
+		asteroidSlot = entity_slot(
+				gameState->impactTarget[PROJECTILE_INDEX(newProjectileSlot)]);
+		if(asteroidSlot != NO_ENTITY && CELL(entityY[asteroidSlot]) > 2) {
+			asteroidSlot = NO_ENTITY;
+		}
+#ifndef NDEBUG
+		if((asteroidSlot == NO_ENTITY) !=
+				(find_entity(ENTITY_ASTEROID, x, 2, 2, 0) == NO_ENTITY)) {
+			collisions.errors++;
+		}
+#endif
+		if(asteroidSlot != NO_ENTITY) {
+			// Fired straight into an asteroid
+			projectile_hit_asteroid(newProjectileSlot, asteroidSlot, 2);
+		}
+		index_entities(ENTITY_PROJECTILE);
+		if(!quiet) {
+			audio_play(AUDIO_SOUND_FIRE);
+		}
+		render_field();
+		flush_display();
+		show_hits();
 		return 1;
 	} else {
 		return 0;
 	}
 }
-// Returns 1 if projectile fired, 0 otherwise.
+int8_t game_base_position(uint8_t player) {
+	return gameState->basePosition[player];
+}
+
+void game_copy_board(uint8_t type, FieldRowMask* board) {
+	memcpy(board, gameState->boards[type], sizeof(Bitboard));
+}
+
+const FieldRowMask* game_board(uint8_t type) {
+	return gameState->boards[type];
+}
+
+// Move every asteroid down by its speed, then hit the projectiles which
+// the asteroids have reached (see impactTarget) - the highest first, as
+// an asteroid falling past several projectiles meets that one first.
+// Asteroids that reach the bottom row are moved back to the top in
+// different columns.
 void advance_asteroids(void) {
-	int8_t x, y;
-	int8_t asteroidNumber;
-	asteroidNumber = 0;
-	while(asteroidNumber < numAsteroids) {
-		// Get the current position of the projectile
-		x = GET_X_POSITION(asteroids[asteroidNumber]);
-		y = GET_Y_POSITION(asteroids[asteroidNumber]);
-		// Work out the new position (but don't update the projectil
-		// location yet - we only do that if we know the move is valid)
-		y = y-1;
-		// Chek if new position would be off the top of the display
-		if(y == 0) {
-			
-			redraw_asteroid(asteroidNumber, COLOUR_BLACK);
-			// Update the asteroid's position
-			int newColumn;
-			while(1){
-				newColumn = (uint8_t)(random() % FIELD_WIDTH);
-				if(newColumn != x){
-					break;
-				}
+	uint8_t x, fromY, toY, size, index, count;
+	FieldRowMask reachedBase = 0, arrived = 0;
+	uint16_t y;
+	uint8_t slot, projectileSlot, asteroidSlot;
+	uint8_t asteroids[MAX_ASTEROIDS];
+	uint32_t bytesBefore = display_encoder_bytes_sent();
+#ifndef NDEBUG
+	EntityHandle swept[MAX_PROJECTILES];
+	uint8_t numSwept = 0, hitY;
+#endif
+	PROFILE_BEGIN(PROFILE_ADVANCE_ASTEROIDS);
+
+	asteroidSteps++;
+	asteroidStepBytesPerAsteroid += entity_count(ENTITY_ASTEROID) * 2 * LEDMATRIX_PIXEL_BYTES;
+	collisions.steps++;
+	collisions.testsEveryPair += entity_count(ENTITY_PROJECTILE) * entity_count(ENTITY_ASTEROID);
+
+	for(slot = ENTITY_FIRST(ENTITY_ASTEROID); slot < ENTITY_END(ENTITY_ASTEROID); slot++) {
+		x = entityX[slot];
+		y = entityY[slot];
+		size = entitySize[slot];
+		fromY = CELL(y);
+		y = y > entitySpeed[slot] ? y - entitySpeed[slot] : 0;
+		toY = CELL(y);
+		if(fromY > 1 && toY <= 1) {
+			reachedBase |= base_reached(x, size);
+		}
+		if(toY == 0) {
+			// Replace this asteroid with a new one at the top, in
+			// different columns (unless there is no room). It can't
+			// have been any projectile's target (it would have hit the
+			// projectile on the way down), but the projectiles in the
+			// columns it arrives in need their impacts planned again.
+			size = random_asteroid_size();
+			entityX[slot] = random_top_column(shape_columns(entitySize[slot], x), size);
+			entityY[slot] = FIXED(FIELD_HEIGHT - size) + FIXED_HALF;
+			entitySize[slot] = size;
+			entitySpeed[slot] = random_asteroid_speed();
+			for(uint8_t row = 0; row < size; row++) {
+				gameState->boards[ENTITY_ASTEROID][FIELD_HEIGHT - size + row] |=
+						shape_row(size, entityX[slot], row);
 			}
-			asteroids[asteroidNumber] = GAME_POSITION(newColumn,FIELD_HEIGHT-1);
-			// Redraw the projectile
-			redraw_asteroid(asteroidNumber, COLOUR_ASTEROID);
-			// Move on to the next projectile (we don't do this if a projectile
-			//asteroidNumber++;
-			// decreased by 1
-		} else {
-			check_lives(x,y);
-			redraw_base(COLOUR_BASE);
-			if(asteroid_at(x,y + 1) != -1  && projectile_at(x, y) != -1){  //
-				//int8_t asteroid_position = asteroid_at(x,y + 1);
-				uint8_t projectileNumber = projectile_at(x,y);
-				game_animation(x,y);
-				//remove_asteroid(asteroid_at(x,y + 1));
-				remove_projectile(projectileNumber);
-				asteroidNumber ++;
-				add_to_score(1);
-				y = (uint8_t)(FIELD_HEIGHT-1);
-				
-				do {
-					//Generate random x position - somewhere from 0
-					//// to FIELD_WIDTH - 1
-					x = (uint8_t)(random() % FIELD_WIDTH);
-					
-
-				} while(asteroid_at(x,y) != -1 );
-				// Remove the projectile from the display
-				redraw_asteroid(asteroidNumber, COLOUR_BLACK);
-				// Update the projectile's position
-				asteroids[asteroidNumber] = GAME_POSITION(x,y);
-				// Redraw the projectile
-				redraw_asteroid(asteroidNumber, COLOUR_ASTEROID);
-				// Move on to the next projectile (we don't do this if a projectile
-				asteroidNumber++;
-				
-			} else {
-				// Remove the projectile from the display
-				redraw_asteroid(asteroidNumber, COLOUR_BLACK);
-				// Update the projectile's position
-				asteroids[asteroidNumber] = GAME_POSITION(x,y);
-				// Redraw the projectile
-				redraw_asteroid(asteroidNumber, COLOUR_ASTEROID);
-				// Move on to the next projectile (we don't do this if a projectile
-				asteroidNumber++;
+			arrived |= shape_columns(size, entityX[slot]);
+			continue;
+		}
+		entityY[slot] = y;
+#ifndef NDEBUG
+		// The highest projectile in the positions the asteroid has
+		// moved through must be hit
+		projectileSlot = sweep_asteroid(slot, fromY, toY, &hitY);
+		if(projectileSlot != NO_ENTITY && numSwept < MAX_PROJECTILES) {
+			swept[numSwept++] = entity_handle(projectileSlot);
+		}
+#endif
+	}
+	index_entities(ENTITY_ASTEROID);
+
+	// Plan again the impacts of the projectiles whose targets have been
+	// overtaken
+	asteroidsFalling = 1;
+	for(slot = ENTITY_FIRST(ENTITY_PROJECTILE); slot < ENTITY_END(ENTITY_PROJECTILE); slot++) {
+		index = PROJECTILE_INDEX(slot);
+		if(gameState->impactReplan[index] && --gameState->impactReplan[index] == 0) {
+			count = column_asteroids(entityX[slot], asteroids);
+			plan_impact(slot, asteroids, count);
+		}
+	}
+
+	// Hit the projectiles whose targets have reached them, highest
+	// first (then from the left). A hit changes the plans in its
+	// columns, so the projectiles are looked at again after each one.
+	do {
+		projectileSlot = NO_ENTITY;
+		for(slot = ENTITY_FIRST(ENTITY_PROJECTILE); slot < ENTITY_END(ENTITY_PROJECTILE); slot++) {
+			collisions.tests++;
+			asteroidSlot = entity_slot(gameState->impactTarget[PROJECTILE_INDEX(slot)]);
+			if(asteroidSlot != NO_ENTITY && CELL(entityY[asteroidSlot]) <= CELL(entityY[slot]) &&
+					(projectileSlot == NO_ENTITY ||
+					entityY[slot] > entityY[projectileSlot] ||
+					(entityY[slot] == entityY[projectileSlot] &&
+					entityX[slot] < entityX[projectileSlot]))) {
+				projectileSlot = slot;
 			}
-		}	}	//redraw_all_asteroids();
+		}
+		if(projectileSlot != NO_ENTITY) {
+			projectile_hit_asteroid(projectileSlot,
+					entity_slot(gameState->impactTarget[PROJECTILE_INDEX(projectileSlot)]),
+					CELL(entityY[projectileSlot]));
+		}
+	} while(projectileSlot != NO_ENTITY);
+	asteroidsFalling = 0;
+	// (Asteroids which have arrived at the top can only be over a
+	// projectile in the top rows, which is hit in the next step.)
+	plan_columns(arrived);
+#ifndef NDEBUG
+	// (A projectile's handle may since have been given to a new
+	// asteroid)
+	for(uint8_t i = 0; i < numSwept; i++) {
+		slot = entity_slot(swept[i]);
+		if(slot != NO_ENTITY && slot >= ENTITY_FIRST(ENTITY_PROJECTILE)) {
+			collisions.errors++;
+		}
+	}
+#endif
+
+	// The base, asteroids and projectiles are all drawn again - the
+	// display encoder only sends the pixels which changed
+	render_field();
+	flush_display();
+	show_hits();
+
+	// Asteroids which have reached the base
+	for(x = 0; x < FIELD_WIDTH; x++) {
+		if(reachedBase & FIELD_COLUMN_BIT(x)) {
+			check_lives(x,1);
+		}
+	}
+	render_field();
+	flush_display();
+	asteroidStepBytes += display_encoder_bytes_sent() - bytesBefore;
+	PROFILE_END(PROFILE_ADVANCE_ASTEROIDS);
 }
 
-// Move projectiles up by one position, and remove those that 
-// have gone off the top or that hit an asteroid.
+// Move projectiles up by their speed, and remove those that have gone
+// off the top or that hit an asteroid. A projectile hits its target
+// (see impactTarget) when the target's bottom row is in the rows the
+// projectile has moved through (below the top row), so a projectile
+// can't pass through an asteroid however fast it is.
 void advance_projectiles(void) {
-	uint8_t x, y;
-	int8_t projectileNumber;
+	uint8_t x, fromY, toY, hitY;
+	uint16_t y;
+	uint8_t slot, asteroidSlot;
+#ifndef NDEBUG
+	uint8_t sweptSlot, sweptY;
+#endif
+	PROFILE_BEGIN(PROFILE_ADVANCE_PROJECTILES);
 
-	projectileNumber = 0;
-	while(projectileNumber < numProjectiles) {
+	collisions.steps++;
+	collisions.testsEveryPair += entity_count(ENTITY_PROJECTILE) * entity_count(ENTITY_ASTEROID);
+	// Go through the projectiles from last to first so removing a
+	// projectile doesn't move any which haven't been dealt with yet
+	for(slot = ENTITY_END(ENTITY_PROJECTILE); slot-- > ENTITY_FIRST(ENTITY_PROJECTILE); ) {
 		// Get the current position of the projectile
-		x = GET_X_POSITION(projectiles[projectileNumber]);
-		y = GET_Y_POSITION(projectiles[projectileNumber]);
-		
-		// Work out the new position (but don't update the projectile 
+		x = entityX[slot];
+		y = entityY[slot];
+		fromY = CELL(y);
+
+		// Work out the new position (but don't update the projectile
 		// location yet - we only do that if we know the move is valid)
-		y = y+1;
-		
-		// Check if new position would be off the top of the display
-		if(y == FIELD_HEIGHT-1) {
-			// Yes - remove the projectile. (Note that we haven't updated
-			// the position of the projectile itself - so the projectile 
-			// will be removed from its old location.)
-			remove_projectile(projectileNumber);
-			// Note - we do not increment the projectileNumber here as
-			// the remove_projectile() function moves the later projectiles
-			// (if any) back down the list of projectiles so that
-			// the projectileNumber is now the next projectile to be
-			// dealt with (if we weren't at the last one in the list).
-			// remove_projectile() will also result in numProjectiles being
-			// decreased by 1
-		} else {
-			// Projectile is not going off the top of the display
-			// CHECK HERE IF THE NEW PROJECTILE LOCATION CORRESPONDS TO
-			// AN ASTEROID LOCATION. IF IT DOES, REMOVE THE PROJECTILE
-			// AND THE ASTEROID.
-			if(asteroid_at(x,y) != -1){
-				//uint8_t asteroid_position = asteroid_at(x,y);
-				
-				remove_asteroid(asteroid_at(x,y));
-				game_animation(x,y);
-				remove_projectile(projectileNumber);
-				add_to_score(1);
-				y = (uint8_t)(FIELD_HEIGHT-1);
-		
-				do {
-						 //Generate random x position - somewhere from 0
-						//// to FIELD_WIDTH - 1
-						x = (uint8_t)(random() % FIELD_WIDTH);
-						//// Generate random y position - somewhere from 3
-						//// to FIELD_HEIGHT - 1 (i.e., not in the lowest
-						//// three rows)
-						
-					} while(asteroid_at(x,y) != -1); //&& !(GAME_POSITION(x,y) != asteroid_position)
-					////Now we check if this position does not correspond to the previous position.
-					////if not, we redraw the asteroid.
-					//if(GAME_POSITION(x,y) != asteroid_position) {
-						asteroids[numAsteroids] = GAME_POSITION(x,y);
-						numAsteroids++;
-						redraw_asteroid(numAsteroids, COLOUR_ASTEROID);
-						//i = MAX_ASTEROIDS;
-				
-			} else {
-				// OTHERWISE..
-				//Remove the projectile from the display
-				redraw_projectile(projectileNumber, COLOUR_BLACK);
-
-				// Update the projectile's position
-				projectiles[projectileNumber] = GAME_POSITION(x,y);
-
-				// Redraw the projectile
-				redraw_projectile(projectileNumber, COLOUR_PROJECTILE);
-
-				// Move on to the next projectile (we don't do this if a projectile
-				// is removed since projectiles will be shuffled in the list and the
-				// next projectile (if any) will take on the same projectile number)
-				projectileNumber++;
+		y = y + entitySpeed[slot];
+		toY = CELL(y);
+
+		// CHECK HERE IF THE PROJECTILE HAS REACHED ITS TARGET (below the
+		// top row). IF IT HAS, REMOVE THE PROJECTILE AND THE ASTEROID.
+		// (The target is above the projectile unless it was added on
+		// top of it, when the projectile is hit where it is.)
+		collisions.tests++;
+		asteroidSlot = entity_slot(gameState->impactTarget[PROJECTILE_INDEX(slot)]);
+		hitY = 0;
+		if(asteroidSlot != NO_ENTITY) {
+			hitY = CELL(entityY[asteroidSlot]);
+			if(hitY < fromY) {
+				hitY = fromY;
+			}
+			if(hitY > toY || hitY > FIELD_HEIGHT-2) {
+				asteroidSlot = NO_ENTITY;
 			}
-		}			
+		}
+#ifndef NDEBUG
+		// Check against sweeping the rows the projectile has moved
+		// through (and the one it was in)
+		sweptSlot = NO_ENTITY;
+		if(fromY <= FIELD_HEIGHT-2) {
+			sweptSlot = find_entity(ENTITY_ASTEROID, x, fromY,
+					toY < FIELD_HEIGHT-2 ? toY : FIELD_HEIGHT-2, &sweptY);
+		}
+		if((sweptSlot == NO_ENTITY) != (asteroidSlot == NO_ENTITY) ||
+				(sweptSlot != NO_ENTITY && sweptY != hitY)) {
+			collisions.errors++;
+		}
+#endif
+		if(asteroidSlot != NO_ENTITY) {
+			projectile_hit_asteroid(slot, asteroidSlot, hitY);
+		} else if(toY >= FIELD_HEIGHT-1) {
+			// Gone off the top of the display - remove the projectile
+			remove_projectile(slot);
+		} else {
+			// OTHERWISE.. update the projectile's position
+			entityY[slot] = y;
+		}
+	}
+	index_entities(ENTITY_PROJECTILE);
+	render_field();
+	flush_display();
+	show_hits();
+	PROFILE_END(PROFILE_ADVANCE_PROJECTILES);
+}
+
+void game_collision_stats(GameCollisionStats* stats) {
+	*stats = collisions;
+}
+
+void game_report(void) {
+	if(asteroidSteps) {
+		printf_P(PSTR("Asteroid steps: %u, mean %lu SPI bytes (%lu redrawing each asteroid)\n"),
+				asteroidSteps, asteroidStepBytes / asteroidSteps,
+				asteroidStepBytesPerAsteroid / asteroidSteps);
 	}
+	if(collisions.steps) {
+		// In tenths of a test
+		uint32_t planned = collisions.tests * 10 / collisions.steps;
+		uint32_t everyPair = collisions.testsEveryPair * 10 / collisions.steps;
+		printf_P(PSTR("Collision tests per step: %lu.%lu planned, %lu.%lu testing every pair\n"),
+				planned / 10, planned % 10, everyPair / 10, everyPair % 10);
+	}
+#ifndef NDEBUG
+	printf_P(PSTR("Collision errors: %u\n"), collisions.errors);
+#endif
+}
+
+// Little endian values in snapshots
+static uint8_t* put16(uint8_t* p, uint16_t value) {
+	*p++ = (uint8_t)value;
+	*p++ = (uint8_t)(value >> 8);
+	return p;
+}
+
+static uint8_t* put32(uint8_t* p, uint32_t value) {
+	return put16(put16(p, (uint16_t)value), (uint16_t)(value >> 16));
+}
+
+static uint16_t get16(const uint8_t* p) {
+	return p[0] | ((uint16_t)p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* p) {
+	return get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+static uint16_t snapshot_crc(const uint8_t* buffer, uint16_t length) {
+	uint16_t crc = 0xFFFF;
+	for(uint16_t i = 0; i < length; i++) {
+		crc = _crc16_update(crc, buffer[i]);
+	}
+	return crc;
+}
+
+uint16_t game_snapshot_save(uint8_t* buffer, const GameTimers* timers) {
+	uint8_t* p = buffer;
+	uint8_t type, slot, i;
+	
+	*p++ = GAME_SNAPSHOT_VERSION;
+	*p++ = FIELD_WIDTH;
+	*p++ = FIELD_HEIGHT;
+	*p++ = gameState->numPlayers;
+	for(i = 0; i < GAME_MAX_PLAYERS; i++) {
+		*p++ = i < gameState->numPlayers ? (uint8_t)gameState->basePosition[i] : 0;
+	}
+	*p++ = (uint8_t)gameState->over;
+	*p++ = (uint8_t)get_lives();
+	p = put32(p, get_score());
+	p = put32(p, gameState->random);
+	p = put16(p, timers->projectilePeriod);
+	p = put16(p, timers->asteroidPeriod);
+	p = put16(p, timers->projectileOwed);
+	p = put16(p, timers->asteroidOwed);
+	*p++ = entity_count(ENTITY_ASTEROID);
+	*p++ = entity_count(ENTITY_PROJECTILE);
+	for(type = 0; type < ENTITY_TYPES; type++) {
+		for(slot = ENTITY_FIRST(type); slot < ENTITY_END(type); slot++) {
+			*p++ = entityX[slot];
+			*p++ = entitySize[slot];
+			p = put16(p, entityY[slot]);
+			*p++ = (uint8_t)(entitySpeed[slot] - ASTEROID_SPEED_MIN);
+		}
+	}
+	p = put16(p, snapshot_crc(buffer, p - buffer));
+	return p - buffer;
+}
+
+uint8_t game_snapshot_restore(const uint8_t* buffer, uint16_t length, GameTimers* timers) {
+	const uint8_t* p;
+	uint8_t numAsteroids, numProjectiles, type, i, count, slot;
+	uint16_t snapshotLength;
+	
+	// Check the snapshot is one we can use before changing anything
+	if(length < GAME_SNAPSHOT_HEADER_BYTES + 2 || buffer[0] != GAME_SNAPSHOT_VERSION ||
+			buffer[1] != FIELD_WIDTH || buffer[2] != FIELD_HEIGHT ||
+			buffer[3] < 1 || buffer[3] > GAME_MAX_PLAYERS) {
+		return 0;
+	}
+	numAsteroids = buffer[GAME_SNAPSHOT_HEADER_BYTES - 2];
+	numProjectiles = buffer[GAME_SNAPSHOT_HEADER_BYTES - 1];
+	snapshotLength = GAME_SNAPSHOT_HEADER_BYTES +
+			(numAsteroids + numProjectiles) * GAME_SNAPSHOT_ENTITY_BYTES;
+	if(numAsteroids > MAX_ASTEROIDS || numProjectiles > MAX_PROJECTILES ||
+			length < snapshotLength + 2 ||
+			get16(buffer + snapshotLength) != snapshot_crc(buffer, snapshotLength)) {
+		return 0;
+	}
+	
+	gameState->numPlayers = buffer[3];
+	for(i = 0; i < gameState->numPlayers; i++) {
+		gameState->basePosition[i] = (int8_t)buffer[4 + i];
+	}
+	p = buffer + 4 + GAME_MAX_PLAYERS;
+	gameState->over = (int8_t)p[0];
+	set_lives_count(p[1]);
+	set_score(get32(p + 2));
+	gameState->random = get32(p + 6);
+	timers->projectilePeriod = get16(p + 10);
+	timers->asteroidPeriod = get16(p + 12);
+	timers->projectileOwed = get16(p + 14);
+	timers->asteroidOwed = get16(p + 16);
+	
+	entity_clear();
+	p = buffer + GAME_SNAPSHOT_HEADER_BYTES;
+	for(type = 0; type < ENTITY_TYPES; type++) {
+		count = type == ENTITY_ASTEROID ? numAsteroids : numProjectiles;
+		for(i = 0; i < count; i++, p += GAME_SNAPSHOT_ENTITY_BYTES) {
+			slot = entity_add(type, p[0], get16(p + 2), ASTEROID_SPEED_MIN + p[4]);
+			entitySize[slot] = p[1];
+		}
+	}
+	index_entities(ENTITY_ASTEROID);
+	index_entities(ENTITY_PROJECTILE);
+	// The plans depend only on where everything is, so are made again
+	plan_columns(FIELD_ROW_MASK);
+	numPendingHits = 0;
+	numWaitingHits = 0;
+	numExplosions = 0;
+	lifeLostPending = 0;
+	lifeLostShown = 0;
+	
+	if(!quiet) {
+		redraw_whole_display();
+	}
+	return 1;
+}
+
+void game_start_timers(GameTimers* timers) {
+	timers->projectilePeriod = GAME_PROJECTILE_PERIOD;
+	timers->asteroidPeriod = GAME_ASTEROID_PERIOD;
+	timers->projectileOwed = 0;
+	timers->asteroidOwed = 0;
+}
+
+void game_run_steps(GameTimers* timers, uint16_t ms, GameSteps* steps) {
+	uint32_t score, owed;
+	uint8_t step, run = 0, late = 0, dropped = 0;
+
+	if(steps) {
+		frame_stage_begin(FRAME_STAGE_PROJECTILES);
+	}
+	owed = (uint32_t)timers->projectileOwed + ms;
+	for(step = 0; !is_game_over() && owed >= timers->projectilePeriod; step++) {
+		if(step == GAME_MAX_CATCHUP_STEPS) {
+			dropped += owed / timers->projectilePeriod;
+			owed %= timers->projectilePeriod;
+			break;
+		}
+		advance_projectiles();
+		owed -= timers->projectilePeriod;
+		score = get_score();
+		if(score >= 10) {
+			timers->projectilePeriod = score < GAME_PROJECTILE_PERIOD - GAME_MIN_STEP_PERIOD ?
+					GAME_PROJECTILE_PERIOD - score : GAME_MIN_STEP_PERIOD;
+		}
+	}
+	// (Only more than a period if the game is over)
+	timers->projectileOwed = owed < UINT16_MAX ? owed : UINT16_MAX;
+	run += step;
+	if(step > 1) {
+		late += step - 1;
+	}
+
+	if(steps) {
+		frame_stage_begin(FRAME_STAGE_ASTEROIDS);
+	}
+	owed = (uint32_t)timers->asteroidOwed + ms;
+	for(step = 0; !is_game_over() && owed >= timers->asteroidPeriod; step++) {
+		if(step == GAME_MAX_CATCHUP_STEPS) {
+			dropped += owed / timers->asteroidPeriod;
+			owed %= timers->asteroidPeriod;
+			break;
+		}
+		advance_asteroids();
+		owed -= timers->asteroidPeriod;
+		score = get_score();
+		if(score >= 10) {
+			timers->asteroidPeriod = score < (GAME_ASTEROID_PERIOD - GAME_MIN_STEP_PERIOD) / 2 ?
+					GAME_ASTEROID_PERIOD - 2 * score : GAME_MIN_STEP_PERIOD;
+		}
+	}
+	timers->asteroidOwed = owed < UINT16_MAX ? owed : UINT16_MAX;
+	run += step;
+	if(step > 1) {
+		late += step - 1;
+	}
+
+	if(steps) {
+		steps->run = run;
+		steps->late = late;
+		steps->dropped = dropped;
+	}
+}
+
+void game_task(void) {
+	flashState = flash_task(&flash);
+	explosionState = explosion_task(&explosion);
+}
+
+uint8_t game_task_active(void) {
+	return flashState == CORO_SLEEPING || explosionState == CORO_SLEEPING;
+}
+
+uint32_t game_next_time(void) {
+	if(flashState != CORO_SLEEPING) {
+		return explosion.deadline;
+	}
+	if(explosionState == CORO_SLEEPING &&
+			(int32_t)(explosion.deadline - flash.deadline) < 0) {
+		return explosion.deadline;
+	}
+	return flash.deadline;
 }
 
 // Returns 1 if the game is over, 0 otherwise. Initially, the game is
 // never over.
 int8_t is_game_over(void) {
-	return terminate;
+	return gameState->over;
 }
 
 //A method which changes the state of the ga
 void game_over(int8_t num){
-	terminate = num;
+	gameState->over = num;
 }
 
 
 /******** INTERNAL FUNCTIONS ****************/
 
-// Check whether there is an asteroid at a given position.
-// Returns -1 if there is no asteroid, otherwise we return
-// the asteroid number (from 0 to numAsteroids-1).
-static int8_t asteroid_at(uint8_t x, uint8_t y){
-	uint8_t i;
-	uint8_t positionToCheck = GAME_POSITION(x,y);
-	for(i=0; i < numAsteroids; i++) {
-		if(asteroids[i] == positionToCheck) {
-			// Asteroid i is at the given position
-			return i;
+// Check whether there is a projectile at a given position.
+// Returns NO_ENTITY if there is no projectile, otherwise we return
+// the projectile's slot.
+static uint8_t projectile_at(uint8_t x, uint8_t y){
+	if(!(gameState->boards[ENTITY_PROJECTILE][y] & FIELD_COLUMN_BIT(x))) {
+		// No projectile at the given position
+		return NO_ENTITY;
+	}
+	return find_entity(ENTITY_PROJECTILE, x, y, y, 0);
+}
+
+static int8_t base_at(uint8_t x, uint8_t y) {
+	for(uint8_t player = 0; player < gameState->numPlayers; player++) {
+		if(sprite_covers(&spriteBaseHitZone, gameState->basePosition[player], 1, x, y)) {
+			return player;
 		}
 	}
-	// No match was found - no asteroid at the given position
 	return -1;
 }
 
-// Check whether there is a projectile at a given position.
-// Returns -1 if there is no projectile, otherwise we return
-// the projectile number (from 0 to numProjectiles-1).
-static int8_t projectile_at(uint8_t x, uint8_t y){
-	uint8_t i;
-	uint8_t positionToCheck = GAME_POSITION(x,y);
-	for(i=0; i < numProjectiles; i++) {
-		if(projectiles[i] == positionToCheck) {
-			// Projectile i is at the given position
-			return i;
+static uint8_t find_entity(uint8_t type, uint8_t x, uint8_t fromY, uint8_t toY,
+		uint8_t* foundY) {
+	uint8_t found = NO_ENTITY;
+	uint8_t y, slot;
+	for(y = fromY; y <= toY; y++) {
+		if(gameState->boards[type][y] & FIELD_COLUMN_BIT(x)) {
+			for(slot = ENTITY_FIRST(type); slot < ENTITY_END(type); slot++) {
+				if(entity_covers(slot, x, y)) {
+					found = slot;
+					break;
+				}
+			}
+			break;
 		}
 	}
-	// No match was found - no projectile at the given position 
-	return -1;
+#ifndef NDEBUG
+	// Check the board against the table
+	for(slot = ENTITY_FIRST(type); slot < ENTITY_END(type); slot++) {
+		for(uint8_t row = fromY; row < y; row++) {
+			if(entity_covers(slot, x, row)) {
+				collisions.errors++;
+			}
+		}
+	}
+	if(y <= toY && found == NO_ENTITY) {
+		collisions.errors++;
+	}
+#endif
+	if(foundY) {
+		*foundY = y;
+	}
+	return found;
 }
 
-/* Remove asteroid with the given index number (from 0 to
-** numAsteroids - 1).
-*/
-static void remove_asteroid(int8_t asteroidNumber) {
-	if(asteroidNumber < 0 || asteroidNumber >= numAsteroids) {
-		// Invalid index - do nothing
-		return;
+#ifndef NDEBUG
+static uint8_t sweep_asteroid(uint8_t slot, uint8_t fromY, uint8_t toY,
+		uint8_t* hitY) {
+	uint8_t x = entityX[slot];
+	uint8_t size = entitySize[slot];
+	const Sprite* shape = &spriteAsteroid[size - 1];
+	uint8_t found = NO_ENTITY;
+	uint8_t y, r, hitX;
+	FieldRowMask hits;
+
+	*hitY = 0;
+	// Try the asteroid in each row its bottom row passed through,
+	// highest first (where it was), until it overlaps a projectile. The
+	// projectile met first is the highest one it overlaps there - below
+	// where it was, the shapes have no gaps so that can only be one in
+	// its bottom row.
+	for(y = fromY + 1; y-- > toY; ) {
+		if(!sprite_collides(shape, x, y, gameState->boards[ENTITY_PROJECTILE])) {
+			continue;
+		}
+		for(r = size; r-- > 0; ) {
+			hits = gameState->boards[ENTITY_PROJECTILE][y + r] & shape_row(size, x, r);
+			if(hits) {
+				for(hitX = 0; !(hits & FIELD_COLUMN_BIT(hitX)); hitX++) {
+					;
+				}
+				found = find_entity(ENTITY_PROJECTILE, hitX, y + r, y + r, 0);
+				*hitY = y + r;
+				break;
+			}
+		}
+		break;
 	}
-	
-	// Remove the asteroid from the display
-	redraw_asteroid(asteroidNumber, COLOUR_BLACK);
-	
-	if(asteroidNumber < numAsteroids - 1) {
-		// Asteroid is not the last one in the list
-		// - move the last one in the list to this position
-		asteroids[asteroidNumber] = asteroids[numAsteroids - 1];
+
+	// Check against the table - no projectile should be in the swept
+	// positions above the one found
+	for(uint8_t p = ENTITY_FIRST(ENTITY_PROJECTILE); p < ENTITY_END(ENTITY_PROJECTILE); p++) {
+		uint8_t py = CELL(entityY[p]);
+		if(found != NO_ENTITY && py <= *hitY) {
+			continue;
+		}
+		for(r = 0; r < size; r++) {
+			if(py >= toY + r && py <= fromY + r &&
+					(shape_row(size, x, r) & FIELD_COLUMN_BIT(entityX[p]))) {
+				collisions.errors++;
+				break;
+			}
+		}
 	}
-	// Last position in asteroids array is no longer used
-	numAsteroids--;
+	return found;
 }
+#endif
+
+// The asteroids covering a column are only looked for once, for all of
+// the projectiles in it
+static void plan_columns(FieldRowMask columns) {
+	uint8_t asteroids[MAX_ASTEROIDS];
+	uint8_t x, slot, count;
 
-// Remove projectile with the given projectile number (from 0 to
-// numProjectiles - 1).
-static void remove_projectile(int8_t projectileNumber) {	
-	if(projectileNumber < 0 || projectileNumber >= numProjectiles) {
-		// Invalid index - do nothing 
+	for(x = 0; x < FIELD_WIDTH; x++) {
+		if(!(columns & FIELD_COLUMN_BIT(x))) {
+			continue;
+		}
+		count = NO_ENTITY;
+		for(slot = ENTITY_FIRST(ENTITY_PROJECTILE); slot < ENTITY_END(ENTITY_PROJECTILE);
+				slot++) {
+			if(entityX[slot] == x) {
+				if(count == NO_ENTITY) {
+					count = column_asteroids(x, asteroids);
+				}
+				plan_impact(slot, asteroids, count);
+			}
+		}
+	}
+}
+
+// Asteroid shapes are solid squares
+static uint8_t column_asteroids(uint8_t x, uint8_t* asteroids) {
+	uint8_t count = 0;
+	for(uint8_t a = ENTITY_FIRST(ENTITY_ASTEROID); a < ENTITY_END(ENTITY_ASTEROID); a++) {
+		collisions.tests++;
+		if((uint8_t)(x - entityX[a]) < entitySize[a]) {
+			asteroids[count++] = a;
+		}
+	}
+	return count;
+}
+
+// An asteroid's lowest position in any of its columns is its bottom
+// row (the shapes are solid squares). The target is the asteroid which
+// gets down to the projectile first, of those not wholly below it (see
+// asteroidsFalling).
+static void plan_impact(uint8_t slot, const uint8_t* asteroids, uint8_t count) {
+	uint8_t y = CELL(entityY[slot]);
+	uint8_t index = PROJECTILE_INDEX(slot);
+	uint8_t target = NO_ENTITY;
+	uint8_t i, a, steps;
+
+	for(i = 0; i < count; i++) {
+		a = asteroids[i];
+		collisions.tests++;
+		if(asteroid_above(a, y) &&
+				(target == NO_ENTITY || asteroid_before(a, entityY[a], target, entityY[target]))) {
+			target = a;
+		}
+	}
+	gameState->impactReplan[index] = 0;
+	if(target == NO_ENTITY) {
+		gameState->impactTarget[index] = NO_ENTITY;
 		return;
 	}
-	
-	// Remove the projectile from the display
-	redraw_projectile(projectileNumber, COLOUR_BLACK);
-	
-	// Close up the gap in the list of projectiles - move any
-	// projectiles after this in the list closer to the start of the list
-	for(uint8_t i = projectileNumber+1; i < numProjectiles; i++) {
-		projectiles[i-1] = projectiles[i];
+	gameState->impactTarget[index] = entity_handle(target);
+
+	// Plan again when the first of the others overtakes it
+	for(i = 0; i < count; i++) {
+		a = asteroids[i];
+		if(a != target && asteroid_above(a, y)) {
+			steps = steps_to_overtake(target, a, y);
+			if(steps && (!gameState->impactReplan[index] ||
+					steps < gameState->impactReplan[index])) {
+				gameState->impactReplan[index] = steps;
+			}
+		}
 	}
-	// Update projectile count - have one fewer projectiles now.
-	numProjectiles--;
 }
 
-// Redraw the whole display - base, asteroids and projectiles.
-// We assume all of the data structures have been appropriately poplulated
-static void redraw_whole_display(void) {
-	// clear the display
-	ledmatrix_clear();
-	
-	// Redraw each of the elements
-	redraw_base(COLOUR_BASE);
-	redraw_all_asteroids();	
-	redraw_all_projectiles();
+static uint8_t asteroid_above(uint8_t a, uint8_t y) {
+	uint16_t fromY = entityY[a] + (asteroidsFalling ? entitySpeed[a] : 0);
+	return CELL(fromY) + entitySize[a] > y;
 }
 
-static void redraw_base(uint8_t colour){
-	// Add the bottom row of the base first (0) followed by the single bit
-	// in the next row (1)
-	for(int8_t x = basePosition - 1; x <= basePosition+1; x++) {
-		if (x >= 0 && x < FIELD_WIDTH) {
-			ledmatrix_update_pixel(LED_MATRIX_POSN_FROM_XY(x, 0), colour);
-		}
+static uint8_t asteroid_before(uint8_t a, uint16_t aY, uint8_t b, uint16_t bY) {
+	if(aY != bY) {
+		return aY < bY;
+	}
+	if(entitySpeed[a] != entitySpeed[b]) {
+		return entitySpeed[a] > entitySpeed[b];
+	}
+	if(entityX[a] != entityX[b]) {
+		return entityX[a] < entityX[b];
 	}
-	ledmatrix_update_pixel(LED_MATRIX_POSN_FROM_XY(basePosition, 1), colour);
+	if(entitySize[a] != entitySize[b]) {
+		return entitySize[a] < entitySize[b];
+	}
+	return a < b;
 }
 
-static void redraw_all_asteroids(void) {
-	// For each asteroid, determine it's position and redraw it
-	for(uint8_t i=0; i < numAsteroids; i++) {
-		redraw_asteroid(i, COLOUR_ASTEROID);
+// After n steps the other asteroid is (otherY - targetY) - n * (the
+// difference in their speeds) above the target, so it can only overtake
+// a slower target. (It gets to the bottom row after the target reaches
+// the projectile, so neither stops falling before then.)
+static uint8_t steps_to_overtake(uint8_t target, uint8_t other, uint8_t y) {
+	uint16_t targetY = entityY[target];
+	uint16_t otherY = entityY[other];
+	uint16_t steps, arrives;
+
+	collisions.tests++;
+	if(entitySpeed[other] <= entitySpeed[target] || otherY <= targetY ||
+			targetY < FIXED(y + 1)) {
+		return 0;
 	}
+	// Rounded up, as at the same row the faster one comes first
+	steps = (otherY - targetY + entitySpeed[other] - entitySpeed[target] - 1) /
+			(entitySpeed[other] - entitySpeed[target]);
+	// The step the target's bottom row reaches row y
+	arrives = (targetY - FIXED(y + 1)) / entitySpeed[target] + 1;
+	return steps <= arrives ? (uint8_t)steps : 0;
+}
+
+static void remove_projectile(uint8_t slot) {
+	uint8_t last = PROJECTILE_INDEX(ENTITY_END(ENTITY_PROJECTILE) - 1);
+	gameState->impactTarget[PROJECTILE_INDEX(slot)] = gameState->impactTarget[last];
+	gameState->impactReplan[PROJECTILE_INDEX(slot)] = gameState->impactReplan[last];
+	entity_remove(slot);
 }
 
-static void redraw_asteroid(uint8_t asteroidNumber, uint8_t colour) {
-	uint8_t asteroidPosn;
-	if(asteroidNumber < numAsteroids) {
-		asteroidPosn = asteroids[asteroidNumber];
-		ledmatrix_update_pixel(LED_MATRIX_POSN_FROM_GAME_POSN(asteroidPosn), colour);
+static FieldRowMask base_reached(uint8_t x, uint8_t size) {
+	for(uint8_t column = x; column < x + size; column++) {
+		if(base_at(column, 1) >= 0) {
+			return FIELD_COLUMN_BIT(column);
+		}
 	}
+	return 0;
+}
+
+// An asteroid of size s with its bottom left corner at (x,y) covers the
+// positions in row y+r given by row r of spriteAsteroid[s-1] shifted
+// left by x (bit 0 is column x). Projectiles are size 1.
+static FieldRowMask shape_row(uint8_t size, uint8_t x, uint8_t row) {
+	return ((FieldRowMask)pgm_read_byte(&spriteAsteroid[size-1].rows[row]) << x) &
+			FIELD_ROW_MASK;
 }
 
-static void redraw_all_projectiles(void){
-	// For each projectile, determine its position and redraw it
-	for(uint8_t i = 0; i < numProjectiles; i++) {
-		redraw_projectile(i, COLOUR_PROJECTILE);
+static FieldRowMask shape_columns(uint8_t size, uint8_t x) {
+	FieldRowMask columns = 0;
+	for(uint8_t row = 0; row < size; row++) {
+		columns |= shape_row(size, x, row);
 	}
+	return columns;
 }
 
-static void redraw_projectile(uint8_t projectileNumber, uint8_t colour) {
-	uint8_t projectilePosn;
-	
-	// Check projectileNumber is valid - ignore otherwise
-	if(projectileNumber < numProjectiles) {
-		projectilePosn = projectiles[projectileNumber];
-		ledmatrix_update_pixel(LED_MATRIX_POSN_FROM_GAME_POSN(projectilePosn), colour);
+static uint8_t entity_covers(uint8_t slot, uint8_t x, uint8_t y) {
+	uint8_t bottom = CELL(entityY[slot]);
+	if(y < bottom || y >= bottom + entitySize[slot]) {
+		return 0;
 	}
+	return (shape_row(entitySize[slot], entityX[slot], y - bottom) &
+			FIELD_COLUMN_BIT(x)) != 0;
 }
 
-void check_lives(uint8_t x, uint8_t y){
-	if((x  == basePosition  &&  y == 1 ) || (basePosition -1 == x && y == 1) || (basePosition + 1 == x && y == 1) ) {
-		for(int8_t x = basePosition - 1; x <= basePosition+1; x++) {
-			if (x >= 0 && x < FIELD_WIDTH) {
-				_delay_ms(150);
-				ledmatrix_update_pixel(LED_MATRIX_POSN_FROM_XY(x, 1), COLOUR_RED);
+static void index_entities(uint8_t type) {
+	uint8_t i, row, y;
+	for(i = 0; i < FIELD_HEIGHT; i++) {
+		gameState->boards[type][i] = 0;
+	}
+	for(i = ENTITY_FIRST(type); i < ENTITY_END(type); i++) {
+		for(row = 0; row < entitySize[i]; row++) {
+			y = CELL(entityY[i]) + row;
+			if(y < FIELD_HEIGHT) {
+				gameState->boards[type][y] |= shape_row(entitySize[i], entityX[i], row);
 			}
 		}
-		ledmatrix_update_pixel(LED_MATRIX_POSN_FROM_XY(basePosition, 2), COLOUR_RED);
-		
-		for(int8_t x = basePosition - 1; x <= basePosition+1; x++) {
-			if (x >= 0 && x < FIELD_WIDTH) {
-				_delay_ms(150);
-				ledmatrix_update_pixel(LED_MATRIX_POSN_FROM_XY(x, 1), COLOUR_BLACK);
+	}
+}
+
+static FieldRowMask add_asteroid(uint8_t x, uint16_t y, uint8_t size, uint16_t speed) {
+	uint8_t slot = entity_add(ENTITY_ASTEROID, x, y, speed);
+	if(slot == NO_ENTITY) {
+		return 0;
+	}
+	entitySize[slot] = size;
+	for(uint8_t row = 0; row < size && CELL(y) + row < FIELD_HEIGHT; row++) {
+		gameState->boards[ENTITY_ASTEROID][CELL(y) + row] |= shape_row(size, x, row);
+	}
+	return shape_columns(size, x);
+}
+
+static FieldRowMask add_asteroid_at_top(void) {
+	uint8_t size = random_asteroid_size();
+	uint8_t x = random_top_column(0, size);
+	return add_asteroid(x, FIXED(FIELD_HEIGHT - size) + FIXED_HALF, size,
+			random_asteroid_speed());
+}
+
+static uint8_t asteroid_fits(uint8_t x, uint8_t y, uint8_t size) {
+	const Sprite* shape = &spriteAsteroid[size - 1];
+	if(x + size > FIELD_WIDTH || y + size > FIELD_HEIGHT) {
+		return 0;
+	}
+	return !sprite_collides(shape, x, y, gameState->boards[ENTITY_ASTEROID]) &&
+			!sprite_collides(shape, x, y, gameState->boards[ENTITY_PROJECTILE]);
+}
+
+// Most asteroids are single cells - about 1 in 4 is larger
+static uint8_t random_asteroid_size(void) {
+	uint8_t r = (uint8_t)(game_random() % 16);
+	if(r < 12) {
+		return 1;
+	}
+	return r < 15 ? 2 : 3;
+}
+
+// Random number generator (xorshift32). We use our own rather than
+// random() so that its state can be saved in snapshots.
+static uint32_t game_random(void) {
+	uint32_t x = gameState->random;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	gameState->random = x;
+	return x;
+}
+
+static uint16_t random_asteroid_speed(void) {
+	return ASTEROID_SPEED_MIN + (uint16_t)(game_random() % ASTEROID_SPEED_RANGE);
+}
+
+// Columns where the asteroid would fit and would not cover any of the
+// avoid columns are tried first, then columns where it would fit, then
+// any column.
+static uint8_t random_top_column(FieldRowMask avoid, uint8_t size) {
+	uint8_t x;
+	uint8_t numColumns = FIELD_WIDTH - size + 1;
+	FieldRowMask fits = 0, apart = 0, freeColumns;
+	for(x = 0; x < numColumns; x++) {
+		if(asteroid_fits(x, FIELD_HEIGHT - size, size)) {
+			fits |= FIELD_COLUMN_BIT(x);
+			if(!(shape_columns(size, x) & avoid)) {
+				apart |= FIELD_COLUMN_BIT(x);
 			}
 		}
-		ledmatrix_update_pixel(LED_MATRIX_POSN_FROM_XY(basePosition, 2), COLOUR_BLACK);
-		redraw_base(COLOUR_BASE);
-		set_lives();
-		
 	}
+	freeColumns = apart;
+	if(!freeColumns) {
+		freeColumns = fits;
+	}
+	if(!freeColumns) {
+		freeColumns = FIELD_ROW_MASK;
+	}
+	do {
+		// Generate random x position - somewhere from 0
+		// to FIELD_WIDTH - size
+		x = (uint8_t)(game_random() % numColumns);
+	} while(!(freeColumns & FIELD_COLUMN_BIT(x)));
+	return x;
 }
 
-void game_animation(uint8_t p, uint8_t y){
-	for(int8_t x = p - 1; x <= p+1; x++) {
-		if (x >= 0 && x < FIELD_WIDTH) {
-			_delay_ms(150);
-			ledmatrix_update_pixel(LED_MATRIX_POSN_FROM_XY(x, y+1), COLOUR_ORANGE);
+// Remove the projectile and the asteroid it has hit. A large asteroid
+// splits about the column it was hit in - the part either side of that
+// column carries on falling at the same speed, as an asteroid as wide
+// as the part (level with the bottom of the one hit). The cell hit is
+// left empty. When a single cell asteroid is destroyed a new one is
+// added at the top, unless there are already NUM_ASTEROIDS asteroids.
+// The score goes up by the size of the asteroid hit. The explosion is
+// shown by show_hits().
+static void projectile_hit_asteroid(uint8_t projectileSlot, uint8_t asteroidSlot,
+		uint8_t hitY) {
+	uint8_t x = entityX[asteroidSlot];
+	uint16_t y = entityY[asteroidSlot];
+	uint8_t size = entitySize[asteroidSlot];
+	uint16_t speed = entitySpeed[asteroidSlot];
+	uint8_t hitX = entityX[projectileSlot];
+	// Projectiles heading for the asteroid, or for one it was in front
+	// of, and those in the columns asteroids are added to, need new
+	// targets (the pieces of a large asteroid are in its columns)
+	FieldRowMask replan = shape_columns(size, x);
+	if(numPendingHits < MAX_PROJECTILES) {
+		pendingHits[numPendingHits++] = GAME_POSITION(hitX, hitY);
+	}
+	entity_remove(asteroidSlot);
+	remove_projectile(projectileSlot);
+	index_entities(ENTITY_PROJECTILE);
+	if(hitX > x) {
+		add_asteroid(x, y, hitX - x, speed);
+	}
+	if(hitX < x + size - 1) {
+		add_asteroid(hitX + 1, y, x + size - 1 - hitX, speed);
+	}
+	index_entities(ENTITY_ASTEROID);
+	add_to_score(size);
+	if(size == 1 && entity_count(ENTITY_ASTEROID) < NUM_ASTEROIDS) {
+		replan |= add_asteroid_at_top();
+	}
+	plan_columns(replan);
+}
+
+// Pass the hits found during a step on to explosion_task(), which
+// shows them while the game carries on
+static void show_hits(void) {
+	if(quiet) {
+		numPendingHits = 0;
+		return;
+	}
+	if(numPendingHits) {
+		audio_play(AUDIO_SOUND_HIT);
+	}
+	for(uint8_t i = 0; i < numPendingHits; i++) {
+		if(numWaitingHits < MAX_PROJECTILES) {
+			waitingHits[numWaitingHits++] = pendingHits[i];
 		}
 	}
-	ledmatrix_update_pixel(LED_MATRIX_POSN_FROM_XY(p, y+2), COLOUR_ORANGE);
+	numPendingHits = 0;
+}
+
+// Set the palette index of game position (x,y) in gameFrame. Positions
+// off the game field are ignored.
+static void draw_cell(int8_t x, int8_t y, uint8_t paletteIndex) {
+	if(x < 0 || x >= FIELD_WIDTH || y < 0 || y >= FIELD_HEIGHT) {
+		return;
+	}
+	frame_set_pixel(gameFrame, LED_MATRIX_POSN_FROM_XY(x, y), paletteIndex);
+}
+
+// Send the changes made to gameFrame since the last flush to the LED
+// matrix, using the fewest SPI bytes
+static void flush_display(void) {
+	if(quiet) {
+		return;
+	}
+	display_encoder_flush(shownFrame, gameFrame, gamePalette);
+}
+
+// Clear the LED matrix and both frames
+static void clear_display(void) {
+	frame_fill(gameFrame, PALETTE_BLACK);
+	frame_fill(shownFrame, PALETTE_BLACK);
+	ledmatrix_clear();
+}
+
+// Draw the whole field into gameFrame - bases, asteroids and projectiles.
+// We assume all of the data structures have been appropriately poplulated.
+static void render_field(void) {
+	uint8_t i;
+	
+	if(quiet) {
+		// Drawn when quiet is turned off
+		return;
+	}
+	frame_fill(gameFrame, PALETTE_BLACK);
 	
-	for(int8_t x = p - 1; x <= p+1; x++) {
-		if (x >= 0 && x < FIELD_WIDTH) {
-			_delay_ms(150);
-			ledmatrix_update_pixel(LED_MATRIX_POSN_FROM_XY(x, y+1), COLOUR_BLACK);
+	// Draw each of the elements
+	for(i = 0; i < gameState->numPlayers; i++) {
+		sprite_blit(gameFrame, &spriteBase, gameState->basePosition[i], 0, PALETTE_BASE);
+	}
+	for(i = 0; i < FIELD_HEIGHT; i++) {
+		sprite_blit_row(gameFrame, i, gameState->boards[ENTITY_ASTEROID][i],
+				PALETTE_ASTEROID);
+		sprite_blit_row(gameFrame, i, gameState->boards[ENTITY_PROJECTILE][i],
+				PALETTE_PROJECTILE);
+	}
+	for(i = 0; i < gameState->numPlayers; i++) {
+		if(lifeLostShown & (1 << i)) {
+			sprite_blit(gameFrame, &spriteLifeLost, gameState->basePosition[i], 1,
+					PALETTE_LIFE_LOST);
 		}
 	}
-	ledmatrix_update_pixel(LED_MATRIX_POSN_FROM_XY(p, y+2), COLOUR_BLACK);
+	for(i = 0; i < numExplosions; i++) {
+		for(uint8_t frame = explosionFirst; frame <= explosionLast; frame++) {
+			sprite_blit(gameFrame, &spriteExplosion[frame], GET_X_POSITION(explosions[i]),
+					GET_Y_POSITION(explosions[i]) + 1, PALETTE_EXPLOSION);
+		}
+	}
+#ifdef GAME_HUD_ROW
+	scrolling_display_draw_hud(gameFrame, GAME_HUD_ROW, PALETTE_HUD, PALETTE_BLACK);
+#endif
+}
+
+void redraw_hud(void) {
+#ifdef GAME_HUD_ROW
+	scrolling_display_draw_hud(gameFrame, GAME_HUD_ROW, PALETTE_HUD, PALETTE_BLACK);
+	flush_display();
+#endif
 }
 
+// Redraw the whole display. The field is drawn into gameFrame and then
+// the whole frame is sent in one go.
+static void redraw_whole_display(void) {
+	render_field();
+	ledmatrix_update_all_packed(gameFrame, gamePalette);
+	frame_copy(gameFrame, shownFrame);
+}
 
-void game_visual(void) {
-	int8_t x = 0;
-	ledmatrix_clear();
-	for(int8_t x = 0; x <= 7; x++) {
-		if (x >= 0 && x < FIELD_WIDTH) {
-			_delay_ms(150);
-			ledmatrix_update_pixel(LED_MATRIX_POSN_FROM_XY(x, (FIELD_HEIGHT-1)-x), COLOUR_ORANGE);
+static void redraw_base(uint8_t player, uint8_t paletteIndex){
+	sprite_blit(gameFrame, &spriteBase, gameState->basePosition[player], 0, paletteIndex);
+}
+
+void check_lives(uint8_t x, uint8_t y){
+	int8_t player = base_at(x, y);
+	// (With two bases, the last life may already have gone this step)
+	if(player >= 0 && !is_game_over()) {
+		if(!quiet) {
+			audio_play(AUDIO_SOUND_LIFE_LOST);
+			// Flash the life lost sprite above the base
+			lifeLostPending |= 1 << player;
 		}
+		set_lives();
+		
 	}
-	
-	ledmatrix_update_pixel(LED_MATRIX_POSN_FROM_XY(x, FIELD_HEIGHT-5), COLOUR_ORANGE);
-	for(int8_t x = FIELD_WIDTH-1; x >=0 ; x--) {
-		if (x >= 0 && x < FIELD_WIDTH) {
-			_delay_ms(150);
-			ledmatrix_update_pixel(LED_MATRIX_POSN_FROM_XY(x, x+5), COLOUR_YELLOW);
+}
+
+// Show the life lost sprite of each player who has lost a life for
+// LIFE_LOST_FLASH_MS, then leave a gap of the same length before the
+// next flash
+static uint8_t flash_task(Coroutine* c) {
+	CORO_BEGIN(c);
+	while(1) {
+		CORO_WAIT_UNTIL(c, lifeLostPending);
+		lifeLostShown = lifeLostPending;
+		lifeLostPending = 0;
+		render_field();
+		flush_display();
+		CORO_SLEEP_MS(c, LIFE_LOST_FLASH_MS);
+		lifeLostShown = 0;
+		render_field();
+		flush_display();
+		CORO_SLEEP_MS(c, LIFE_LOST_FLASH_MS);
+	}
+	CORO_END(c);
+}
+
+// Show the explosions of the waiting hits (see show_hits()), drawn by
+// render_field(). Each frame of the explosion adds to the ones before,
+// then they are taken away in the same order, EXPLOSION_STEP_MS apart.
+// The display encoder sends only the pixels which changed.
+static uint8_t explosion_task(Coroutine* c) {
+	CORO_BEGIN(c);
+	while(1) {
+		CORO_WAIT_UNTIL(c, numWaitingHits);
+		for(numExplosions = 0; numExplosions < numWaitingHits; numExplosions++) {
+			explosions[numExplosions] = waitingHits[numExplosions];
+		}
+		numWaitingHits = 0;
+		explosionFirst = 0;
+		for(explosionLast = 0; explosionLast < EXPLOSION_FRAMES - 1; explosionLast++) {
+			render_field();
+			flush_display();
+			CORO_SLEEP_MS(c, EXPLOSION_STEP_MS);
 		}
+		for(explosionFirst = 0; explosionFirst < EXPLOSION_FRAMES; explosionFirst++) {
+			render_field();
+			flush_display();
+			CORO_SLEEP_MS(c, EXPLOSION_STEP_MS);
+		}
+		numExplosions = 0;
+		render_field();
+		flush_display();
+	}
+	CORO_END(c);
+}
+
+
+uint8_t game_visual_task(Coroutine* c) {
+	// Kept while the coroutine is stopped
+	static int8_t x;
+
+	CORO_BEGIN(c);
+	clear_display();
+	for(x = 0; x < FIELD_WIDTH; x++) {
+		flush_display();
+		CORO_SLEEP_MS(c, VISUAL_STEP_MS);
+		draw_cell(x, (FIELD_HEIGHT-1)-x, PALETTE_EXPLOSION);
 	}
 	
-	ledmatrix_update_pixel(LED_MATRIX_POSN_FROM_XY(x, 0+x), COLOUR_YELLOW);
-	for(int8_t x = 0; x <= 15; x++) {
-	
-		if (x >= 0 && x < FIELD_WIDTH) {
-			_delay_ms(150);
-			ledmatrix_update_pixel(LED_MATRIX_POSN_FROM_XY(x, (FIELD_HEIGHT-1)-x), COLOUR_ORANGE);
-		}
+	draw_cell(0, FIELD_HEIGHT-5, PALETTE_EXPLOSION);
+	for(x = FIELD_WIDTH-1; x >= 0; x--) {
+		flush_display();
+		CORO_SLEEP_MS(c, VISUAL_STEP_MS);
+		draw_cell(x, x+5, PALETTE_VISUAL);
 	}
 	
-	ledmatrix_update_pixel(LED_MATRIX_POSN_FROM_XY(x, FIELD_HEIGHT-5), COLOUR_ORANGE);
-	for(int8_t x = FIELD_WIDTH-1; x >=0 ; x--) {
-		if (x >= 0 && x < FIELD_WIDTH) {
-			_delay_ms(150);
-			ledmatrix_update_pixel(LED_MATRIX_POSN_FROM_XY(x, x+2), COLOUR_YELLOW);
-		}
+	draw_cell(0, 0, PALETTE_VISUAL);
+	for(x = 0; x < FIELD_WIDTH; x++) {
+		flush_display();
+		CORO_SLEEP_MS(c, VISUAL_STEP_MS);
+		draw_cell(x, (FIELD_HEIGHT-1)-x, PALETTE_EXPLOSION);
 	}
-	ledmatrix_update_pixel(LED_MATRIX_POSN_FROM_XY(x, 14), COLOUR_YELLOW);
 	
+	draw_cell(0, FIELD_HEIGHT-5, PALETTE_EXPLOSION);
+	for(x = FIELD_WIDTH-1; x >= 0; x--) {
+		flush_display();
+		CORO_SLEEP_MS(c, VISUAL_STEP_MS);
+		draw_cell(x, x+2, PALETTE_VISUAL);
+	}
+	draw_cell(0, FIELD_HEIGHT-2, PALETTE_VISUAL);
+	flush_display();
+	CORO_END(c);
 }
 
@@ -10,28 +10,86 @@
 #define GAME_H_
 
 #include <inttypes.h>
+#include "ledmatrix.h"
+#include "coroutine.h"
+
+// The game field is FIELD_HEIGHT rows in size by FIELD_WIDTH columns,
+// i.e. x (column number) ranges from 0 to FIELD_WIDTH-1 (left to right)
+// and y (row number) ranges from 0 to FIELD_HEIGHT-1 (bottom to top).
+// Rows of the field are columns of the LED matrix display, so by
+// default the field is 16 rows by 8 columns on one panel, or e.g.
+// 32 by 16 on four panels (see LEDMATRIX_PANELS_X/Y in ledmatrix.h).
+#ifndef FIELD_HEIGHT
+#define FIELD_HEIGHT MATRIX_NUM_COLUMNS
+#endif
+#ifndef FIELD_WIDTH
+#define FIELD_WIDTH MATRIX_NUM_ROWS
+#endif
+#if FIELD_HEIGHT > MATRIX_NUM_COLUMNS || FIELD_WIDTH > MATRIX_NUM_ROWS
+#error "The game field doesn't fit on the LED matrix display"
+#endif
+
+// If the field leaves at least a panel's worth of rows of the display
+// free above it (e.g. -DLEDMATRIX_PANELS_Y=2 -DFIELD_WIDTH=8), the
+// bottom PANEL_NUM_ROWS of those rows are a HUD band, starting at row
+// GAME_HUD_ROW, where text can scroll while the game runs (see
+// SCROLL_TO_HUD in scrolling_char_display.h).
+#if MATRIX_NUM_ROWS - FIELD_WIDTH >= PANEL_NUM_ROWS
+#define GAME_HUD_ROW FIELD_WIDTH
+#endif
 
-// The game field is 16 rows in size by 8 columns, i.e. x (column number)
-// ranges from 0 to 7 (left to right) and y (row number) ranges from
-// 0 to 15 (bottom to top).
-#define FIELD_HEIGHT 16
-#define FIELD_WIDTH 8
+// One bit for each column of a row of the field (bit x for column x)
+#if FIELD_WIDTH > 8
+typedef uint16_t FieldRowMask;
+#else
+typedef uint8_t FieldRowMask;
+#endif
+#define FIELD_COLUMN_BIT(x)		((FieldRowMask)1 << (x))
+#define FIELD_ROW_MASK			((FieldRowMask)(((uint32_t)1 << FIELD_WIDTH) - 1))
 
 // Limits on the number of asteroids and projectiles we can have on the 
-// game field at any one time. (These numbers should fit within the 
-// range of an int8_t type - i.e. max 127, though in reality
-// there are tighter constraints than this - e.g. there are only 128
-// positions on the game field.)
-#define MAX_PROJECTILES 4
-#define MAX_ASTEROIDS 20
+// game field at any one time. Each limit reserves that many slots in
+// the entity table (see entity.h), so together they must be less than
+// 255. Asteroids can go up to the size of the game field (128) - each
+// step only goes through the asteroids and projectiles once.
+#define MAX_PROJECTILES 16
+#define MAX_ASTEROIDS 32
+
+// Number of asteroids on the field at the start of the game. Large
+// asteroids split when hit, so there can be more than this later on.
+#define NUM_ASTEROIDS 20
 
 // Arguments that can be passed to move_base() below
 #define MOVE_LEFT 0
 #define MOVE_RIGHT 1
 
+// Most players there can be - each has their own base station. There
+// is one player unless two boards are linked (see netplay.h).
+#define GAME_MAX_PLAYERS 2
+
 // Initialise the game and output the initial display
 void initialise_game(void); 
 
+// Set the number of players (1 to GAME_MAX_PLAYERS) for the games
+// started by initialise_game()
+void game_set_players(uint8_t players);
+
+// Start the random number generator from the given seed. Boards which
+// start games from the same seed (and get the same input) play the
+// same game.
+void game_seed_random(uint32_t seed);
+
+// Turn quiet mode on (1) or off (0). In quiet mode the game state
+// changes as usual but nothing is drawn, and explosions and lost lives
+// aren't shown, nor the score and lives - for running steps again after
+// a rollback (see netplay.h) or as fast as possible (see env.h).
+// Turning it off draws the field as it now is, and shows the score and
+// lives if they have changed.
+void game_set_quiet(uint8_t on);
+
+// Returns 1 in quiet mode, 0 if not
+uint8_t game_is_quiet(void);
+
 // Attempt to move the base station to the left or the right. Returns
 // 1 if successful, 0 otherwise (e.g. already at edge). The "direction"
 // argument takes on the value MOVE_LEFT or MOVE_RIGHT (see above).
@@ -43,6 +101,24 @@ int8_t move_base(int8_t direction);
 // the maximum number of projectiles in flight has been reached.
 int8_t fire_projectile(void);
 
+// As move_base() and fire_projectile() (which are for player 0), for
+// the given player's base station
+int8_t move_player_base(uint8_t player, int8_t direction);
+int8_t fire_player_projectile(uint8_t player);
+
+// The column of the centre of the given player's base station
+int8_t game_base_position(uint8_t player);
+
+// Copy the positions of the asteroids (type 0 - ENTITY_ASTEROID in
+// entity.h) or projectiles (type 1) into board - FIELD_HEIGHT row
+// masks, bottom row first, with bit x set if there is something in
+// column x
+void game_copy_board(uint8_t type, FieldRowMask* board);
+
+// The game's own asteroid (type 0) or projectile (type 1) bitboard, as
+// in game_copy_board(). It changes as the game runs.
+const FieldRowMask* game_board(uint8_t type);
+
 // Advance the projectiles that have been fired. Any projectiles that
 // go off the top or that hit an asteroid are removed.
 void advance_projectiles(void);
@@ -59,8 +135,112 @@ void game_over(int8_t num);
 // reaches the bottom are removed.
 void advance_asteroids(void);
 
+// Collision tests made in the game being played - by the planned
+// impacts, and by testing every projectile against every asteroid each
+// step instead - over the steps run. errors counts the disagreements
+// found by checking the impacts against sweeping each object along its
+// path (Debug builds only - always 0 with NDEBUG).
+typedef struct {
+	uint32_t	tests;
+	uint32_t	testsEveryPair;
+	uint32_t	steps;
+	uint16_t	errors;
+} GameCollisionStats;
+
+void game_collision_stats(GameCollisionStats* stats);
+
+// Print the SPI bytes sent per asteroid step and the collision tests
+// made per step to standard output
+void game_report(void);
+
 //checking lives of the player
 void check_lives(uint8_t x, uint8_t y);
-void game_animation( uint8_t x, uint8_t y);
+
+// Draw the HUD band (if there is one - see GAME_HUD_ROW) again, after
+// the text scrolling in it has moved on
+void redraw_hud(void);
+
+// Move on the game's animations which run while the game carries on
+// (the life lost flash and the explosions). Call from the main loop, at least by
+// game_next_time() while game_task_active() returns 1.
+void game_task(void);
+uint8_t game_task_active(void);
+uint32_t game_next_time(void);
+
+// Coroutine (see coroutine.h) which plays the game over animation on
+// the LED matrix
+uint8_t game_visual_task(Coroutine* c);
+
+// Snapshots of the whole game state - the asteroids, projectiles, bases,
+// score, lives, random number generator and the main loop's timers (see
+// GameTimers) - as a string of bytes which can be kept in RAM, saved to
+// the EEPROM or sent over the serial port. Restoring a snapshot puts the
+// game back exactly as it was, so it carries on the same way.
+//
+// Format (version GAME_SNAPSHOT_VERSION, multi-byte values least
+// significant byte first):
+//	version, FIELD_WIDTH, FIELD_HEIGHT, number of players, position of
+//	each of the GAME_MAX_PLAYERS bases (0 if not playing), game over, lives,
+//	score (4 bytes), random number generator state (4 bytes),
+//	the four timers (2 bytes each), number of asteroids, number of
+//	projectiles,
+//	then for each asteroid and then each projectile: column, size,
+//	fixed point row (2 bytes), speed - ASTEROID_SPEED_MIN,
+//	then a CRC16 of everything before it (2 bytes).
+#define GAME_SNAPSHOT_VERSION		2
+#define GAME_SNAPSHOT_HEADER_BYTES	(24 + GAME_MAX_PLAYERS)
+#define GAME_SNAPSHOT_ENTITY_BYTES	5
+#define GAME_SNAPSHOT_MAX_BYTES		(GAME_SNAPSHOT_HEADER_BYTES + \
+		(MAX_ASTEROIDS + MAX_PROJECTILES) * GAME_SNAPSHOT_ENTITY_BYTES + 2)
+
+// The main loop's timers (in ms) - the time between projectile and
+// asteroid steps, and the time owed to each (see game_run_steps())
+typedef struct {
+	uint16_t	projectilePeriod;
+	uint16_t	asteroidPeriod;
+	uint16_t	projectileOwed;
+	uint16_t	asteroidOwed;
+} GameTimers;
+
+// Save the game state and the given timers in buffer (which must be
+// GAME_SNAPSHOT_MAX_BYTES long). Returns the length of the snapshot.
+uint16_t game_snapshot_save(uint8_t* buffer, const GameTimers* timers);
+
+// Restore the game state from the snapshot in buffer (of up to length
+// bytes), set *timers and redraw the display. Returns 1 if successful,
+// 0 if the snapshot is damaged or of the wrong version or field size
+// (in which case nothing is changed).
+uint8_t game_snapshot_restore(const uint8_t* buffer, uint16_t length, GameTimers* timers);
+
+// Step periods (ms) at the start of a game, and the shortest they get
+// as the score goes up
+#define GAME_PROJECTILE_PERIOD	500
+#define GAME_ASTEROID_PERIOD	1000
+#define GAME_MIN_STEP_PERIOD	100
+
+// Most steps of each kind run at once. If more are owed (e.g. after a
+// slow frame) the rest are dropped rather than stalling the game while
+// it catches up.
+#define GAME_MAX_CATCHUP_STEPS	4
+
+// The steps run by game_run_steps() - all of them, those run to catch
+// up (after the first of each kind), and those dropped
+typedef struct {
+	uint8_t		run;
+	uint8_t		late;
+	uint8_t		dropped;
+} GameSteps;
+
+// Set the timers for the start of a game
+void game_start_timers(GameTimers* timers);
+
+// Add ms to the time owed to each kind of step and run the steps which
+// are then due - the projectile steps first, then the asteroid steps.
+// The step periods get shorter as the score goes up. This is how every
+// game moves on - in the main loop, linked games (see netplay.h) and
+// training environments (see env.h). If steps isn't 0 the steps are
+// counted in it, and the projectile and asteroid stages of the frame
+// are marked (see frame_timing.h).
+void game_run_steps(GameTimers* timers, uint16_t ms, GameSteps* steps);
 
 #endif
@@ -0,0 +1,57 @@
+/*
+ * game_state.h
+ *
+ * The state of a game - everything the rules change as it is played.
+ * The game functions (game.h, entity.h, score.h, and the lives in
+ * timer0.h) all play the game gameState points to. That is normally
+ * boardGame, the game on the LED matrix, but game_use() can point them
+ * at another game - e.g. each training environment (see env.h) has a
+ * game of its own - without copying anything.
+ *
+ * What is drawn and shown (the display, the explosions, the score on
+ * the terminal) is not part of the state - a game other than boardGame
+ * should be played in quiet mode (see game_set_quiet()).
+ */
+
+#ifndef GAME_STATE_H_
+#define GAME_STATE_H_
+
+#include <stdint.h>
+#include "game.h"
+#include "entity.h"
+#include "sprite.h"
+
+// entities - the asteroids and projectiles (see entity.h).
+// boards - which cells have an asteroid/a projectile in them, for each
+// entity type (see game_board()).
+// basePosition - the column of the centre of each player's base, which
+// can be from 0 to FIELD_WIDTH-1 (the base can be partly off the field).
+// numPlayers - the number of bases on the field.
+// over - 1 once the game is over (see is_game_over()).
+// score, lives - see score.h and get_lives().
+// random - the random number generator (see game_seed_random()).
+// impactTarget, impactReplan - the planned impacts (see game.c).
+typedef struct {
+	EntityTable		entities;
+	Bitboard		boards[ENTITY_TYPES];
+	int8_t			basePosition[GAME_MAX_PLAYERS];
+	uint8_t			numPlayers;
+	int8_t			over;
+	uint32_t		score;
+	int8_t			lives;
+	uint32_t		random;
+	EntityHandle	impactTarget[MAX_PROJECTILES];
+	uint8_t			impactReplan[MAX_PROJECTILES];
+} GameState;
+
+// The game on the LED matrix, and the game in play
+extern GameState	boardGame;
+extern GameState*	gameState;
+
+// Play the given game from now on (boardGame if state is 0). A game
+// which has never been played should be started with initialise_game()
+// (after init_score(), init_lives() and game_over(0)) before anything
+// else is done with it.
+void game_use(GameState* state);
+
+#endif /* GAME_STATE_H_ */
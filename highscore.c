@@ -0,0 +1,171 @@
+/*
+ * highscore.c
+ *
+ * The high score table - see highscore.h
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+
+#include "highscore.h"
+#include "eeprom_queue.h"
+#include "terminalio.h"
+
+/* A copy of the table as stored in the EEPROM. The CRC covers
+ * everything before it. sequence goes up by one with each save (and
+ * wraps around). Packed, like HighScore, so there is no padding when
+ * built for a PC.
+ */
+typedef struct __attribute__((packed)) {
+	uint16_t	sequence;
+	HighScore	entries[HIGHSCORE_COUNT];
+	uint16_t	crc;
+} HighScoreRecord;
+
+#define RECORD_ADDRESS(slot) \
+		(HIGHSCORE_EEPROM_ADDRESS + (slot) * sizeof(HighScoreRecord))
+
+// HIGHSCORE_EEPROM_END works the size out by hand (it is used in #if)
+_Static_assert(RECORD_ADDRESS(HIGHSCORE_SLOTS) == HIGHSCORE_EEPROM_END,
+		"HIGHSCORE_EEPROM_END doesn't match the size of HighScoreRecord");
+
+#ifdef E2END
+#if HIGHSCORE_EEPROM_END > E2END + 1
+#error "The high score table copies don't fit in the EEPROM"
+#endif
+#endif
+
+/* table - the table in RAM, which is also what is written to the
+ * EEPROM. nextSlot is the slot the next save goes to. savePending is 1
+ * if the table has changed but hasn't been queued to be saved yet.
+ */
+static HighScoreRecord	table;
+static uint8_t			nextSlot;
+static uint8_t			savePending;
+
+/* CRC of a record in RAM */
+static uint16_t record_crc(const HighScoreRecord* record) {
+	const uint8_t* bytes = (const uint8_t*)record;
+	uint16_t crc = 0xFFFF;
+	for(uint8_t i = 0; i < offsetof(HighScoreRecord, crc); i++) {
+		crc = _crc16_update(crc, bytes[i]);
+	}
+	return crc;
+}
+
+/* Check the CRC of the record in the given EEPROM slot, reading it a
+ * byte at a time. Returns 1 if it is good, 0 if not.
+ */
+static uint8_t slot_is_good(uint8_t slot) {
+	const uint8_t* address = (const uint8_t*)RECORD_ADDRESS(slot);
+	uint16_t crc = 0xFFFF;
+	for(uint8_t i = 0; i < offsetof(HighScoreRecord, crc); i++) {
+		crc = _crc16_update(crc, eeprom_read_byte(address + i));
+	}
+	return crc == eeprom_read_word((const uint16_t*)(address +
+			offsetof(HighScoreRecord, crc)));
+}
+
+void highscore_init(void) {
+	uint8_t slot, newest = HIGHSCORE_SLOTS;
+	uint16_t sequence, newestSequence = 0;
+	
+	// Find the newest good copy. Sequence numbers wrap around, so a
+	// copy is newer if its sequence number is less than half way
+	// round from the newest so far.
+	for(slot = 0; slot < HIGHSCORE_SLOTS; slot++) {
+		if(!slot_is_good(slot)) {
+			continue;
+		}
+		sequence = eeprom_read_word((const uint16_t*)RECORD_ADDRESS(slot));
+		if(newest == HIGHSCORE_SLOTS || (int16_t)(sequence - newestSequence) > 0) {
+			newest = slot;
+			newestSequence = sequence;
+		}
+	}
+	
+	savePending = 0;
+	if(newest == HIGHSCORE_SLOTS) {
+		// Nothing saved yet (or nothing readable) - start with an
+		// empty table
+		uint8_t* bytes = (uint8_t*)&table;
+		for(uint8_t i = 0; i < sizeof(table); i++) {
+			bytes[i] = 0;
+		}
+		nextSlot = 0;
+		return;
+	}
+	eeprom_read_block(&table, (const void*)RECORD_ADDRESS(newest), sizeof(table));
+	nextSlot = (newest + 1) % HIGHSCORE_SLOTS;
+}
+
+/* Save the table to the next slot, once nothing else is being written
+ * to the EEPROM. The table isn't copied - the write reads it as it
+ * goes - so if the table is changed before the write finishes that copy
+ * is left with the wrong CRC. But the change is then saved in full to
+ * the slot after it, as the save waits for the write to finish.
+ */
+static void save_table(void) {
+	if(eeprom_queue_pending()) {
+		savePending = 1;
+		return;
+	}
+	table.sequence++;
+	table.crc = record_crc(&table);
+	eeprom_queue_write(RECORD_ADDRESS(nextSlot), &table, sizeof(table));
+	nextSlot = (nextSlot + 1) % HIGHSCORE_SLOTS;
+	savePending = 0;
+}
+
+uint8_t highscore_qualifies(uint32_t score) {
+	return score > table.entries[HIGHSCORE_COUNT - 1].score;
+}
+
+uint8_t highscore_add(const char* name, uint32_t score) {
+	uint8_t position, i;
+	
+	if(!highscore_qualifies(score)) {
+		return HIGHSCORE_COUNT;
+	}
+	// Move the lower scores down to make room
+	for(position = HIGHSCORE_COUNT - 1; position > 0 &&
+			score > table.entries[position - 1].score; position--) {
+		table.entries[position] = table.entries[position - 1];
+	}
+	for(i = 0; i < HIGHSCORE_NAME_LENGTH && name[i]; i++) {
+		table.entries[position].name[i] = name[i];
+	}
+	for(; i < HIGHSCORE_NAME_LENGTH; i++) {
+		table.entries[position].name[i] = 0;
+	}
+	table.entries[position].score = score;
+	save_table();
+	return position;
+}
+
+void highscore_task(void) {
+	if(savePending) {
+		save_table();
+	}
+}
+
+const HighScore* highscore_get(uint8_t position) {
+	return &table.entries[position];
+}
+
+void highscore_print(uint8_t row) {
+	move_cursor(10, row);
+	printf_P(PSTR("High scores"));
+	for(uint8_t i = 0; i < HIGHSCORE_COUNT && table.entries[i].score; i++) {
+		move_cursor(10, row + 1 + i);
+		printf_P(PSTR("%u. %-*.*s %lu"), i + 1, HIGHSCORE_NAME_LENGTH,
+				HIGHSCORE_NAME_LENGTH, table.entries[i].name,
+				table.entries[i].score);
+	}
+}
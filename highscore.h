@@ -0,0 +1,69 @@
+/*
+ * highscore.h
+ *
+ * The high score table - the best HIGHSCORE_COUNT scores and the names
+ * of the players who got them, kept in the EEPROM so they survive a
+ * reset. The table is read from the EEPROM once (by highscore_init())
+ * into RAM. Changes are made in RAM and written back in the background
+ * (see eeprom_queue.h), so they never hold up the game.
+ *
+ * Each save goes to the next of HIGHSCORE_SLOTS copies of the table in
+ * the EEPROM, so the writes are spread over all of them. Each copy has
+ * a sequence number and a CRC - the newest copy with a good CRC is the
+ * one loaded, so if a save is cut short (e.g. by a reset) the one
+ * before it is used instead.
+ */
+
+#ifndef HIGHSCORE_H_
+#define HIGHSCORE_H_
+
+#include <stdint.h>
+
+// Number of scores in the table, and the longest name
+#define HIGHSCORE_COUNT			5
+#define HIGHSCORE_NAME_LENGTH	10
+
+// Where the copies of the table go in the EEPROM
+#define HIGHSCORE_EEPROM_ADDRESS	0
+#define HIGHSCORE_SLOTS				8
+
+// The first EEPROM address after the copies of the table (each copy is
+// a 2 byte sequence number, the entries and a 2 byte CRC). highscore.c
+// checks this matches the size of its records.
+#define HIGHSCORE_EEPROM_END (HIGHSCORE_EEPROM_ADDRESS + HIGHSCORE_SLOTS * \
+		(4 + HIGHSCORE_COUNT * (HIGHSCORE_NAME_LENGTH + 4)))
+
+// An entry in the table. The name is padded with nulls, and is not
+// null terminated if it is HIGHSCORE_NAME_LENGTH characters long.
+// Entries which aren't used have a score of 0 and an empty name.
+// (Packed so that it is laid out as on the board when built for a PC.)
+typedef struct __attribute__((packed)) {
+	char		name[HIGHSCORE_NAME_LENGTH];
+	uint32_t	score;
+} HighScore;
+
+// Load the table from the EEPROM (or start with an empty table if
+// there is no good copy there)
+void highscore_init(void);
+
+// Would the given score get into the table? Returns 1 if yes, 0 if no.
+uint8_t highscore_qualifies(uint32_t score);
+
+// Add a score to the table (if it qualifies) and save the table.
+// Returns its position in the table (0 for the best), or
+// HIGHSCORE_COUNT if it didn't get in. If anything is still being
+// written to the EEPROM the save waits for highscore_task().
+uint8_t highscore_add(const char* name, uint32_t score);
+
+// Save the table if a save has been waiting and the EEPROM writes
+// have finished. Called from the main loop.
+void highscore_task(void);
+
+// The entry at the given position (0 for the best)
+const HighScore* highscore_get(uint8_t position);
+
+// Print the table to standard output, starting at the given terminal
+// row
+void highscore_print(uint8_t row);
+
+#endif /* HIGHSCORE_H_ */
@@ -0,0 +1,357 @@
+/*
+ * avr_host.c
+ *
+ * The hardware stand-ins for the host build - see host.h
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <avr/sleep.h>
+#include <util/crc16.h>
+#include <util/delay.h>
+
+#include "host.h"
+#include "ledmatrix.h"
+#include "spi.h"
+#include "serial_link.h"
+
+#undef REGISTER8
+#undef REGISTER16
+#define REGISTER8(name) volatile uint8_t name;
+#define REGISTER16(name) volatile uint16_t name;
+
+REGISTER8(PORTA) REGISTER8(PORTB) REGISTER8(PORTC) REGISTER8(PORTD)
+REGISTER8(DDRA) REGISTER8(DDRB) REGISTER8(DDRC) REGISTER8(DDRD)
+REGISTER8(PINA) REGISTER8(PINB) REGISTER8(PINC) REGISTER8(PIND)
+REGISTER8(TCNT0) REGISTER8(OCR0A) REGISTER8(OCR0B) REGISTER8(TCCR0A) REGISTER8(TCCR0B)
+REGISTER8(TIMSK0) REGISTER8(TIFR0)
+REGISTER16(TCNT1) REGISTER16(OCR1A) REGISTER16(OCR1B) REGISTER8(OCR1BL)
+REGISTER8(TCCR1A) REGISTER8(TCCR1B) REGISTER8(TIMSK1) REGISTER8(TIFR1)
+REGISTER8(TCNT2) REGISTER8(OCR2A) REGISTER8(OCR2B) REGISTER8(TCCR2A) REGISTER8(TCCR2B)
+REGISTER8(TIMSK2) REGISTER8(TIFR2) REGISTER8(ASSR)
+REGISTER8(ADMUX) REGISTER8(ADCSRA) REGISTER16(ADC)
+REGISTER8(PCICR) REGISTER8(PCIFR) REGISTER8(PCMSK0) REGISTER8(PCMSK1)
+REGISTER8(SPCR0) REGISTER8(SPSR0) REGISTER8(SPDR0)
+REGISTER16(UBRR0) REGISTER8(UCSR0A) REGISTER8(UCSR0B) REGISTER8(UCSR0C) REGISTER8(UDR0)
+REGISTER8(UBRR1) REGISTER8(UCSR1A) REGISTER8(UCSR1B) REGISTER8(UDR1)
+REGISTER8(EECR) REGISTER8(EEDR) REGISTER16(EEAR)
+REGISTER8(SREG) REGISTER8(SMCR) REGISTER8(MCUSR)
+REGISTER8(SPL) REGISTER8(SPH) REGISTER16(SP)
+
+void cli(void) {
+	SREG &= ~(1 << SREG_I);
+}
+
+void sei(void) {
+	SREG |= (1 << SREG_I);
+}
+
+void _delay_ms(double ms) {
+	(void)ms;
+}
+
+void _delay_us(double us) {
+	(void)us;
+}
+
+void set_sleep_mode(int mode) {
+	(void)mode;
+}
+
+void sleep_enable(void) {
+}
+
+void sleep_disable(void) {
+}
+
+void sleep_cpu(void) {
+}
+
+void sleep_mode(void) {
+}
+
+///////////////////////////////////////////////////////////
+// printf_P()
+
+// Longest format string passed to printf_P()
+#define MAX_FORMAT 256
+
+int host_printf_P(const char* format, ...) {
+	char hostFormat[MAX_FORMAT];
+	uint16_t i = 0;
+	uint8_t inConversion = 0;
+	va_list args;
+	int result;
+
+	// On the board long is 32 bits, the same as uint32_t and int32_t
+	// are on the host, so the l is dropped. %S (a string in program
+	// memory) is just a string.
+	for(; *format && i < MAX_FORMAT - 1; format++) {
+		if(inConversion && *format == 'l') {
+			continue;
+		}
+		if(inConversion && *format == 'S') {
+			hostFormat[i++] = 's';
+			inConversion = 0;
+			continue;
+		}
+		hostFormat[i++] = *format;
+		if(*format == '%') {
+			inConversion = !inConversion;
+		} else if(inConversion && strchr("diouxXcsp", *format)) {
+			inConversion = 0;
+		}
+	}
+	hostFormat[i] = 0;
+	va_start(args, format);
+	result = vprintf(hostFormat, args);
+	va_end(args);
+	return result;
+}
+
+///////////////////////////////////////////////////////////
+// CRCs - as given in the avr-libc documentation
+
+uint16_t _crc16_update(uint16_t crc, uint8_t data) {
+	crc ^= data;
+	for(uint8_t i = 0; i < 8; i++) {
+		crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+	}
+	return crc;
+}
+
+uint16_t _crc_xmodem_update(uint16_t crc, uint8_t data) {
+	crc ^= (uint16_t)data << 8;
+	for(uint8_t i = 0; i < 8; i++) {
+		crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+	}
+	return crc;
+}
+
+uint16_t _crc_ccitt_update(uint16_t crc, uint8_t data) {
+	data ^= crc & 0xFF;
+	data ^= data << 4;
+	return (((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4) ^
+			((uint16_t)data << 3);
+}
+
+uint8_t _crc8_ccitt_update(uint8_t crc, uint8_t data) {
+	crc ^= data;
+	for(uint8_t i = 0; i < 8; i++) {
+		crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+	}
+	return crc;
+}
+
+///////////////////////////////////////////////////////////
+// SPI - the LED matrix
+
+// Number of the panel whose slave select pin is low, taking the pins
+// in the same order as ledmatrix_setup() (see LEDMATRIX_SS_PINS_B and
+// _A in ledmatrix.h), or LEDMATRIX_NUM_PANELS if none is
+static uint8_t selected_panel(void) {
+	uint8_t panel = 1;
+
+	if(!(PORTB & (1 << 4))) {
+		return 0;
+	}
+	for(uint8_t pin = 0x80; pin; pin >>= 1) {
+		if(LEDMATRIX_SS_PINS_B & pin) {
+			if(!(PORTB & pin)) {
+				return panel;
+			}
+			panel++;
+		}
+	}
+	for(uint8_t pin = 0x80; pin; pin >>= 1) {
+		if(LEDMATRIX_SS_PINS_A & pin) {
+			if(!(PORTA & pin)) {
+				return panel;
+			}
+			panel++;
+		}
+	}
+	return panel;
+}
+
+static FILE* capture;
+static uint8_t capturedPanel;
+
+void host_capture_to(FILE* file) {
+	capture = file;
+	capturedPanel = 0;
+}
+
+void host_capture_frame(void) {
+	if(capture) {
+		fprintf(capture, "frame\n");
+	}
+}
+
+void host_capture_expect(uint8_t panel, const uint8_t colours[128]) {
+	if(!capture) {
+		return;
+	}
+	fprintf(capture, "expect %u", panel);
+	for(uint8_t i = 0; i < 128; i++) {
+		fprintf(capture, " %02x", colours[i]);
+	}
+	fprintf(capture, "\n");
+}
+
+void spi_setup_master(uint8_t clockdivider) {
+	(void)clockdivider;
+	// Select the slave (panel 0), as spi.c does
+	PORTB &= ~(1 << 4);
+}
+
+uint8_t spi_send_byte(uint8_t byte) {
+	if(capture) {
+		uint8_t panel = selected_panel();
+		if(panel < LEDMATRIX_NUM_PANELS && panel != capturedPanel) {
+			fprintf(capture, "select %u\n", panel);
+			capturedPanel = panel;
+		}
+		fprintf(capture, "spi %02x\n", byte);
+	}
+	return 0;
+}
+
+///////////////////////////////////////////////////////////
+// Serial link - to another program, through a file descriptor
+
+static int linkFile = -1;
+static int16_t linkByte = -1;	// Read ahead, or -1
+static uint32_t linkBytesSent;
+static uint32_t linkBytesReceived;
+
+void host_link_to(int fd) {
+	linkFile = fd;
+	linkByte = -1;
+	if(fd >= 0) {
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	}
+}
+
+void serial_link_init(long baudrate) {
+	(void)baudrate;
+	linkByte = -1;
+	linkBytesSent = linkBytesReceived = 0;
+}
+
+void serial_link_send(uint8_t byte) {
+	if(linkFile < 0) {
+		return;
+	}
+	// Waits for room, as serial_link.c does
+	while(write(linkFile, &byte, 1) != 1) {
+		usleep(100);
+	}
+	linkBytesSent++;
+}
+
+uint8_t serial_link_input_available(void) {
+	uint8_t byte;
+	if(linkByte < 0 && linkFile >= 0 && read(linkFile, &byte, 1) == 1) {
+		linkByte = byte;
+		linkBytesReceived++;
+	}
+	return linkByte >= 0;
+}
+
+uint8_t serial_link_get(void) {
+	uint8_t byte = (uint8_t)linkByte;
+	linkByte = -1;
+	return byte;
+}
+
+uint32_t serial_link_bytes_sent(void) {
+	return linkBytesSent;
+}
+
+uint32_t serial_link_bytes_received(void) {
+	return linkBytesReceived;
+}
+
+uint16_t serial_link_overruns(void) {
+	// The other program waits for room
+	return 0;
+}
+
+///////////////////////////////////////////////////////////
+// EEPROM
+
+uint8_t hostEeprom[E2END + 1];
+uint16_t hostEepromWrites[E2END + 1];
+
+#define EEPROM_OFFSET(address) ((uintptr_t)(address) & E2END)
+
+void host_eeprom_erase(void) {
+	memset(hostEeprom, 0xFF, sizeof(hostEeprom));
+	memset(hostEepromWrites, 0, sizeof(hostEepromWrites));
+	EECR = 0;
+}
+
+static void write_byte(uint16_t offset, uint8_t value) {
+	hostEeprom[offset] = value;
+	hostEepromWrites[offset]++;
+}
+
+uint8_t host_eeprom_step(void) {
+	void EE_READY_vect(void);
+
+	if(EECR & (1 << EEPE)) {
+		write_byte(EEAR & E2END, EEDR);
+		EECR &= ~((1 << EEPE) | (1 << EEMPE));
+	}
+	if(EECR & (1 << EERIE)) {
+		EE_READY_vect();
+		return 1;
+	}
+	return 0;
+}
+
+uint8_t eeprom_read_byte(const uint8_t* address) {
+	return hostEeprom[EEPROM_OFFSET(address)];
+}
+
+uint16_t eeprom_read_word(const uint16_t* address) {
+	uint16_t offset = EEPROM_OFFSET(address);
+	return hostEeprom[offset] | (uint16_t)hostEeprom[(offset + 1) & E2END] << 8;
+}
+
+void eeprom_read_block(void* destination, const void* source, size_t length) {
+	uint16_t offset = EEPROM_OFFSET(source);
+	for(size_t i = 0; i < length; i++) {
+		((uint8_t*)destination)[i] = hostEeprom[(offset + i) & E2END];
+	}
+}
+
+void eeprom_write_byte(uint8_t* address, uint8_t value) {
+	write_byte(EEPROM_OFFSET(address), value);
+}
+
+void eeprom_write_word(uint16_t* address, uint16_t value) {
+	uint16_t offset = EEPROM_OFFSET(address);
+	write_byte(offset, value & 0xFF);
+	write_byte((offset + 1) & E2END, value >> 8);
+}
+
+void eeprom_update_byte(uint8_t* address, uint8_t value) {
+	if(eeprom_read_byte(address) != value) {
+		eeprom_write_byte(address, value);
+	}
+}
+
+int eeprom_is_ready(void) {
+	return !(EECR & (1 << EEPE));
+}
@@ -0,0 +1,75 @@
+/*
+ * env_driver.c
+ *
+ * Runs the training environments (see env.h) on a PC.
+ *
+ * Usage: env_driver bench [environments] [steps]
+ *        env_driver play [episodes]
+ *
+ * bench runs env_benchmark() - each of the environments is stepped
+ * the given number of times with pseudo-random actions - and prints
+ * the steps per second. play plays episodes in one environment with
+ * the autopilot (see autopilot.h) choosing each action from the
+ * game's state, and prints the steps, score and total reward of each.
+ * env_close() isn't called, as there is no display to draw the game on.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "env.h"
+#include "autopilot.h"
+
+static uint32_t now(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint32_t)(t.tv_sec * 1000 + t.tv_nsec / 1000000);
+}
+
+static void bench(uint8_t count, uint32_t steps) {
+	GameEnv* envs = calloc(count, sizeof(GameEnv));
+	GameState* games = calloc(count, sizeof(GameState));
+
+	for(uint8_t i = 0; i < count; i++) {
+		env_init(&envs[i], &games[i]);
+	}
+	env_benchmark(envs, count, steps, now);
+	free(games);
+	free(envs);
+}
+
+static void play(uint32_t episodes) {
+	static GameState game;
+	GameEnv env;
+	int32_t reward;
+	uint8_t action;
+
+	env_init(&env, &game);
+	for(uint32_t episode = 1; episode <= episodes; episode++) {
+		env_reset(&env, episode);
+		reward = 0;
+		while(!env.done) {
+			action = autopilot_decide(0, &env.timers, ENV_STEP_MS);
+			reward += env_step(&env, action);
+		}
+		printf("episode %" PRIu32 ": %" PRIu32 " steps, score %" PRIu32
+				", reward %" PRId32 "\n", episode, env.steps, env.score, reward);
+	}
+}
+
+int main(int argc, char** argv) {
+	if(argc >= 2 && !strcmp(argv[1], "bench")) {
+		bench(argc >= 3 ? atoi(argv[2]) : 1, argc >= 4 ? atol(argv[3]) : 100000);
+	} else if(argc >= 2 && !strcmp(argv[1], "play")) {
+		play(argc >= 3 ? atol(argv[2]) : 5);
+	} else {
+		fprintf(stderr, "Usage: %s bench [environments] [steps]\n"
+				"       %s play [episodes]\n", argv[0], argv[0]);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,56 @@
+/*
+ * host.h
+ *
+ * The parts of the host build which stand in for the hardware, for the
+ * programs in host/ to use.
+ *
+ * The game's modules are built for the PC (see host/Makefile) with
+ * the AVR headers in host/include, where the registers are plain
+ * variables. spi.c is replaced by a stand-in which writes each byte
+ * sent to the LED matrix to a capture file, in the format read by
+ * matrix_emulator.py. The EEPROM is simulated in RAM, with the time a
+ * write takes left to the program - host_eeprom_step() finishes the
+ * byte being written and runs the EEPROM ready interrupt handler.
+ * serial_link.c is replaced by a stand-in which sends and receives
+ * through a file descriptor, e.g. a pseudo terminal.
+ */
+
+#ifndef HOST_H_
+#define HOST_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <avr/io.h>
+
+// Write the SPI bytes sent from now on (and the panel selected, from
+// the slave select pins) to the given file, or discard them if file is
+// 0 (the default)
+void host_capture_to(FILE* file);
+
+// Mark the end of a frame in the capture
+void host_capture_frame(void);
+
+// Write the colours the given panel should now be showing (row 0 first,
+// 16 pixels to a row - as for CMD_UPDATE_ALL) to the capture, for
+// matrix_emulator.py to check
+void host_capture_expect(uint8_t panel, const uint8_t colours[128]);
+
+// The simulated EEPROM, and the number of times each byte has been
+// written
+extern uint8_t hostEeprom[E2END + 1];
+extern uint16_t hostEepromWrites[E2END + 1];
+
+// Send and receive the serial link's bytes (see serial_link.h) through
+// the given file descriptor, which is made non-blocking, or discard
+// them if fd is -1 (the default)
+void host_link_to(int fd);
+
+// Erase the simulated EEPROM (to 0xFF) and clear the write counts
+void host_eeprom_erase(void);
+
+// Finish the byte the EEPROM is writing (if any), then, if the EEPROM
+// ready interrupt is enabled, run its handler. Returns 1 if the handler
+// was run (so there may be more to write), 0 if not.
+uint8_t host_eeprom_step(void);
+
+#endif /* HOST_H_ */
@@ -0,0 +1,26 @@
+/*
+ * avr/eeprom.h (host build)
+ *
+ * The EEPROM is simulated in RAM (see host/avr_host.c). EEMEM
+ * variables are laid out from address 0 by the linker on the board;
+ * on the host they are only ever used for their addresses, which are
+ * turned into offsets into the simulated EEPROM.
+ */
+
+#ifndef HOST_AVR_EEPROM_H_
+#define HOST_AVR_EEPROM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define EEMEM
+
+uint8_t eeprom_read_byte(const uint8_t* address);
+uint16_t eeprom_read_word(const uint16_t* address);
+void eeprom_read_block(void* destination, const void* source, size_t length);
+void eeprom_write_byte(uint8_t* address, uint8_t value);
+void eeprom_write_word(uint16_t* address, uint16_t value);
+void eeprom_update_byte(uint8_t* address, uint8_t value);
+int eeprom_is_ready(void);
+
+#endif /* HOST_AVR_EEPROM_H_ */
@@ -0,0 +1,21 @@
+/*
+ * avr/interrupt.h (host build)
+ *
+ * Interrupt handlers are ordinary functions, named after their vector,
+ * which host code can call to make the interrupt "happen".
+ */
+
+#ifndef HOST_AVR_INTERRUPT_H_
+#define HOST_AVR_INTERRUPT_H_
+
+#include <avr/io.h>
+
+#define ISR(vector, ...) void vector(void); void vector(void)
+#define EMPTY_INTERRUPT(vector) void vector(void); void vector(void) {}
+#define ISR_NAKED 0
+#define ISR_NOBLOCK 0
+
+void cli(void);
+void sei(void);
+
+#endif /* HOST_AVR_INTERRUPT_H_ */
@@ -0,0 +1,139 @@
+/*
+ * avr/io.h (host build)
+ *
+ * The ATmega324A registers used by the game, as plain variables (see
+ * host/avr_host.c), and the bit numbers used with them. Writing a
+ * register does nothing more than store the value.
+ */
+
+#ifndef HOST_AVR_IO_H_
+#define HOST_AVR_IO_H_
+
+#include <stdint.h>
+
+#define _BV(bit) (1 << (bit))
+#define bit_is_set(reg, bit) ((reg) & _BV(bit))
+#define bit_is_clear(reg, bit) (!((reg) & _BV(bit)))
+
+#define REGISTER8(name) extern volatile uint8_t name;
+#define REGISTER16(name) extern volatile uint16_t name;
+
+// Ports
+REGISTER8(PORTA) REGISTER8(PORTB) REGISTER8(PORTC) REGISTER8(PORTD)
+REGISTER8(DDRA) REGISTER8(DDRB) REGISTER8(DDRC) REGISTER8(DDRD)
+REGISTER8(PINA) REGISTER8(PINB) REGISTER8(PINC) REGISTER8(PIND)
+
+// Timers
+REGISTER8(TCNT0) REGISTER8(OCR0A) REGISTER8(OCR0B) REGISTER8(TCCR0A) REGISTER8(TCCR0B)
+REGISTER8(TIMSK0) REGISTER8(TIFR0)
+REGISTER16(TCNT1) REGISTER16(OCR1A) REGISTER16(OCR1B) REGISTER8(OCR1BL)
+REGISTER8(TCCR1A) REGISTER8(TCCR1B) REGISTER8(TIMSK1) REGISTER8(TIFR1)
+REGISTER8(TCNT2) REGISTER8(OCR2A) REGISTER8(OCR2B) REGISTER8(TCCR2A) REGISTER8(TCCR2B)
+REGISTER8(TIMSK2) REGISTER8(TIFR2) REGISTER8(ASSR)
+
+// ADC, pin change interrupts, SPI
+REGISTER8(ADMUX) REGISTER8(ADCSRA) REGISTER16(ADC)
+REGISTER8(PCICR) REGISTER8(PCIFR) REGISTER8(PCMSK0) REGISTER8(PCMSK1)
+REGISTER8(SPCR0) REGISTER8(SPSR0) REGISTER8(SPDR0)
+
+// USARTs
+REGISTER16(UBRR0) REGISTER8(UCSR0A) REGISTER8(UCSR0B) REGISTER8(UCSR0C) REGISTER8(UDR0)
+REGISTER8(UBRR1) REGISTER8(UCSR1A) REGISTER8(UCSR1B) REGISTER8(UDR1)
+
+// EEPROM, status, sleep and stack
+REGISTER8(EECR) REGISTER8(EEDR) REGISTER16(EEAR)
+REGISTER8(SREG) REGISTER8(SMCR) REGISTER8(MCUSR)
+REGISTER8(SPL) REGISTER8(SPH) REGISTER16(SP)
+
+#define SREG_I 7
+
+// Timer 0
+#define CS00 0
+#define CS01 1
+#define CS02 2
+#define WGM00 0
+#define WGM01 1
+#define WGM02 3
+#define TOIE0 0
+#define OCIE0A 1
+#define OCIE0B 2
+#define TOV0 0
+#define OCF0A 1
+#define OCF0B 2
+
+// Timer 1
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define WGM10 0
+#define WGM11 1
+#define WGM12 3
+#define WGM13 4
+#define COM1B0 4
+#define COM1B1 5
+
+// Timer 2
+#define CS20 0
+#define CS21 1
+#define CS22 2
+#define WGM20 0
+#define WGM21 1
+#define WGM22 3
+#define OCIE2A 1
+#define OCF2A 1
+#define COM2B0 4
+#define COM2B1 5
+#define COM2A1 7
+
+// ADC
+#define ADPS0 0
+#define ADPS1 1
+#define ADPS2 2
+#define ADIE 3
+#define ADIF 4
+#define ADSC 6
+#define ADEN 7
+#define REFS0 6
+
+// Pin change interrupts
+#define PCIE1 1
+#define PCIF1 1
+#define PCINT8 0
+#define PCINT9 1
+#define PCINT10 2
+#define PCINT11 3
+
+// SPI
+#define SPR00 0
+#define SPR10 1
+#define SPI2X0 0
+#define MSTR0 4
+#define SPE0 6
+#define SPIE0 7
+#define SPIF0 7
+
+// USARTs
+#define TXEN0 3
+#define RXEN0 4
+#define UDRIE0 5
+#define TXCIE0 6
+#define RXCIE0 7
+#define TXEN1 3
+#define RXEN1 4
+#define UDRIE1 5
+#define RXCIE1 7
+
+// EEPROM
+#define EERE 0
+#define EEPE 1
+#define EEMPE 2
+#define EERIE 3
+
+#define PORTA2 2
+#define SE 0
+
+#define RAMSTART 0x0100
+#define RAMEND 0x08FF
+#define E2END 0x03FF
+
+#endif /* HOST_AVR_IO_H_ */
@@ -0,0 +1,50 @@
+/*
+ * avr/pgmspace.h (host build)
+ *
+ * There is only one address space, so program memory is ordinary
+ * (constant) memory and most of the _P functions are the standard
+ * ones. printf_P() is host_printf_P() (see host/avr_host.c), which
+ * understands avr-libc's formats - %S for a string in program memory,
+ * and %ld and %lu for 32 bit numbers.
+ */
+
+#ifndef HOST_AVR_PGMSPACE_H_
+#define HOST_AVR_PGMSPACE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define PGM_P const char*
+
+// Words are also used to hold pointers, which are wider on the host
+static inline uintptr_t host_pgm_read_word(const void* address, size_t size) {
+	uint16_t word;
+	uintptr_t pointer;
+	if(size == sizeof(word)) {
+		memcpy(&word, address, sizeof(word));
+		return word;
+	}
+	memcpy(&pointer, address, sizeof(pointer));
+	return pointer;
+}
+
+// (Addresses may also be 16 bit integers, as on the board)
+#define pgm_read_byte(address) (*(const uint8_t*)(uintptr_t)(address))
+#define pgm_read_word(address) host_pgm_read_word((address), sizeof(*(address)))
+#define pgm_read_ptr(address) (*(void* const*)(address))
+
+int host_printf_P(const char* format, ...);
+
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define printf_P host_printf_P
+#define sprintf_P sprintf
+#define snprintf_P snprintf
+#define fputs_P fputs
+#define puts_P puts
+
+#endif /* HOST_AVR_PGMSPACE_H_ */
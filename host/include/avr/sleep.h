@@ -0,0 +1,19 @@
+/*
+ * avr/sleep.h (host build)
+ *
+ * Sleeping returns straight away.
+ */
+
+#ifndef HOST_AVR_SLEEP_H_
+#define HOST_AVR_SLEEP_H_
+
+#define SLEEP_MODE_IDLE 0
+#define SLEEP_MODE_PWR_SAVE 1
+
+void set_sleep_mode(int mode);
+void sleep_enable(void);
+void sleep_disable(void);
+void sleep_cpu(void);
+void sleep_mode(void);
+
+#endif /* HOST_AVR_SLEEP_H_ */
@@ -0,0 +1,23 @@
+/*
+ * avr_libc.h (host build)
+ *
+ * The avr-libc additions to <stdio.h> used by serialio.c. This file is
+ * included before every source file (see host/Makefile), since the
+ * host's own <stdio.h> is used.
+ */
+
+#ifndef HOST_AVR_LIBC_H_
+#define HOST_AVR_LIBC_H_
+
+#include <stdio.h>
+
+// The stream's functions aren't called (the host's own streams are
+// used) but are referred to, as on the board, so they count as used
+#define FDEV_SETUP_STREAM(put, get, flags) \
+		{ (int)(0 * (sizeof(&(put)) + sizeof(&(get)))) }
+#define fdev_setup_stream(stream, put, get, flags) do {} while(0)
+#define _FDEV_SETUP_RW 0
+#define _FDEV_EOF (-2)
+#define _FDEV_ERR (-1)
+
+#endif /* HOST_AVR_LIBC_H_ */
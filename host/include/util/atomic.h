@@ -0,0 +1,15 @@
+/*
+ * util/atomic.h (host build)
+ *
+ * Nothing interrupts the host build, so an atomic block is just a
+ * block.
+ */
+
+#ifndef HOST_UTIL_ATOMIC_H_
+#define HOST_UTIL_ATOMIC_H_
+
+#define ATOMIC_BLOCK(type) for(int atomicOnce = 1; atomicOnce; atomicOnce = 0)
+#define ATOMIC_RESTORESTATE 0
+#define ATOMIC_FORCEON 0
+
+#endif /* HOST_UTIL_ATOMIC_H_ */
@@ -0,0 +1,17 @@
+/*
+ * util/crc16.h (host build)
+ *
+ * The avr-libc CRC functions, written out in C (see host/avr_host.c).
+ */
+
+#ifndef HOST_UTIL_CRC16_H_
+#define HOST_UTIL_CRC16_H_
+
+#include <stdint.h>
+
+uint16_t _crc16_update(uint16_t crc, uint8_t data);
+uint16_t _crc_xmodem_update(uint16_t crc, uint8_t data);
+uint16_t _crc_ccitt_update(uint16_t crc, uint8_t data);
+uint8_t _crc8_ccitt_update(uint8_t crc, uint8_t data);
+
+#endif /* HOST_UTIL_CRC16_H_ */
@@ -0,0 +1,13 @@
+/*
+ * util/delay.h (host build)
+ *
+ * Delays return straight away.
+ */
+
+#ifndef HOST_UTIL_DELAY_H_
+#define HOST_UTIL_DELAY_H_
+
+void _delay_ms(double ms);
+void _delay_us(double us);
+
+#endif /* HOST_UTIL_DELAY_H_ */
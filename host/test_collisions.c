@@ -0,0 +1,124 @@
+/*
+ * test_collisions.c
+ *
+ * Checks the game's planned impacts between projectiles and asteroids
+ * (see impactTarget in game.c). Seeded games are played in quiet mode
+ * with pseudo-random moves, firing as often as possible, so the field
+ * is full of projectiles. The host build is a Debug build, so the game
+ * checks each impact against sweeping the objects along the paths
+ * they moved and counts any disagreement - there must be none.
+ *
+ * Each game is then played again from the same seed, saving and
+ * restoring a snapshot every few ticks - the plans are made again on
+ * restoring, and the game must carry on exactly as before.
+ *
+ * The collision tests made per step are printed, with the tests that
+ * checking every projectile against every asteroid would have taken.
+ * Exits with status 1 if any check fails.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "host.h"
+#include "game.h"
+#include "score.h"
+#include "timer0.h"
+#include "entity.h"
+
+#define GAMES			40
+#define MAX_TICKS		3000
+#define TICK_MS			20
+
+// Ticks between snapshots in the second playing of each game
+#define SNAPSHOT_TICKS	7
+
+static uint8_t failures;
+
+static void check(uint8_t ok, const char* description, uint32_t seed) {
+	if(!ok) {
+		fprintf(stderr, "FAIL: %s (game %u)\n", description, (unsigned)seed);
+		failures++;
+	}
+}
+
+// A hash of the score, lives and both boards
+static uint32_t state_hash(void) {
+	uint32_t hash = 2166136261u;
+	for(uint8_t type = 0; type < ENTITY_TYPES; type++) {
+		const FieldRowMask* board = game_board(type);
+		for(uint8_t y = 0; y < FIELD_HEIGHT; y++) {
+			hash = (hash ^ board[y]) * 16777619u;
+		}
+	}
+	hash = (hash ^ get_score()) * 16777619u;
+	return (hash ^ (uint32_t)get_lives()) * 16777619u;
+}
+
+// Play the game started from the given seed, saving and restoring a
+// snapshot every snapshotTicks ticks (if not 0). Returns the number of
+// ticks played and puts the state hash after each one in hashes.
+static uint16_t play(uint32_t seed, uint8_t snapshotTicks, uint32_t* hashes) {
+	static uint8_t snapshot[GAME_SNAPSHOT_MAX_BYTES];
+	uint32_t random = seed;
+	uint16_t tick, length;
+	GameTimers timers;
+
+	game_over(0);
+	init_score();
+	init_lives();
+	game_seed_random(seed);
+	game_set_players(1);
+	initialise_game();
+	game_start_timers(&timers);
+	for(tick = 0; tick < MAX_TICKS && !is_game_over(); tick++) {
+		random = random * 1103515245 + 12345;
+		if(random & 0x10000) {
+			move_base((random & 0x20000) ? MOVE_LEFT : MOVE_RIGHT);
+		}
+		fire_projectile();
+		game_run_steps(&timers, TICK_MS, 0);
+		if(snapshotTicks && tick % snapshotTicks == 0) {
+			length = game_snapshot_save(snapshot, &timers);
+			check(game_snapshot_restore(snapshot, length, &timers),
+					"snapshot restored", seed);
+		}
+		hashes[tick] = state_hash();
+	}
+	return tick;
+}
+
+int main(void) {
+	static uint32_t hashes[MAX_TICKS], restoredHashes[MAX_TICKS];
+	GameCollisionStats stats;
+	uint32_t tests = 0, testsEveryPair = 0, steps = 0;
+	uint16_t ticks, restoredTicks, tick;
+
+	game_set_quiet(1);
+	for(uint32_t seed = 1; seed <= GAMES; seed++) {
+		ticks = play(seed, 0, hashes);
+		game_collision_stats(&stats);
+		check(stats.errors == 0, "impacts agree with sweeping", seed);
+		tests += stats.tests;
+		testsEveryPair += stats.testsEveryPair;
+		steps += stats.steps;
+
+		restoredTicks = play(seed, SNAPSHOT_TICKS, restoredHashes);
+		for(tick = 0; tick < ticks && tick < restoredTicks; tick++) {
+			if(hashes[tick] != restoredHashes[tick]) {
+				break;
+			}
+		}
+		check(ticks == restoredTicks && tick == ticks,
+				"game carries on the same after restoring snapshots", seed);
+	}
+	printf("%u games, %lu steps: %.1f collision tests per step planned, "
+			"%.1f testing every pair\n", GAMES, (unsigned long)steps,
+			(double)tests / steps, (double)testsEveryPair / steps);
+	if(failures) {
+		fprintf(stderr, "%u checks failed\n", failures);
+		return 1;
+	}
+	printf("collisions: all checks passed\n");
+	return 0;
+}
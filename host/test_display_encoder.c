@@ -0,0 +1,139 @@
+/*
+ * test_display_encoder.c
+ *
+ * Checks that display_encoder_flush() leaves the LED matrix showing
+ * the next frame, whichever mix of commands it picks. Frames with
+ * different kinds of change (a few pixels, whole rows and columns,
+ * everything moved one column left or right as when the asteroids
+ * descend, everything different) are flushed one after another. The
+ * SPI bytes sent are written to standard output with what each panel
+ * should then show, for matrix_emulator.py to decode and check (see
+ * the test target in host/Makefile).
+ *
+ * The program itself checks that the encoder's copy of what is shown
+ * matches the next frame, and exits with status 1 if not.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "host.h"
+#include "display_encoder.h"
+#include "framebuffer.h"
+#include "ledmatrix.h"
+
+// Frames of each kind
+#define ROUNDS 40
+
+static FramePalette palette;
+static PackedFrame shown, next;
+static uint32_t random = 1;
+static uint8_t failures;
+
+static uint8_t random_byte(void) {
+	random = random * 1103515245 + 12345;
+	return (uint8_t)(random >> 16);
+}
+
+static uint8_t random_index(void) {
+	return random_byte() % FRAME_PALETTE_SIZE;
+}
+
+// Move the whole of "next" one column left (direction -1) or right (1),
+// filling the column moved in with a new pattern
+static void move_sideways(int8_t direction) {
+	PackedFrame moved;
+	for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+		int16_t from = x - direction;
+		for(uint8_t y = 0; y < MATRIX_NUM_ROWS; y++) {
+			frame_set_pixel(moved, x, y, from >= 0 && from < MATRIX_NUM_COLUMNS ?
+					frame_get_pixel(next, from, y) : random_index());
+		}
+	}
+	frame_copy(moved, next);
+}
+
+// Send the changes from "shown" to "next" and record what each panel
+// should now show
+static void flush(const char* description) {
+	uint8_t colours[PANEL_NUM_ROWS * PANEL_NUM_COLUMNS];
+
+	display_encoder_flush(shown, next, palette);
+	if(memcmp(shown, next, sizeof(PackedFrame))) {
+		fprintf(stderr, "%s: shown frame doesn't match the next frame\n", description);
+		failures++;
+	}
+	for(uint8_t panel = 0; panel < LEDMATRIX_NUM_PANELS; panel++) {
+		uint8_t x0 = (panel % LEDMATRIX_PANELS_X) * PANEL_NUM_COLUMNS;
+		uint8_t y0 = (panel / LEDMATRIX_PANELS_X) * PANEL_NUM_ROWS;
+		for(uint8_t y = 0; y < PANEL_NUM_ROWS; y++) {
+			for(uint8_t x = 0; x < PANEL_NUM_COLUMNS; x++) {
+				colours[y * PANEL_NUM_COLUMNS + x] =
+						palette[frame_get_pixel(next, x0 + x, y0 + y)];
+			}
+		}
+		host_capture_expect(panel, colours);
+	}
+	printf("# %s\n", description);
+	host_capture_frame();
+}
+
+int main(void) {
+	uint8_t round, i, x, y;
+
+	// Every index a different colour, except that 0 and 1 are both
+	// black - so some changes of index don't change the display
+	for(i = 0; i < FRAME_PALETTE_SIZE; i++) {
+		palette[i] = i < 2 ? 0 : (uint8_t)(i * 0x11 + 0x21);
+	}
+
+	host_capture_to(stdout);
+	ledmatrix_setup();
+	ledmatrix_clear();
+	frame_fill(shown, 0);
+	frame_fill(next, 0);
+	host_capture_frame();
+
+	for(round = 0; round < ROUNDS; round++) {
+		// A few pixels
+		for(i = random_byte() % 6; i > 0; i--) {
+			frame_set_pixel(next, random_byte() % MATRIX_NUM_COLUMNS,
+					random_byte() % MATRIX_NUM_ROWS, random_index());
+		}
+		flush("pixels");
+
+		// A whole column and a whole row
+		x = random_byte() % MATRIX_NUM_COLUMNS;
+		y = random_byte() % MATRIX_NUM_ROWS;
+		for(i = 0; i < MATRIX_NUM_ROWS; i++) {
+			frame_set_pixel(next, x, i, random_index());
+		}
+		for(i = 0; i < MATRIX_NUM_COLUMNS; i++) {
+			frame_set_pixel(next, i, y, random_index());
+		}
+		flush("row and column");
+
+		// Everything moved sideways, with and without a few other
+		// changes
+		move_sideways(round & 1 ? 1 : -1);
+		flush("shift");
+		move_sideways(round & 1 ? -1 : 1);
+		frame_set_pixel(next, random_byte() % MATRIX_NUM_COLUMNS,
+				random_byte() % MATRIX_NUM_ROWS, random_index());
+		flush("shift and a pixel");
+
+		// Nothing at all
+		flush("no change");
+
+		// Everything
+		for(x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+			for(y = 0; y < MATRIX_NUM_ROWS; y++) {
+				frame_set_pixel(next, x, y, random_index());
+			}
+		}
+		flush("everything");
+	}
+	fflush(stdout);
+	return failures ? 1 : 0;
+}
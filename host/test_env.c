@@ -0,0 +1,112 @@
+/*
+ * test_env.c
+ *
+ * Checks that training environments (see env.h) with games of their
+ * own don't disturb each other. Each environment is played alone from
+ * its seed with pseudo-random actions, then all are played again
+ * stepped in turn - every environment must go through exactly the same
+ * rewards and observations both times. boardGame must be left as it
+ * was, and be played again on closing. Exits with status 1 if any check
+ * fails.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "host.h"
+#include "env.h"
+#include "ledmatrix.h"
+
+#define ENVS			4
+#define MAX_STEPS		3000
+
+static uint8_t failures;
+
+static void check(uint8_t ok, const char* description, uint8_t env) {
+	if(!ok) {
+		fprintf(stderr, "FAIL: %s (environment %u)\n", description, env);
+		failures++;
+	}
+}
+
+// A hash of the reward and the environment's observation
+static uint32_t observation_hash(const GameEnv* env, int16_t reward) {
+	uint32_t hash = 2166136261u;
+	for(uint8_t type = 0; type < ENTITY_TYPES; type++) {
+		const FieldRowMask* board = env_observation(env, type);
+		for(uint8_t y = 0; y < FIELD_HEIGHT; y++) {
+			hash = (hash ^ board[y]) * 16777619u;
+		}
+	}
+	hash = (hash ^ (uint8_t)env_base_position(env)) * 16777619u;
+	return (hash ^ (uint16_t)reward) * 16777619u;
+}
+
+// The action for the given step of an environment
+static uint8_t action(uint8_t env, uint16_t step) {
+	uint32_t random = (env + 1) * 2654435761u + step * 40503u;
+	return (uint8_t)(random >> 13) & 0x07;
+}
+
+int main(void) {
+	static GameState games[ENVS];
+	static uint32_t hashes[ENVS][MAX_STEPS];
+	static uint16_t steps[ENVS];
+	GameEnv envs[ENVS];
+	GameState before;
+	uint32_t total = 0;
+	uint8_t i, running;
+	uint16_t step;
+	int16_t reward;
+
+	// env_close() draws boardGame on the display
+	ledmatrix_setup();
+	before = boardGame;
+	for(i = 0; i < ENVS; i++) {
+		env_init(&envs[i], &games[i]);
+	}
+
+	// Each environment alone
+	for(i = 0; i < ENVS; i++) {
+		env_reset(&envs[i], i + 1);
+		for(step = 0; step < MAX_STEPS && !envs[i].done; step++) {
+			reward = env_step(&envs[i], action(i, step));
+			hashes[i][step] = observation_hash(&envs[i], reward);
+		}
+		steps[i] = step;
+	}
+
+	// All of them in turn
+	for(i = 0; i < ENVS; i++) {
+		env_reset(&envs[i], i + 1);
+	}
+	for(step = 0, running = 1; step < MAX_STEPS && running; step++) {
+		running = 0;
+		for(i = 0; i < ENVS; i++) {
+			if(envs[i].done) {
+				continue;
+			}
+			reward = env_step(&envs[i], action(i, step));
+			check(step < steps[i] && hashes[i][step] == observation_hash(&envs[i], reward),
+					"same observations stepped in turn as alone", i);
+			running = 1;
+		}
+	}
+	for(i = 0; i < ENVS; i++) {
+		check(envs[i].steps == steps[i], "same episode length stepped in turn", i);
+		total += steps[i];
+	}
+
+	env_close();
+	check(gameState == &boardGame, "boardGame is played after closing", 0);
+	check(!memcmp(&before, &boardGame, sizeof(before)), "boardGame is left alone", 0);
+	printf("%u environments, %lu steps stepped in turn and alone\n", ENVS,
+			(unsigned long)total);
+	if(failures) {
+		fprintf(stderr, "%u checks failed\n", failures);
+		return 1;
+	}
+	printf("environments: all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,207 @@
+/*
+ * test_highscore.c
+ *
+ * Checks the high score table's use of the (simulated) EEPROM:
+ * - saves go to each slot in turn, so no byte is written much more
+ *   often than the others
+ * - a save cut short by a reset, after any number of bytes, leaves the
+ *   table from the save before
+ * - a copy whose CRC is wrong is not loaded
+ * - a save made while another is still being written waits for it,
+ *   then saves the whole table
+ * The EEPROM write-behind queue is run by host_eeprom_step(), a byte
+ * at a time. Exits with status 1 if any check fails.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "host.h"
+#include "highscore.h"
+#include "eeprom_queue.h"
+
+// Size of each copy of the table in the EEPROM
+#define SLOT_SIZE ((HIGHSCORE_EEPROM_END - HIGHSCORE_EEPROM_ADDRESS) / HIGHSCORE_SLOTS)
+
+// Number of saves made for the wear levelling check
+#define SAVES (HIGHSCORE_SLOTS * 4)
+
+static uint8_t failures;
+
+static void check(uint8_t ok, const char* description) {
+	if(!ok) {
+		fprintf(stderr, "FAIL: %s\n", description);
+		failures++;
+	}
+}
+
+// Let the EEPROM write everything in the queue
+static void finish_writes(void) {
+	while(host_eeprom_step()) {
+		;
+	}
+}
+
+// Copy the table, as it is in RAM
+static void get_table(HighScore table[HIGHSCORE_COUNT]) {
+	for(uint8_t i = 0; i < HIGHSCORE_COUNT; i++) {
+		table[i] = *highscore_get(i);
+	}
+}
+
+static uint8_t table_is(const HighScore table[HIGHSCORE_COUNT]) {
+	HighScore current[HIGHSCORE_COUNT];
+	get_table(current);
+	return !memcmp(current, table, sizeof(current));
+}
+
+static void check_wear_levelling(void) {
+	HighScore saved[HIGHSCORE_COUNT];
+	uint16_t most = 0;
+
+	host_eeprom_erase();
+	highscore_init();
+	check(highscore_get(0)->score == 0, "erased EEPROM gives an empty table");
+	for(uint8_t i = 1; i <= SAVES; i++) {
+		check(highscore_add("WEAR", 100 * i) == 0, "higher score goes to the top");
+		finish_writes();
+	}
+	for(uint16_t address = HIGHSCORE_EEPROM_ADDRESS; address < HIGHSCORE_EEPROM_END;
+			address++) {
+		if(hostEepromWrites[address] > most) {
+			most = hostEepromWrites[address];
+		}
+	}
+	printf("%u saves: at most %u writes to a byte\n", SAVES, most);
+	check(most <= SAVES / HIGHSCORE_SLOTS, "saves are spread over every slot");
+	for(uint8_t slot = 0; slot < HIGHSCORE_SLOTS; slot++) {
+		// The low byte of each slot's sequence number changes with
+		// every save to it
+		check(hostEepromWrites[HIGHSCORE_EEPROM_ADDRESS + slot * SLOT_SIZE] ==
+				SAVES / HIGHSCORE_SLOTS, "each slot is saved to in turn");
+	}
+
+	// The newest copy is loaded after a reset
+	get_table(saved);
+	highscore_init();
+	check(table_is(saved), "table is loaded again after a reset");
+	check(highscore_get(0)->score == 100 * SAVES, "newest copy is loaded");
+}
+
+static void check_torn_writes(void) {
+	static uint8_t before[E2END + 1], torn[E2END + 1];
+	HighScore old[HIGHSCORE_COUNT], new[HIGHSCORE_COUNT];
+	uint16_t needed, steps;
+
+	// Start from a saved table, and find out how many bytes the next
+	// save has to write
+	host_eeprom_erase();
+	highscore_init();
+	highscore_add("FIRST", 500);
+	finish_writes();
+	highscore_add("SECOND", 300);
+	finish_writes();
+	memcpy(before, hostEeprom, sizeof(before));
+	highscore_init();
+	get_table(old);
+	eeprom_queue_reset_counts();
+	highscore_add("TORN", 400);
+	finish_writes();
+	get_table(new);
+	needed = eeprom_queue_bytes_written();
+
+	// Reset after each number of steps. The first step starts the
+	// first byte, and each step after that finishes one.
+	for(steps = 1; steps <= needed + 1; steps++) {
+		memcpy(hostEeprom, before, sizeof(before));
+		highscore_init();
+		highscore_add("TORN", 400);
+		for(uint16_t i = 0; i < steps; i++) {
+			host_eeprom_step();
+		}
+		// What the EEPROM holds at the reset. (The queue is emptied
+		// so the next save starts afresh.)
+		memcpy(torn, hostEeprom, sizeof(torn));
+		finish_writes();
+		memcpy(hostEeprom, torn, sizeof(torn));
+		highscore_init();
+		if(steps - 1 < needed) {
+			check(table_is(old), "save cut short leaves the table before it");
+		} else {
+			check(table_is(new), "finished save is loaded");
+		}
+	}
+	printf("save of %u bytes cut short after each byte\n", needed);
+}
+
+static void check_crc(void) {
+	HighScore old[HIGHSCORE_COUNT];
+	uint16_t slot, newest;
+
+	host_eeprom_erase();
+	highscore_init();
+	highscore_add("OLD", 10);
+	finish_writes();
+	get_table(old);
+	highscore_add("NEW", 20);
+	finish_writes();
+	// The second save went to slot 1
+	newest = HIGHSCORE_EEPROM_ADDRESS + SLOT_SIZE;
+
+	// Any one bit wrong in the newest copy (including its CRC) means
+	// the copy before it is loaded
+	for(uint16_t offset = 0; offset < SLOT_SIZE; offset++) {
+		for(uint8_t bit = 0; bit < 8; bit++) {
+			hostEeprom[newest + offset] ^= (1 << bit);
+			highscore_init();
+			check(table_is(old), "copy with a wrong CRC is not loaded");
+			hostEeprom[newest + offset] ^= (1 << bit);
+		}
+	}
+	highscore_init();
+	check(highscore_get(0)->score == 20, "good copy is loaded");
+
+	// With every copy wrong, the table is empty
+	for(slot = 0; slot < HIGHSCORE_SLOTS; slot++) {
+		hostEeprom[HIGHSCORE_EEPROM_ADDRESS + slot * SLOT_SIZE + 2] ^= 0x01;
+	}
+	highscore_init();
+	check(highscore_get(0)->score == 0, "no good copy gives an empty table");
+	printf("every bit of a copy changed in turn\n");
+}
+
+static void check_waiting_save(void) {
+	HighScore saved[HIGHSCORE_COUNT];
+
+	host_eeprom_erase();
+	highscore_init();
+	highscore_add("FIRST", 100);
+	highscore_add("SECOND", 200);
+	check(eeprom_queue_pending() == 1, "second save waits for the first");
+	finish_writes();
+	highscore_task();
+	check(eeprom_queue_pending() == 1, "waiting save is made after the first");
+	finish_writes();
+	highscore_task();
+	check(eeprom_queue_pending() == 0, "waiting save is only made once");
+	get_table(saved);
+	highscore_init();
+	check(table_is(saved), "table is loaded after a waiting save");
+	check(highscore_get(0)->score == 200 && highscore_get(1)->score == 100,
+			"both scores are saved");
+	printf("save made while another was being written\n");
+}
+
+int main(void) {
+	check_wear_levelling();
+	check_torn_writes();
+	check_crc();
+	check_waiting_save();
+	if(failures) {
+		fprintf(stderr, "%u checks failed\n", failures);
+		return 1;
+	}
+	printf("high score table: all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,284 @@
+/*
+ * test_netplay.c
+ *
+ * Plays linked games (see netplay.h) between two copies of the game,
+ * each in its own process with its end of the serial link on a pseudo
+ * terminal. This program sits between the two pseudo terminals and
+ * passes the bytes across - after a delay, or not at all - like a
+ * slow or broken cable. Each player gives pseudo-random input. The
+ * scenarios are:
+ * - lockstep: no delay, so the inputs arrive in time
+ * - rollback: each byte is held back for longer than the input delay
+ *   (NETPLAY_INPUT_DELAY ticks), so ticks are run on a guess of the
+ *   other player's input and run again when it arrives
+ * - desync: player 1's score is changed behind the game's back, so the
+ *   snapshot hashes differ
+ * - link lost: the bytes stop being passed on part way through
+ * Each player's netplay_report() is printed, and how both games ended
+ * is checked. Exits with status 1 if any scenario doesn't end as
+ * expected.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "host.h"
+#include "netplay.h"
+#include "serial_link.h"
+#include "game.h"
+#include "score.h"
+#include "ledmatrix.h"
+
+// How long each game is played for (ms), and the longest a scenario
+// can take
+#define PLAY_MS			3000
+#define SCENARIO_MS		(PLAY_MS + 3000)
+
+// Bytes on their way from one player to the other
+#define RELAY_SIZE		4096
+
+typedef struct {
+	const char*	name;
+	uint16_t	delay;		// ms each byte is held back
+	uint16_t	cutAt;		// ms after the start when bytes stop being
+							// passed on (0 for never)
+	uint16_t	desyncAt;	// ms after the start when player 1's score
+							// is changed (0 for never)
+	uint8_t		endStates;	// States (1 << NETPLAY_...) both games may
+							// end in
+	uint8_t		rollbacks;	// 1 if there must be rollbacks
+} Scenario;
+
+static const Scenario scenarios[] = {
+	{ "lockstep", 0, 0, 0, (1 << NETPLAY_RUNNING) | (1 << NETPLAY_FINISHED), 0 },
+	{ "rollback", 3 * NETPLAY_TICK_MS, 0, 0,
+			(1 << NETPLAY_RUNNING) | (1 << NETPLAY_FINISHED), 1 },
+	{ "desync", 0, 0, 1000, 1 << NETPLAY_DESYNC, 0 },
+	{ "link lost", 0, 500, 0, 1 << NETPLAY_LINK_LOST, 0 },
+};
+#define NUM_SCENARIOS (sizeof(scenarios) / sizeof(scenarios[0]))
+
+typedef struct {
+	uint8_t		bytes[RELAY_SIZE];
+	uint32_t	due[RELAY_SIZE];
+	uint16_t	head, tail;
+} Relay;
+
+static uint32_t now(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint32_t)(t.tv_sec * 1000 + t.tv_nsec / 1000000);
+}
+
+// Open a pseudo terminal, in raw mode. Returns the master's file
+// descriptor and puts the slave's in *slave, or returns -1.
+static int open_pty(int* slave) {
+	struct termios raw;
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if(master < 0 || grantpt(master) || unlockpt(master)) {
+		return -1;
+	}
+	*slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+	if(*slave < 0 || tcgetattr(*slave, &raw)) {
+		return -1;
+	}
+	cfmakeraw(&raw);
+	tcsetattr(*slave, TCSANOW, &raw);
+	return master;
+}
+
+// Play one side of the linked game, with the serial link on link, then
+// write the report and end state to result
+static void play(const Scenario* scenario, uint8_t player, int link, int result) {
+	static uint8_t snapshot[GAME_SNAPSHOT_MAX_BYTES];
+	uint32_t random = player + 1, start, nextInput;
+	int quiet = open("/dev/null", O_WRONLY);
+
+	// The game's own output (score and lives) isn't wanted
+	dup2(quiet, STDOUT_FILENO);
+	// The game draws on the display, as on the board
+	ledmatrix_setup();
+	host_link_to(link);
+	serial_link_init(19200);
+	start = now();
+	if(player == 0) {
+		netplay_offer(1234);
+	}
+	while(!netplay_poll(now())) {
+		if(now() - start > 2000) {
+			break;
+		}
+		usleep(1000);
+	}
+	if(netplay_state() == NETPLAY_AGREED) {
+		start = now();
+		netplay_start(start, snapshot);
+		nextInput = start;
+		while(netplay_state() == NETPLAY_RUNNING && now() - start < PLAY_MS) {
+			if((int32_t)(now() - nextInput) >= 0) {
+				random = random * 1103515245 + 12345;
+				netplay_input((uint8_t)(random >> 16) & 0x07);
+				nextInput += NETPLAY_TICK_MS;
+			}
+			netplay_task(now());
+			if(player == 1 && scenario->desyncAt && now() - start >= scenario->desyncAt) {
+				set_score(get_score() + 1);
+			}
+			usleep(1000);
+		}
+	}
+	fflush(stdout);
+	dup2(result, STDOUT_FILENO);
+	netplay_report();
+	printf("state %u\n", netplay_state());
+	fflush(stdout);
+}
+
+// Read the bytes waiting on from and queue them for the other player.
+// Returns 0 once the player has gone.
+static uint8_t relay_read(int from, Relay* relay, const Scenario* scenario,
+		uint32_t elapsed) {
+	uint8_t bytes[256];
+	ssize_t length = read(from, bytes, sizeof(bytes));
+	if(length <= 0) {
+		return 0;
+	}
+	if(scenario->cutAt && elapsed >= scenario->cutAt) {
+		return 1;
+	}
+	for(ssize_t i = 0; i < length; i++) {
+		relay->bytes[relay->head] = bytes[i];
+		relay->due[relay->head] = now() + scenario->delay;
+		relay->head = (relay->head + 1) % RELAY_SIZE;
+	}
+	return 1;
+}
+
+// Pass on the bytes which are due
+static void relay_write(int to, Relay* relay) {
+	while(relay->tail != relay->head && (int32_t)(now() - relay->due[relay->tail]) >= 0) {
+		if(write(to, &relay->bytes[relay->tail], 1) != 1) {
+			return;
+		}
+		relay->tail = (relay->tail + 1) % RELAY_SIZE;
+	}
+}
+
+// Read a player's result, print it and return the state the game ended
+// in. The number of rollbacks is put in *rollbacks.
+static uint8_t read_result(int from, uint8_t player, unsigned* rollbacks) {
+	char text[1024], *line;
+	ssize_t length = read(from, text, sizeof(text) - 1);
+	unsigned state = NETPLAY_OFF;
+
+	*rollbacks = 0;
+	text[length > 0 ? length : 0] = 0;
+	for(line = strtok(text, "\n"); line; line = strtok(0, "\n")) {
+		printf("  player %u: %s\n", player, line);
+		sscanf(line, "Linked game: player %*u, %*u ticks, %u rollbacks", rollbacks);
+		sscanf(line, "state %u", &state);
+	}
+	return (uint8_t)state;
+}
+
+static uint8_t run_scenario(const Scenario* scenario) {
+	static Relay relays[2];
+	int master[2], slave[2], result[2][2];
+	pid_t pid[2];
+	uint8_t running[2] = { 1, 1 }, ok = 1, player, state;
+	unsigned rollbacks, mostRollbacks = 0;
+	uint32_t start;
+
+	printf("%s\n", scenario->name);
+	fflush(stdout);
+	for(player = 0; player < 2; player++) {
+		master[player] = open_pty(&slave[player]);
+		if(master[player] < 0 || pipe(result[player])) {
+			perror("pseudo terminal");
+			return 0;
+		}
+		relays[player].head = relays[player].tail = 0;
+	}
+	for(player = 0; player < 2; player++) {
+		pid[player] = fork();
+		if(pid[player] == 0) {
+			play(scenario, player, slave[player], result[player][1]);
+			_exit(0);
+		}
+		close(slave[player]);
+		close(result[player][1]);
+		fcntl(master[player], F_SETFL, fcntl(master[player], F_GETFL) | O_NONBLOCK);
+	}
+
+	// Pass the bytes between the players until both have finished
+	start = now();
+	while(running[0] || running[1]) {
+		struct pollfd fds[2] = {
+			{ master[0], POLLIN, 0 }, { master[1], POLLIN, 0 }
+		};
+		poll(fds, 2, 1);
+		for(player = 0; player < 2; player++) {
+			if(running[player] && (fds[player].revents & POLLIN)) {
+				relay_read(master[player], &relays[player], scenario, now() - start);
+			}
+			relay_write(master[1 - player], &relays[player]);
+			if(running[player] && waitpid(pid[player], 0, WNOHANG) == pid[player]) {
+				running[player] = 0;
+			}
+		}
+		if(now() - start > SCENARIO_MS) {
+			for(player = 0; player < 2; player++) {
+				if(running[player]) {
+					kill(pid[player], SIGKILL);
+					waitpid(pid[player], 0, 0);
+					running[player] = 0;
+				}
+			}
+			printf("  took too long\n");
+			ok = 0;
+		}
+	}
+
+	for(player = 0; player < 2; player++) {
+		state = read_result(result[player][0], player, &rollbacks);
+		if(!(scenario->endStates & (1 << state))) {
+			printf("  FAIL: player %u ended in state %u\n", player, state);
+			ok = 0;
+		}
+		if(rollbacks > mostRollbacks) {
+			mostRollbacks = rollbacks;
+		}
+		close(result[player][0]);
+		close(master[player]);
+	}
+	if(scenario->rollbacks && !mostRollbacks) {
+		printf("  FAIL: no rollbacks\n");
+		ok = 0;
+	}
+	return ok;
+}
+
+int main(void) {
+	uint8_t failures = 0;
+
+	for(uint8_t i = 0; i < NUM_SCENARIOS; i++) {
+		if(!run_scenario(&scenarios[i])) {
+			failures++;
+		}
+	}
+	if(failures) {
+		printf("%u scenarios failed\n", failures);
+		return 1;
+	}
+	printf("linked games: all scenarios passed\n");
+	return 0;
+}
@@ -0,0 +1,81 @@
+/*
+ * test_scrolling_display.c
+ *
+ * Checks that a message scrolled with scroll_display() moves across
+ * the whole display, from one panel to the next, rather than each
+ * panel scrolling on its own. After each column is shifted in, the
+ * SPI bytes sent are written to standard output with what each panel
+ * should then show, for matrix_emulator.py to decode and check (see
+ * the test target in host/Makefile).
+ *
+ * What should be shown is worked out from the message's font data,
+ * which scrolling_char_display.c keeps in the cache it is given.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <avr/pgmspace.h>
+#include "host.h"
+#include "ledmatrix.h"
+#include "scrolling_char_display.h"
+
+#define MESSAGE_COLOUR 0x0F
+
+static uint8_t cache[255];
+
+// The font data of the column scrolled in by the given shift (counting
+// from 1). The cache holds the message up to the point where its end
+// has been shifted in - the rest of it is blank, as are the columns
+// after the message.
+static uint8_t font_column(int16_t shift) {
+	if(shift < 1 || shift > sizeof(cache)) {
+		return 0;
+	}
+	return cache[shift - 1];
+}
+
+// Record what each panel should show after the given number of shifts
+static void expect(int16_t shifts) {
+	uint8_t colours[PANEL_NUM_ROWS * PANEL_NUM_COLUMNS];
+
+	for(uint8_t panel = 0; panel < LEDMATRIX_NUM_PANELS; panel++) {
+		uint8_t x0 = (panel % LEDMATRIX_PANELS_X) * PANEL_NUM_COLUMNS;
+		uint8_t y0 = (panel / LEDMATRIX_PANELS_X) * PANEL_NUM_ROWS;
+		for(uint8_t x = 0; x < PANEL_NUM_COLUMNS; x++) {
+			// The right hand column shows the latest shift
+			uint8_t font = font_column(shifts - (MATRIX_NUM_COLUMNS - 1 - (x0 + x)));
+			for(uint8_t y = 0; y < PANEL_NUM_ROWS; y++) {
+				// Only the bottom 8 rows are used, and not row 0
+				uint8_t row = y0 + y;
+				uint8_t lit = row >= 1 && row <= 7 && (font & (1 << row));
+				colours[y * PANEL_NUM_COLUMNS + x] = lit ? MESSAGE_COLOUR : 0;
+			}
+		}
+		host_capture_expect(panel, colours);
+	}
+	host_capture_frame();
+}
+
+int main(void) {
+	int16_t shifts = 0;
+
+	host_capture_to(stdout);
+	ledmatrix_setup();
+	ledmatrix_clear();
+	host_capture_frame();
+
+	scrolling_display_set_cache(cache, sizeof(cache));
+	set_scrolling_display_text_P(PSTR("SCROLL 42"), MESSAGE_COLOUR);
+	while(scroll_display()) {
+		printf("# shift %d\n", ++shifts);
+		expect(shifts);
+	}
+	fflush(stdout);
+	// The message has to be shifted all the way across
+	if(shifts <= MATRIX_NUM_COLUMNS) {
+		fprintf(stderr, "message stopped after %d shifts\n", shifts);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,121 @@
+/*
+ * idle.c
+ *
+ * Sleeping while there is nothing to do - see idle.h
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <avr/sleep.h>
+
+#include "idle.h"
+#include "buttons.h"
+#include "serialio.h"
+#include "timer0.h"
+
+/* cpu_asleep is 1 while the main loop is sleeping. It is sampled by
+ * the timer interrupt handler (which runs before the main loop gets
+ * the chance to clear it) so we know how many ticks were spent asleep.
+ * In tickless mode ticks_asleep is the total length (ms) of the sleeps
+ * and ticks_sampled is worked out from stats_start_time.
+ */
+static volatile uint8_t cpu_asleep;
+static volatile uint32_t ticks_sampled;
+static volatile uint32_t ticks_asleep;
+static uint32_t wakeups;
+#ifdef TIMER0_TICKLESS
+static uint32_t stats_start_time;
+#endif
+
+static uint8_t input_waiting(void) {
+	return button_push_available() || serial_input_available();
+}
+
+/* Go to sleep unless there is input waiting. Interrupts are turned
+ * off while we check so that input arriving between the check and
+ * going to sleep will still wake us. (The instruction after sei() is
+ * always executed before any pending interrupt is handled.)
+ */
+static void sleep_once(void) {
+#ifdef TIMER0_TICKLESS
+	uint32_t sleep_start_time;
+#endif
+	cli();
+	if(input_waiting()) {
+		sei();
+		return;
+	}
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	sleep_enable();
+	cpu_asleep = 1;
+#ifdef TIMER0_TICKLESS
+	sleep_start_time = get_current_time();
+#endif
+	sei();
+	sleep_cpu();
+	cpu_asleep = 0;
+	sleep_disable();
+#ifdef TIMER0_TICKLESS
+	ticks_asleep += get_current_time() - sleep_start_time;
+#endif
+	wakeups++;
+}
+
+void idle_until(uint32_t deadline) {
+	timer0_set_deadline(deadline);
+	while((int32_t)(get_current_time() - deadline) < 0 && !input_waiting()) {
+		sleep_once();
+	}
+}
+
+void idle_until_input(void) {
+	while(!input_waiting()) {
+		sleep_once();
+	}
+}
+
+void idle_tick(void) {
+	ticks_sampled++;
+	if(cpu_asleep) {
+		ticks_asleep++;
+	}
+}
+
+void idle_reset_stats(void) {
+	uint8_t interrupts_were_enabled = bit_is_set(SREG, SREG_I);
+	cli();
+	ticks_sampled = 0;
+	ticks_asleep = 0;
+	if(interrupts_were_enabled) {
+		sei();
+	}
+	wakeups = 0;
+#ifdef TIMER0_TICKLESS
+	stats_start_time = get_current_time();
+#endif
+}
+
+void idle_report(void) {
+	uint32_t sampled, asleep;
+	uint8_t interrupts_were_enabled = bit_is_set(SREG, SREG_I);
+	cli();
+#ifdef TIMER0_TICKLESS
+	ticks_sampled = get_current_time() - stats_start_time;
+#endif
+	sampled = ticks_sampled;
+	asleep = ticks_asleep;
+	if(interrupts_were_enabled) {
+		sei();
+	}
+	if(sampled == 0) {
+		return;
+	}
+	// Each tick is 1ms
+	printf_P(PSTR("CPU busy %lu%% (%lu of %lu ms), %lu wakeups/s\n"),
+			((sampled - asleep) * 100) / sampled, sampled - asleep, sampled,
+			(wakeups * 1000) / sampled);
+}
@@ -0,0 +1,38 @@
+/*
+ * idle.h
+ *
+ * Putting the CPU to sleep (in idle mode) while the main loop has
+ * nothing to do. The CPU is woken by any interrupt - the timer tick,
+ * a button push, serial input etc. - and goes back to sleep if the
+ * thing it is waiting for has not happened yet.
+ *
+ * The fraction of time spent asleep is sampled on each timer tick so
+ * that the CPU duty cycle and the number of wakeups per second can
+ * be reported. In tickless mode (see timer0.h) there is no tick to
+ * sample on, so the length of each sleep is measured instead.
+ */
+
+#ifndef IDLE_H_
+#define IDLE_H_
+
+#include <stdint.h>
+
+// Sleep until the given time (as returned by get_current_time())
+// has been reached or there is button or serial input waiting to be
+// read - whichever comes first.
+void idle_until(uint32_t deadline);
+
+// Sleep until there is button or serial input waiting to be read
+void idle_until_input(void);
+
+// Called from the timer interrupt handler on every tick to sample
+// whether the CPU is asleep
+void idle_tick(void);
+
+// Clear the duty cycle statistics
+void idle_reset_stats(void);
+
+// Print the CPU duty cycle and wakeup rate to standard output
+void idle_report(void);
+
+#endif /* IDLE_H_ */
@@ -0,0 +1,170 @@
+/*
+ * latency.c
+ *
+ * Input-to-display latency probe - see latency.h
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#include "latency.h"
+#include "timer0.h"
+
+/* Statistics kept for each input source. The sum is kept so that the
+ * mean can be calculated when the report is printed.
+ */
+typedef struct {
+	uint16_t count;
+	uint32_t min;
+	uint32_t max;
+	uint32_t sum;
+	uint16_t buckets[LATENCY_NUM_BUCKETS];
+} LatencyStats;
+
+static LatencyStats stats[LATENCY_NUM_SOURCES];
+
+/* Arrival time of the oldest unhandled input from each source. The
+ * corresponding bit in pending_mask is set if the time is valid. These
+ * are written by interrupt handlers.
+ */
+static volatile uint32_t pending_time[LATENCY_NUM_SOURCES];
+static volatile uint8_t pending_mask;
+
+/* The input currently being acted on by the main loop.
+ * current_source is -1 if there is no input being acted on (or if
+ * the input being acted on was not timestamped).
+ */
+static int8_t current_source = -1;
+static uint32_t current_input_time;
+static uint32_t current_done_time;
+static uint8_t current_tagged;
+
+static PGM_P const source_names[LATENCY_NUM_SOURCES] PROGMEM = {
+	"Button", "Serial", "Joystick"
+};
+
+void latency_reset(void) {
+	uint8_t interrupts_were_enabled = bit_is_set(SREG, SREG_I);
+	cli();
+	pending_mask = 0;
+	if(interrupts_were_enabled) {
+		sei();
+	}
+	for(uint8_t i = 0; i < LATENCY_NUM_SOURCES; i++) {
+		stats[i].count = 0;
+		stats[i].min = UINT32_MAX;
+		stats[i].max = 0;
+		stats[i].sum = 0;
+		for(uint8_t b = 0; b < LATENCY_NUM_BUCKETS; b++) {
+			stats[i].buckets[b] = 0;
+		}
+	}
+	current_source = -1;
+}
+
+void latency_input_event(uint8_t source) {
+	uint8_t interrupts_were_enabled = bit_is_set(SREG, SREG_I);
+	cli();
+	if(!(pending_mask & (1 << source))) {
+		// No unhandled input from this source - remember this one
+		pending_time[source] = get_current_time_us();
+		pending_mask |= (1 << source);
+	}
+	if(interrupts_were_enabled) {
+		sei();
+	}
+}
+
+void latency_input_begin(uint8_t source) {
+	uint8_t interrupts_were_enabled = bit_is_set(SREG, SREG_I);
+	cli();
+	if(pending_mask & (1 << source)) {
+		current_source = source;
+		current_input_time = pending_time[source];
+		pending_mask &= ~(1 << source);
+	} else {
+		current_source = -1;
+	}
+	if(interrupts_were_enabled) {
+		sei();
+	}
+	current_tagged = 0;
+}
+
+void latency_tag_state_change(void) {
+	if(current_source >= 0) {
+		current_tagged = 1;
+		// If nothing is sent to the display the latency is just the
+		// time taken to get to this point.
+		current_done_time = get_current_time_us();
+	}
+}
+
+void latency_display_sent(void) {
+	if(current_tagged) {
+		current_done_time = get_current_time_us();
+	}
+}
+
+void latency_input_end(void) {
+	if(current_source >= 0 && current_tagged) {
+		LatencyStats* s = &stats[current_source];
+		uint32_t latency = current_done_time - current_input_time;
+		uint8_t bucket = 0;
+
+		// Work out which power of two bucket this latency falls into
+		while((latency >> (bucket + LATENCY_FIRST_BUCKET_BITS)) &&
+				bucket < LATENCY_NUM_BUCKETS - 1) {
+			bucket++;
+		}
+		if(s->count < UINT16_MAX) {
+			s->count++;
+			s->sum += latency;
+			s->buckets[bucket]++;
+		}
+		if(latency < s->min) {
+			s->min = latency;
+		}
+		if(latency > s->max) {
+			s->max = latency;
+		}
+	}
+	current_source = -1;
+	current_tagged = 0;
+}
+
+void latency_report(void) {
+	for(uint8_t i = 0; i < LATENCY_NUM_SOURCES; i++) {
+		LatencyStats* s = &stats[i];
+		printf_P((PGM_P)pgm_read_word(&source_names[i]));
+		if(s->count == 0) {
+			printf_P(PSTR(": no samples\n"));
+			continue;
+		}
+		// The 99th percentile is reported as the upper limit of the
+		// bucket which contains it.
+		uint32_t threshold = ((uint32_t)s->count * 99 + 99) / 100;
+		uint32_t seen = 0;
+		uint8_t p99_bucket = 0;
+		for(uint8_t b = 0; b < LATENCY_NUM_BUCKETS; b++) {
+			seen += s->buckets[b];
+			if(seen >= threshold) {
+				p99_bucket = b;
+				break;
+			}
+		}
+		printf_P(PSTR(": n=%u min=%luus mean=%luus p99<%luus max=%luus\n"),
+				s->count, s->min, s->sum / s->count,
+				1UL << (p99_bucket + LATENCY_FIRST_BUCKET_BITS), s->max);
+		for(uint8_t b = 0; b < LATENCY_NUM_BUCKETS; b++) {
+			if(s->buckets[b]) {
+				printf_P(PSTR("  <%7lu us: %u\n"),
+						1UL << (b + LATENCY_FIRST_BUCKET_BITS), s->buckets[b]);
+			}
+		}
+	}
+}
@@ -0,0 +1,65 @@
+/*
+ * latency.h
+ *
+ * Input-to-display latency probe. An input is timestamped as soon as
+ * it arrives (at ISR entry for buttons and serial bytes, at sample
+ * time for the joystick). When the main loop acts on that input and
+ * the action changes the game state (move_base() or fire_projectile())
+ * the input is "tagged". Every SPI update sent to the LED matrix
+ * refreshes the completion time of a tagged input, so when the main
+ * loop has finished handling the input we know when the last byte of
+ * the resulting display change went out.
+ *
+ * Latencies (in microseconds, from get_current_time_us()) are
+ * accumulated per input source into min/max/mean figures and a
+ * power-of-two histogram which can be printed over serial with
+ * latency_report().
+ */
+
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+#include <stdint.h>
+
+// Input sources that can be measured
+#define LATENCY_SOURCE_BUTTON	0
+#define LATENCY_SOURCE_SERIAL	1
+#define LATENCY_SOURCE_JOYSTICK	2
+#define LATENCY_NUM_SOURCES		3
+
+// Number of histogram buckets. Bucket n counts latencies less than
+// 2^(n+5) us (and not counted in an earlier bucket), so the buckets
+// run from under 32us to under ~1s. The last bucket also collects
+// anything larger.
+#define LATENCY_NUM_BUCKETS		16
+#define LATENCY_FIRST_BUCKET_BITS	5
+
+// Clear all recorded statistics and any input in flight
+void latency_reset(void);
+
+// Record the arrival of an input from the given source. Safe to call
+// from an interrupt handler. Only the oldest unhandled input from
+// each source is remembered.
+void latency_input_event(uint8_t source);
+
+// Called by the main loop when it starts acting on an input from
+// the given source.
+void latency_input_begin(uint8_t source);
+
+// Called by the game when the input being acted on changed the
+// game state (and so will result in a display change).
+void latency_tag_state_change(void);
+
+// Called by the LED matrix driver when it has finished sending a
+// display update over SPI.
+void latency_display_sent(void);
+
+// Called by the main loop when it has finished acting on the input
+// passed to latency_input_begin(). If the input was tagged, the
+// latency is recorded, otherwise the input is discarded.
+void latency_input_end(void);
+
+// Print the statistics for each input source to standard output
+void latency_report(void);
+
+#endif /* LATENCY_H_ */
@@ -2,13 +2,19 @@
  * ledmatrix.c
  *
  * Author: Peter Sutton
- * 
+ *
  * See the LED matrix Reference for details of the SPI commands used.
- */ 
+ *
+ * Each command is sent to one panel, selected by taking its slave
+ * select pin low. Commands for the whole display are sent to each of
+ * the panels involved, using that panel's own x and y.
+ */
 
 #include <avr/io.h>
+#include <avr/interrupt.h>
 #include "ledmatrix.h"
 #include "spi.h"
+#include "latency.h"
 
 #define CMD_UPDATE_ALL 0x00
 #define CMD_UPDATE_PIXEL 0x01
@@ -17,20 +23,95 @@
 #define CMD_SHIFT_DISPLAY 0x04
 #define CMD_CLEAR_SCREEN 0x0F
 
+// Port and pin mask of each panel's slave select pin (see
+// LEDMATRIX_SS_PINS_B and _A in ledmatrix.h), set by ledmatrix_setup()
+static volatile uint8_t* panelSelectPort[LEDMATRIX_NUM_PANELS];
+static uint8_t panelSelectPin[LEDMATRIX_NUM_PANELS];
+
+// The panel which is selected, and the bytes sent to each panel
+static uint8_t selectedPanel;
+static uint32_t panelBytes[LEDMATRIX_NUM_PANELS];
+
+// Select the given panel (and deselect the others). Each byte is sent
+// before spi_send_byte() returns, so the panel can be changed between
+// any two bytes.
+static void select_panel(uint8_t panel) {
+	if(panel == selectedPanel) {
+		return;
+	}
+	// Port A is also changed by the seven segment display interrupt
+	uint8_t interruptsOn = bit_is_set(SREG, SREG_I);
+	cli();
+	*panelSelectPort[selectedPanel] |= panelSelectPin[selectedPanel];
+	*panelSelectPort[panel] &= ~panelSelectPin[panel];
+	if(interruptsOn) {
+		sei();
+	}
+	selectedPanel = panel;
+}
+
+// Send a byte to the selected panel
+static void send(uint8_t byte) {
+	(void)spi_send_byte(byte);
+	panelBytes[selectedPanel]++;
+}
+
+// Panel number for the panel showing (x,y)
+static uint8_t panel_at(uint8_t x, uint8_t y) {
+	return (y / PANEL_NUM_ROWS) * LEDMATRIX_PANELS_X + x / PANEL_NUM_COLUMNS;
+}
+
+// Send a command with a single argument to every panel
+static void send_to_all(uint8_t command, uint8_t argument) {
+	for(uint8_t panel = 0; panel < LEDMATRIX_NUM_PANELS; panel++) {
+		select_panel(panel);
+		send(command);
+		send(argument);
+	}
+}
+
 void ledmatrix_setup(void) {
 	// Setup SPI - we divide the clock by 128.
 	// (This speed guarantees the SPI buffer will never overflow on
 	// the LED matrix.)
 	spi_setup_master(128);
+	// spi_setup_master() has selected panel 0 (SS low). Make the other
+	// panels' slave select pins outputs and take them high.
+	uint8_t panel = 0;
+	panelSelectPort[panel] = &PORTB;
+	panelSelectPin[panel++] = (1 << 4);
+	for(uint8_t pin = 0x80; pin; pin >>= 1) {
+		if(LEDMATRIX_SS_PINS_B & pin) {
+			PORTB |= pin;
+			DDRB |= pin;
+			panelSelectPort[panel] = &PORTB;
+			panelSelectPin[panel++] = pin;
+		}
+	}
+	for(uint8_t pin = 0x80; pin; pin >>= 1) {
+		if(LEDMATRIX_SS_PINS_A & pin) {
+			PORTA |= pin;
+			DDRA |= pin;
+			panelSelectPort[panel] = &PORTA;
+			panelSelectPin[panel++] = pin;
+		}
+	}
+	selectedPanel = 0;
 }
 
 void ledmatrix_update_all(MatrixData data) {
-	(void)spi_send_byte(CMD_UPDATE_ALL);
-	for(uint8_t y=0; y<MATRIX_NUM_ROWS; y++) {
-		for(uint8_t x=0; x<MATRIX_NUM_COLUMNS; x++) {
-			(void)spi_send_byte(data[x][y]);
+	for(uint8_t panel = 0; panel < LEDMATRIX_NUM_PANELS; panel++) {
+		uint8_t x0 = (panel % LEDMATRIX_PANELS_X) * PANEL_NUM_COLUMNS;
+		uint8_t y0 = (panel / LEDMATRIX_PANELS_X) * PANEL_NUM_ROWS;
+		select_panel(panel);
+		send(CMD_UPDATE_ALL);
+		for(uint8_t y=0; y<PANEL_NUM_ROWS; y++) {
+			for(uint8_t x=0; x<PANEL_NUM_COLUMNS; x++) {
+				send(data[x0+x][y0+y]);
+			}
 		}
 	}
+	latency_display_sent();
 }
 
 void ledmatrix_update_pixel(uint8_t x, uint8_t y, PixelColour pixel) {
@@ -38,9 +119,11 @@ void ledmatrix_update_pixel(uint8_t x, uint8_t y, PixelColour pixel) {
 		// Position isn't valid - we ignore the request.
 		return;
 	}
-	(void)spi_send_byte(CMD_UPDATE_PIXEL);
-	(void)spi_send_byte( ((y & 0x07)<<4) | (x & 0x0F));
-	(void)spi_send_byte(pixel);
+	select_panel(panel_at(x, y));
+	send(CMD_UPDATE_PIXEL);
+	send( ((y & 0x07)<<4) | (x & 0x0F));
+	send(pixel);
+	latency_display_sent();
 }
 
 void ledmatrix_update_row(uint8_t y, MatrixRow row) {
@@ -48,11 +131,15 @@ void ledmatrix_update_row(uint8_t y, MatrixRow row) {
 		// y value is too large - we ignore the request
 		return;
 	}
-	(void)spi_send_byte(CMD_UPDATE_ROW);
-	(void)spi_send_byte(y & 0x07);	// row number
-	for(uint8_t x = 0; x<MATRIX_NUM_COLUMNS; x++) {
-		(void)spi_send_byte(row[x]);
+	for(uint8_t x0 = 0; x0 < MATRIX_NUM_COLUMNS; x0 += PANEL_NUM_COLUMNS) {
+		select_panel(panel_at(x0, y));
+		send(CMD_UPDATE_ROW);
+		send(y & 0x07);	// row number
+		for(uint8_t x = x0; x<x0+PANEL_NUM_COLUMNS; x++) {
+			send(row[x]);
+		}
 	}
+	latency_display_sent();
 }
 
 void ledmatrix_update_column(uint8_t x, MatrixColumn col) {
@@ -60,35 +147,102 @@ void ledmatrix_update_column(uint8_t x, MatrixColumn col) {
 		// x value is too large - we ignore the request
 		return;
 	}
-	(void)spi_send_byte(CMD_UPDATE_COL);
-	(void)spi_send_byte(x & 0x0F); // column number
-	for(uint8_t y = 0; y<MATRIX_NUM_ROWS; y++) {
-		(void)spi_send_byte(col[y]);
+	for(uint8_t y0 = 0; y0 < MATRIX_NUM_ROWS; y0 += PANEL_NUM_ROWS) {
+		select_panel(panel_at(x, y0));
+		send(CMD_UPDATE_COL);
+		send(x & 0x0F); // column number
+		for(uint8_t y = y0; y<y0+PANEL_NUM_ROWS; y++) {
+			send(col[y]);
+		}
 	}
+	latency_display_sent();
 }
 
 void ledmatrix_shift_display_left(void) {
-	(void)spi_send_byte(CMD_SHIFT_DISPLAY);
-	(void)spi_send_byte(0x02);
+	send_to_all(CMD_SHIFT_DISPLAY, 0x02);
 }
 
 void ledmatrix_shift_display_right(void) {
-	(void)spi_send_byte(CMD_SHIFT_DISPLAY);
-	(void)spi_send_byte(0x01);
+	send_to_all(CMD_SHIFT_DISPLAY, 0x01);
 }
 
 void ledmatrix_shift_display_up(void) {
-	(void)spi_send_byte(CMD_SHIFT_DISPLAY);
-	(void)spi_send_byte(0x08);
+	send_to_all(CMD_SHIFT_DISPLAY, 0x08);
 }
 
 void ledmatrix_shift_display_down(void) {
-	(void)spi_send_byte(CMD_SHIFT_DISPLAY);
-	(void)spi_send_byte(0x04);
+	send_to_all(CMD_SHIFT_DISPLAY, 0x04);
 }
 
 void ledmatrix_clear(void) {
-	(void)spi_send_byte(CMD_CLEAR_SCREEN);
+	for(uint8_t panel = 0; panel < LEDMATRIX_NUM_PANELS; panel++) {
+		select_panel(panel);
+		send(CMD_CLEAR_SCREEN);
+	}
+}
+
+void ledmatrix_update_all_packed(PackedFrame frame, FramePalette palette) {
+	for(uint8_t panel = 0; panel < LEDMATRIX_NUM_PANELS; panel++) {
+		uint8_t x0 = (panel % LEDMATRIX_PANELS_X) * PANEL_NUM_COLUMNS;
+		uint8_t y0 = (panel / LEDMATRIX_PANELS_X) * PANEL_NUM_ROWS;
+		select_panel(panel);
+		send(CMD_UPDATE_ALL);
+		for(uint8_t y=y0; y<y0+PANEL_NUM_ROWS; y++) {
+			for(uint8_t x=x0; x<x0+PANEL_NUM_COLUMNS; x++) {
+				send(palette[PACKED_PIXEL(frame, x, y)]);
+			}
+		}
+	}
+	latency_display_sent();
+}
+
+void ledmatrix_update_row_packed(uint8_t y, PackedFrame frame, FramePalette palette) {
+	if(y >= MATRIX_NUM_ROWS) {
+		// y value is too large - we ignore the request
+		return;
+	}
+	for(uint8_t x0 = 0; x0 < MATRIX_NUM_COLUMNS; x0 += PANEL_NUM_COLUMNS) {
+		select_panel(panel_at(x0, y));
+		send(CMD_UPDATE_ROW);
+		send(y & 0x07);	// row number
+		for(uint8_t x = x0; x<x0+PANEL_NUM_COLUMNS; x++) {
+			send(palette[PACKED_PIXEL(frame, x, y)]);
+		}
+	}
+	latency_display_sent();
+}
+
+void ledmatrix_update_column_packed(uint8_t x, PackedFrame frame, FramePalette palette) {
+	if(x >= MATRIX_NUM_COLUMNS) {
+		// x value is too large - we ignore the request
+		return;
+	}
+	// Unpack the column a byte at a time, starting a new command at the
+	// bottom of each panel
+	uint8_t y = 0;
+	for(uint8_t i = 0; i<FRAME_BYTES_PER_COLUMN; i++) {
+		uint8_t pixels = frame[x][i];
+		for(uint8_t p = 0; p<FRAME_PIXELS_PER_BYTE; p++, y++) {
+			if(y % PANEL_NUM_ROWS == 0) {
+				select_panel(panel_at(x, y));
+				send(CMD_UPDATE_COL);
+				send(x & 0x0F); // column number
+			}
+			send(palette[pixels & (FRAME_PALETTE_SIZE - 1)]);
+			pixels >>= FRAME_BITS_PER_PIXEL;
+		}
+	}
+	latency_display_sent();
+}
+
+uint32_t ledmatrix_panel_bytes(uint8_t panel) {
+	return panel < LEDMATRIX_NUM_PANELS ? panelBytes[panel] : 0;
+}
+
+void ledmatrix_reset_counts(void) {
+	for(uint8_t panel = 0; panel < LEDMATRIX_NUM_PANELS; panel++) {
+		panelBytes[panel] = 0;
+	}
 }
 
 void copy_matrix_column(MatrixColumn from, MatrixColumn to) {
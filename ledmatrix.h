@@ -11,17 +11,121 @@
 #include <stdint.h>
 #include "pixel_colour.h"
 
-// The matrix has 16 columns (x ranges from 0 to 15, left to right) and 
-// 8 rows (y ranges from 0 to 7, bottom to top) - as per the X,Y
-// coordinates marked on the board.
-#define MATRIX_NUM_COLUMNS 16
-#define MATRIX_NUM_ROWS 8
+// Each LED matrix panel has 16 columns (x ranges from 0 to 15, left to
+// right) and 8 rows (y ranges from 0 to 7, bottom to top) - as per the
+// X,Y coordinates marked on the board.
+#define PANEL_NUM_COLUMNS 16
+#define PANEL_NUM_ROWS 8
+
+// Several panels can be used as one larger display - LEDMATRIX_PANELS_X
+// panels side by side and LEDMATRIX_PANELS_Y panels one above the other
+// (e.g. -DLEDMATRIX_PANELS_X=2 for a 32 by 8 display). Panel number p
+// is column (p % LEDMATRIX_PANELS_X) and row (p / LEDMATRIX_PANELS_X)
+// of panels, with panel 0 at the bottom left. Each panel has its own
+// slave select pin (see below). x and y below are positions on the
+// whole display.
+#ifndef LEDMATRIX_PANELS_X
+#define LEDMATRIX_PANELS_X 1
+#endif
+#ifndef LEDMATRIX_PANELS_Y
+#define LEDMATRIX_PANELS_Y 1
+#endif
+#define LEDMATRIX_NUM_PANELS (LEDMATRIX_PANELS_X * LEDMATRIX_PANELS_Y)
+#define MATRIX_NUM_COLUMNS (PANEL_NUM_COLUMNS * LEDMATRIX_PANELS_X)
+#define MATRIX_NUM_ROWS (PANEL_NUM_ROWS * LEDMATRIX_PANELS_Y)
+
+#if MATRIX_NUM_COLUMNS > 255 || MATRIX_NUM_ROWS > 16
+#error "Display too large - at most 255 columns and 16 rows"
+#endif
+
+// Slave select pins. Panel 0 uses the SPI SS pin (B4). The other panels
+// use the pins in LEDMATRIX_SS_PINS_B (port B) then LEDMATRIX_SS_PINS_A
+// (port A), each taken from the highest bit down - e.g. panel 1 is A7
+// with LEDMATRIX_SS_PINS_A 0x80. The rest of the board leaves only A7
+// free, so three or four panels also take the joystick's pins (A0 and
+// A1) and the joystick isn't read.
+#define LEDMATRIX_BUTTON_PINS_B		0x0F	// B0 to B3 (see buttons.c)
+#define LEDMATRIX_SPI_PINS_B		0xF0	// SS, MOSI, MISO and SCK
+#define LEDMATRIX_JOYSTICK_PINS_A	0x03	// ADC0 and ADC1 (see joy_stick())
+#define LEDMATRIX_LED_PINS_A		0x7C	// Digit select and lives LEDs
+#ifndef LEDMATRIX_SS_PINS_B
+#define LEDMATRIX_SS_PINS_B 0x00
+#endif
+#ifndef LEDMATRIX_SS_PINS_A
+#if LEDMATRIX_NUM_PANELS == 1
+#define LEDMATRIX_SS_PINS_A 0x00
+#elif LEDMATRIX_NUM_PANELS == 2
+#define LEDMATRIX_SS_PINS_A 0x80
+#else
+#define LEDMATRIX_SS_PINS_A 0x83
+#endif
+#endif
+
+#define LEDMATRIX_PIN_COUNT(pins) (((pins) & 1) + (((pins) >> 1) & 1) + \
+		(((pins) >> 2) & 1) + (((pins) >> 3) & 1) + (((pins) >> 4) & 1) + \
+		(((pins) >> 5) & 1) + (((pins) >> 6) & 1) + (((pins) >> 7) & 1))
+#if LEDMATRIX_SS_PINS_B & LEDMATRIX_BUTTON_PINS_B
+#error "A slave select pin is a button pin (B0 to B3)"
+#endif
+#if LEDMATRIX_SS_PINS_B & LEDMATRIX_SPI_PINS_B
+#error "A slave select pin is an SPI pin (B4 to B7)"
+#endif
+#if LEDMATRIX_SS_PINS_A & LEDMATRIX_LED_PINS_A
+#error "A slave select pin drives an LED (A2 to A6)"
+#endif
+#if LEDMATRIX_PIN_COUNT(LEDMATRIX_SS_PINS_B) + \
+		LEDMATRIX_PIN_COUNT(LEDMATRIX_SS_PINS_A) != LEDMATRIX_NUM_PANELS - 1
+#error "LEDMATRIX_SS_PINS_B and _A need one pin for each panel after panel 0"
+#endif
+#define LEDMATRIX_JOYSTICK_USED (!(LEDMATRIX_SS_PINS_A & LEDMATRIX_JOYSTICK_PINS_A))
+
+// One bit for each row of a column (bit y for row y)
+#if MATRIX_NUM_ROWS > 8
+typedef uint16_t MatrixColumnMask;
+#else
+typedef uint8_t MatrixColumnMask;
+#endif
 
 // Data types which can be used to store display information
 typedef PixelColour MatrixData[MATRIX_NUM_COLUMNS][MATRIX_NUM_ROWS];
 typedef PixelColour MatrixRow[MATRIX_NUM_COLUMNS];
 typedef PixelColour MatrixColumn[MATRIX_NUM_ROWS];
 
+// Packed display information. Rather than a PixelColour, each pixel
+// is stored as a FRAME_BITS_PER_PIXEL bit index into a palette of
+// PixelColours (2 bits - 4 colours, or 4 bits - 16 colours). Each
+// column is stored in FRAME_BYTES_PER_COLUMN bytes, with pixel y=0 in
+// the least significant bits of the first byte. The palette is only
+// looked up when the data is sent to the display. (See framebuffer.h
+// for functions which draw on packed frames.)
+#ifndef FRAME_BITS_PER_PIXEL
+#define FRAME_BITS_PER_PIXEL 4
+#endif
+#define FRAME_PIXELS_PER_BYTE (8 / FRAME_BITS_PER_PIXEL)
+#define FRAME_BYTES_PER_COLUMN (MATRIX_NUM_ROWS / FRAME_PIXELS_PER_BYTE)
+#define FRAME_PALETTE_SIZE (1 << FRAME_BITS_PER_PIXEL)
+typedef uint8_t PackedFrame[MATRIX_NUM_COLUMNS][FRAME_BYTES_PER_COLUMN];
+typedef PixelColour FramePalette[FRAME_PALETTE_SIZE];
+
+// Palette index of the pixel at (x,y) in a packed frame
+#define PACKED_PIXEL(frame, x, y) \
+		(((frame)[x][(y) / FRAME_PIXELS_PER_BYTE] >> \
+		(((y) % FRAME_PIXELS_PER_BYTE) * FRAME_BITS_PER_PIXEL)) & \
+		(FRAME_PALETTE_SIZE - 1))
+
+// Number of bytes sent over SPI by each kind of update (to all of the
+// panels involved)
+#define LEDMATRIX_ALL_BYTES		((1 + PANEL_NUM_ROWS * PANEL_NUM_COLUMNS) * LEDMATRIX_NUM_PANELS)
+#define LEDMATRIX_PIXEL_BYTES	3
+#define LEDMATRIX_ROW_BYTES		((2 + PANEL_NUM_COLUMNS) * LEDMATRIX_PANELS_X)
+#define LEDMATRIX_COLUMN_BYTES	((2 + PANEL_NUM_ROWS) * LEDMATRIX_PANELS_Y)
+#define LEDMATRIX_SHIFT_BYTES	(2 * LEDMATRIX_NUM_PANELS)
+
+// Is column x of the display on the same panel as column x2? (Used
+// to work out which columns a shift leaves wrong - see below.)
+#define LEDMATRIX_SAME_PANEL_COLUMN(x, x2) \
+		((x) / PANEL_NUM_COLUMNS == (x2) / PANEL_NUM_COLUMNS)
+
 // Setup SPI communication with the LED matrix.
 // This function must be called before the LED matrix functions
 // below are used.
@@ -35,12 +139,25 @@ void ledmatrix_update_all(MatrixData data);
 void ledmatrix_update_pixel(uint8_t x, uint8_t y, PixelColour pixel);
 void ledmatrix_update_row(uint8_t y, MatrixRow row);
 void ledmatrix_update_column(uint8_t x, MatrixColumn col);
+// Each panel shifts on its own - so with more than one panel the
+// column (or row) next to each panel edge is not what was in the next
+// panel, and needs to be sent again.
 void ledmatrix_shift_display_left(void);
 void ledmatrix_shift_display_right(void);
 void ledmatrix_shift_display_up(void);
 void ledmatrix_shift_display_down(void);
 void ledmatrix_clear(void);
 
+// Functions to send packed display information, looking up the colour
+// of each pixel in the given palette as it is sent
+void ledmatrix_update_all_packed(PackedFrame frame, FramePalette palette);
+void ledmatrix_update_row_packed(uint8_t y, PackedFrame frame, FramePalette palette);
+void ledmatrix_update_column_packed(uint8_t x, PackedFrame frame, FramePalette palette);
+
+// Bytes sent to each panel since the counts were last reset
+uint32_t ledmatrix_panel_bytes(uint8_t panel);
+void ledmatrix_reset_counts(void);
+
 // Functions to operate on MatrixRow and MatrixColumn data structures
 void copy_matrix_column(MatrixColumn from, MatrixColumn to);
 void copy_matrix_row(MatrixRow from, MatrixRow to);
@@ -0,0 +1,531 @@
+#!/usr/bin/env python3
+#
+# matrix_emulator.py
+#
+# Emulate the LED matrix panels (the SPI commands sent by ledmatrix.c)
+# and the serial terminal (the VT100 escape sequences sent by
+# terminalio.c) from a capture of the bytes the game sent, so the SPI
+# and UART traffic can be measured - and checked against limits - without
+# the board.
+#
+# For each frame it counts the SPI bytes and commands of each type and
+# the UART bytes, and flags redundant writes - pixels set to the colour
+# they already have, and characters written over the same character.
+# At the end it prints the totals and draws the panels and the terminal
+# as they were left.
+#
+# The capture is text, one record per line (blank lines and anything
+# after a # are ignored):
+#   select <panel>      take the given panel's slave select pin low
+#   spi <byte> ...      bytes sent to the selected panel (hex)
+#   uart <byte> ...     bytes sent to the terminal (hex)
+#   frame               end of a frame (e.g. written by frame_end())
+#   expect <panel> <colour> ...
+#                       the 128 colours (hex, row 0 first) the panel
+#                       should be showing now - anything else is
+#                       reported, and fails the run
+# Panel 0 is selected at the start. A host build writes these records
+# from its spi_send_byte(), PORTB (slave select) and uart_put_char()
+# stand-ins; a logic analyser export can be turned into them just as
+# easily. Raw byte streams (for one panel, or for the terminal) can be
+# read instead with --spi-raw and --uart-raw, as a single frame.
+#
+# Usage: python matrix_emulator.py [options] [capture]
+#        (the capture is read from standard input if not given - see
+#        --help for the options)
+
+import argparse
+import re
+import sys
+
+PANEL_NUM_COLUMNS = 16
+PANEL_NUM_ROWS = 8
+
+CMD_UPDATE_ALL = 0x00
+CMD_UPDATE_PIXEL = 0x01
+CMD_UPDATE_ROW = 0x02
+CMD_UPDATE_COL = 0x03
+CMD_SHIFT_DISPLAY = 0x04
+CMD_CLEAR_SCREEN = 0x0F
+
+COMMAND_NAMES = {
+    CMD_UPDATE_ALL: "update all",
+    CMD_UPDATE_PIXEL: "pixel",
+    CMD_UPDATE_ROW: "row",
+    CMD_UPDATE_COL: "column",
+    CMD_SHIFT_DISPLAY: "shift",
+    CMD_CLEAR_SCREEN: "clear",
+}
+
+# Bytes following each command byte
+COMMAND_ARGUMENTS = {
+    CMD_UPDATE_ALL: PANEL_NUM_ROWS * PANEL_NUM_COLUMNS,
+    CMD_UPDATE_PIXEL: 2,
+    CMD_UPDATE_ROW: 1 + PANEL_NUM_COLUMNS,
+    CMD_UPDATE_COL: 1 + PANEL_NUM_ROWS,
+    CMD_SHIFT_DISPLAY: 1,
+    CMD_CLEAR_SCREEN: 0,
+}
+
+# Shift directions (any combination) - which way the picture moves. Row 0
+# is the bottom row (see ledmatrix.h), so up moves row y to row y + 1.
+SHIFT_RIGHT = 0x01
+SHIFT_LEFT = 0x02
+SHIFT_DOWN = 0x04
+SHIFT_UP = 0x08
+
+TERMINAL_COLUMNS = 80
+TERMINAL_ROWS = 40
+
+# A capture record
+RECORD = re.compile(r"^(select|spi|uart|frame|expect)\b\s*(.*)$")
+
+# A control sequence (ESC [ ...), e.g. ESC[12;30H or ESC[?25l
+CSI = re.compile(rb"\x1b\[(\??)([0-9;]*)([@-~])")
+
+
+class Counts:
+    # Traffic in one frame (or in the whole capture)
+    def __init__(self):
+        self.spi_bytes = {name: 0 for name in COMMAND_NAMES.values()}
+        self.commands = {name: 0 for name in COMMAND_NAMES.values()}
+        self.redundant_pixels = {name: 0 for name in COMMAND_NAMES.values()}
+        self.redundant_commands = 0     # commands which changed nothing
+        self.spi_errors = 0             # unknown commands or bad arguments
+        self.uart_bytes = 0
+        self.characters = 0
+        self.redundant_characters = 0
+        self.escapes = 0
+
+    def spi_total(self):
+        return sum(self.spi_bytes.values())
+
+    def redundant_total(self):
+        return sum(self.redundant_pixels.values())
+
+    def add(self, other):
+        for name in COMMAND_NAMES.values():
+            self.spi_bytes[name] += other.spi_bytes[name]
+            self.commands[name] += other.commands[name]
+            self.redundant_pixels[name] += other.redundant_pixels[name]
+        self.redundant_commands += other.redundant_commands
+        self.spi_errors += other.spi_errors
+        self.uart_bytes += other.uart_bytes
+        self.characters += other.characters
+        self.redundant_characters += other.redundant_characters
+        self.escapes += other.escapes
+
+
+class Panel:
+    # One 16x8 panel, decoding the bytes sent to it. pixels[y][x] is the
+    # colour byte - green in the high nibble, red in the low nibble.
+    def __init__(self):
+        self.pixels = [[0] * PANEL_NUM_COLUMNS for _ in range(PANEL_NUM_ROWS)]
+        self.command = None
+        self.arguments = []
+
+    def receive(self, byte, counts):
+        if self.command is None:
+            if byte not in COMMAND_NAMES:
+                counts.spi_errors += 1
+                return
+            self.command = byte
+            self.arguments = []
+        else:
+            self.arguments.append(byte)
+        name = COMMAND_NAMES[self.command]
+        counts.spi_bytes[name] += 1
+        if len(self.arguments) == COMMAND_ARGUMENTS[self.command]:
+            counts.commands[name] += 1
+            if not self.execute(counts):
+                counts.redundant_commands += 1
+            self.command = None
+
+    # Set a pixel, counting it if it already had the colour. Returns 1
+    # if it changed.
+    def set(self, x, y, colour, counts):
+        if self.pixels[y][x] == colour:
+            counts.redundant_pixels[COMMAND_NAMES[self.command]] += 1
+            return 0
+        self.pixels[y][x] = colour
+        return 1
+
+    # Carry out the command received. Returns 1 if any pixel changed.
+    def execute(self, counts):
+        command, arguments = self.command, self.arguments
+        changed = 0
+        if command == CMD_UPDATE_ALL:
+            for i, colour in enumerate(arguments):
+                changed |= self.set(i % PANEL_NUM_COLUMNS, i // PANEL_NUM_COLUMNS, colour, counts)
+        elif command == CMD_UPDATE_PIXEL:
+            position, colour = arguments
+            if position & 0x80:
+                counts.spi_errors += 1
+            changed = self.set(position & 0x0F, (position >> 4) & 0x07, colour, counts)
+        elif command == CMD_UPDATE_ROW:
+            if arguments[0] >= PANEL_NUM_ROWS:
+                counts.spi_errors += 1
+            y = arguments[0] & 0x07
+            for x, colour in enumerate(arguments[1:]):
+                changed |= self.set(x, y, colour, counts)
+        elif command == CMD_UPDATE_COL:
+            if arguments[0] >= PANEL_NUM_COLUMNS:
+                counts.spi_errors += 1
+            x = arguments[0] & 0x0F
+            for y, colour in enumerate(arguments[1:]):
+                changed |= self.set(x, y, colour, counts)
+        elif command == CMD_SHIFT_DISPLAY:
+            before = [row[:] for row in self.pixels]
+            self.shift(arguments[0])
+            changed = self.pixels != before
+        elif command == CMD_CLEAR_SCREEN:
+            # A single byte, so only counted as redundant as a whole (if
+            # the panel was already clear)
+            changed = any(any(row) for row in self.pixels)
+            self.pixels = [[0] * PANEL_NUM_COLUMNS for _ in range(PANEL_NUM_ROWS)]
+        return changed
+
+    # Move the picture, clearing the pixels moved in from the edge
+    def shift(self, direction):
+        blank = [0] * PANEL_NUM_COLUMNS
+        if direction & SHIFT_LEFT:
+            self.pixels = [row[1:] + [0] for row in self.pixels]
+        if direction & SHIFT_RIGHT:
+            self.pixels = [[0] + row[:-1] for row in self.pixels]
+        if direction & SHIFT_UP:
+            self.pixels = [blank[:]] + self.pixels[:-1]
+        if direction & SHIFT_DOWN:
+            self.pixels = self.pixels[1:] + [blank[:]]
+
+
+class Terminal:
+    # The screen of the serial terminal, holding the characters written
+    # (attributes are ignored). Rows and columns count from 0 here, from
+    # 1 in the escape sequences.
+    def __init__(self, rows=TERMINAL_ROWS, columns=TERMINAL_COLUMNS):
+        self.rows = rows
+        self.columns = columns
+        self.screen = [[" "] * columns for _ in range(rows)]
+        self.x = 0
+        self.y = 0
+        self.top = 0
+        self.bottom = rows - 1
+        self.pending = b""
+
+    def receive(self, data, counts):
+        counts.uart_bytes += len(data)
+        data = self.pending + data
+        self.pending = b""
+        i = 0
+        while i < len(data):
+            byte = data[i]
+            if byte == 0x1B:
+                if i + 1 >= len(data):
+                    self.pending = data[i:]
+                    return
+                if data[i + 1] == ord("["):
+                    match = CSI.match(data, i)
+                    if not match:
+                        # Incomplete - wait for the rest
+                        if re.fullmatch(rb"\x1b\[\??[0-9;]*", data[i:]):
+                            self.pending = data[i:]
+                            return
+                        i += 2
+                        continue
+                    self.control(match.group(1), match.group(2), match.group(3))
+                    i = match.end()
+                else:
+                    self.escape(data[i + 1])
+                    i += 2
+                counts.escapes += 1
+                continue
+            if byte == ord("\r"):
+                self.x = 0
+            elif byte == ord("\n"):
+                self.index()
+            elif byte == 0x08:
+                self.x = max(self.x - 1, 0)
+            elif byte >= 0x20:
+                counts.characters += 1
+                if self.x >= self.columns:
+                    self.x = 0
+                    self.index()
+                character = chr(byte)
+                if self.screen[self.y][self.x] == character:
+                    counts.redundant_characters += 1
+                self.screen[self.y][self.x] = character
+                self.x += 1
+            i += 1
+
+    def control(self, private, parameters, final):
+        numbers = [int(p) if p else 0 for p in parameters.split(b";")] if parameters else []
+        first = numbers[0] if numbers else 0
+        if private:
+            return                          # cursor visibility
+        if final == b"H" or final == b"f":
+            row = numbers[0] if len(numbers) > 0 and numbers[0] else 1
+            column = numbers[1] if len(numbers) > 1 and numbers[1] else 1
+            self.y = min(row, self.rows) - 1
+            self.x = min(column, self.columns) - 1
+        elif final == b"J":
+            if first == 2:
+                self.screen = [[" "] * self.columns for _ in range(self.rows)]
+        elif final == b"K":
+            for x in range(self.x, self.columns):
+                self.screen[self.y][x] = " "
+        elif final == b"A":
+            self.y = max(self.y - max(first, 1), 0)
+        elif final == b"B":
+            self.y = min(self.y + max(first, 1), self.rows - 1)
+        elif final == b"C":
+            self.x = min(self.x + max(first, 1), self.columns - 1)
+        elif final == b"D":
+            self.x = max(self.x - max(first, 1), 0)
+        elif final == b"r":
+            if len(numbers) >= 2 and numbers[0] and numbers[1]:
+                self.top = min(numbers[0], self.rows) - 1
+                self.bottom = min(numbers[1], self.rows) - 1
+            else:
+                self.top = 0
+                self.bottom = self.rows - 1
+            self.x = 0
+            self.y = 0
+        # m (attributes) and anything else are ignored
+
+    def escape(self, byte):
+        if byte == ord("D"):
+            self.index()
+        elif byte == ord("M"):
+            self.reverse_index()
+
+    # Move down a line, scrolling the scroll region at its bottom
+    def index(self):
+        if self.y == self.bottom:
+            del self.screen[self.top]
+            self.screen.insert(self.bottom, [" "] * self.columns)
+        elif self.y < self.rows - 1:
+            self.y += 1
+
+    # Move up a line, scrolling the scroll region down at its top
+    def reverse_index(self):
+        if self.y == self.top:
+            del self.screen[self.bottom]
+            self.screen.insert(self.top, [" "] * self.columns)
+        elif self.y > 0:
+            self.y -= 1
+
+    def lines(self):
+        text = ["".join(row).rstrip() for row in self.screen]
+        while text and not text[-1]:
+            text.pop()
+        return text
+
+
+class Display:
+    # The panels, panels_x across and panels_y down, and the terminal
+    def __init__(self, panels_x, panels_y, terminal_rows):
+        self.panels_x = panels_x
+        self.panels_y = panels_y
+        self.panels = [Panel() for _ in range(panels_x * panels_y)]
+        self.selected = 0
+        self.terminal = Terminal(terminal_rows)
+
+    def select(self, panel, counts):
+        if panel >= len(self.panels):
+            counts.spi_errors += 1
+            return
+        self.selected = panel
+
+    def spi(self, data, counts):
+        panel = self.panels[self.selected]
+        for byte in data:
+            panel.receive(byte, counts)
+
+    def uart(self, data, counts):
+        self.terminal.receive(data, counts)
+
+    # Colour of pixel (x,y) of the whole display, in the same coordinates
+    # as ledmatrix_update_pixel()
+    def pixel(self, x, y):
+        panel = self.panels[(y // PANEL_NUM_ROWS) * self.panels_x + x // PANEL_NUM_COLUMNS]
+        return panel.pixels[y % PANEL_NUM_ROWS][x % PANEL_NUM_COLUMNS]
+
+
+def colour_char(colour, ansi):
+    green = colour >> 4
+    red = colour & 0x0F
+    if not colour:
+        return "\x1b[90m.\x1b[0m" if ansi else "."
+    if not ansi:
+        return "Y" if red and green else ("R" if red else "G")
+    # Nearest of the terminal's eight colours, bright if either half is
+    return "\x1b[%d;%dm#\x1b[0m" % (1 if max(red, green) >= 8 else 22,
+                                   33 if red and green else (31 if red else 32))
+
+
+# Draw the whole display, top row first
+def print_matrix(display, ansi):
+    for y in reversed(range(display.panels_y * PANEL_NUM_ROWS)):
+        print("".join(colour_char(display.pixel(x, y), ansi)
+                      for x in range(display.panels_x * PANEL_NUM_COLUMNS)))
+
+
+def print_terminal(display):
+    print("+" + "-" * display.terminal.columns + "+")
+    for line in display.terminal.lines():
+        print("|%-*s|" % (display.terminal.columns, line))
+    print("+" + "-" * display.terminal.columns + "+")
+
+
+def frame_summary(number, counts):
+    commands = ", ".join("%s %dx/%dB" % (name, counts.commands[name], counts.spi_bytes[name])
+                         for name in COMMAND_NAMES.values() if counts.spi_bytes[name])
+    return ("frame %d: spi %dB (%s), %d redundant pixels; uart %dB, %d redundant chars"
+            % (number, counts.spi_total(), commands or "-", counts.redundant_total(),
+               counts.uart_bytes, counts.redundant_characters))
+
+
+def print_totals(totals, frames, max_spi, max_uart):
+    print("%d frames" % frames)
+    print("%-12s %8s %8s %10s" % ("spi", "commands", "bytes", "redundant"))
+    for name in COMMAND_NAMES.values():
+        print("%-12s %8d %8d %10d" % (name, totals.commands[name], totals.spi_bytes[name],
+                                       totals.redundant_pixels[name]))
+    print("%-12s %8d %8d %10d" % ("total", sum(totals.commands.values()),
+                                   totals.spi_total(), totals.redundant_total()))
+    print("commands which changed nothing: %d" % totals.redundant_commands)
+    if totals.spi_errors:
+        print("protocol errors: %d" % totals.spi_errors)
+    print("uart: %d bytes, %d characters (%d redundant), %d escape sequences"
+          % (totals.uart_bytes, totals.characters, totals.redundant_characters, totals.escapes))
+    if frames:
+        print("per frame: spi %.1fB mean, %dB max; uart %.1fB mean, %dB max"
+              % (totals.spi_total() / frames, max_spi, totals.uart_bytes / frames, max_uart))
+
+
+def hex_bytes(text, line_number):
+    try:
+        return bytes(int(word, 16) for word in text.split())
+    except ValueError:
+        sys.exit("line %d: bad byte in %r" % (line_number, text))
+
+
+# Compare a panel with the colours expected (as for CMD_UPDATE_ALL).
+# Returns a description of the first difference, or None.
+def check_panel(display, panel, colours):
+    if panel >= len(display.panels) or len(colours) != PANEL_NUM_ROWS * PANEL_NUM_COLUMNS:
+        return "bad expect record for panel %d" % panel
+    for i, colour in enumerate(colours):
+        x, y = i % PANEL_NUM_COLUMNS, i // PANEL_NUM_COLUMNS
+        shown = display.panels[panel].pixels[y][x]
+        if shown != colour:
+            return "panel %d shows %02x at (%d,%d), expected %02x" % (panel, shown, x, y, colour)
+    return None
+
+
+# Feed the capture to the display, calling end_frame(counts) at the end
+# of each frame. Returns the differences from the expect records.
+def run_capture(lines, display, end_frame):
+    counts = Counts()
+    frame = 1
+    differences = []
+    for line_number, line in enumerate(lines, 1):
+        line = line.split("#", 1)[0].strip()
+        if not line:
+            continue
+        match = RECORD.match(line)
+        if not match:
+            sys.exit("line %d: unknown record %r" % (line_number, line))
+        kind, rest = match.groups()
+        if kind == "select":
+            display.select(int(rest, 0), counts)
+        elif kind == "spi":
+            display.spi(hex_bytes(rest, line_number), counts)
+        elif kind == "uart":
+            display.uart(hex_bytes(rest, line_number), counts)
+        elif kind == "expect":
+            panel, colours = rest.split(None, 1)
+            difference = check_panel(display, int(panel, 0), hex_bytes(colours, line_number))
+            if difference:
+                differences.append("frame %d: %s" % (frame, difference))
+        else:
+            end_frame(counts)
+            counts = Counts()
+            frame += 1
+    if counts.spi_total() or counts.uart_bytes or counts.spi_errors:
+        end_frame(counts)
+    return differences
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Emulate the LED matrix and terminal from a capture")
+    parser.add_argument("capture", nargs="?", help="capture file (default: standard input)")
+    parser.add_argument("--spi-raw", metavar="FILE", help="read raw SPI bytes for panel 0 instead")
+    parser.add_argument("--uart-raw", metavar="FILE", help="read raw UART bytes instead")
+    parser.add_argument("--panels-x", type=int, default=1, help="panels across (LEDMATRIX_PANELS_X)")
+    parser.add_argument("--panels-y", type=int, default=1, help="panels down (LEDMATRIX_PANELS_Y)")
+    parser.add_argument("--terminal-rows", type=int, default=TERMINAL_ROWS)
+    parser.add_argument("--frames", action="store_true", help="print the counts for each frame")
+    parser.add_argument("--show-frames", action="store_true", help="draw the panels after each frame")
+    parser.add_argument("--no-colour", action="store_true", help="draw the panels without escape sequences")
+    parser.add_argument("--summary", action="store_true", help="only print the totals")
+    parser.add_argument("--max-spi-bytes", type=int, metavar="N",
+                        help="fail if a frame sends more than N SPI bytes")
+    parser.add_argument("--max-uart-bytes", type=int, metavar="N",
+                        help="fail if a frame sends more than N UART bytes")
+    parser.add_argument("--max-redundant", type=int, metavar="N",
+                        help="fail if more than N pixel writes in all are redundant")
+    args = parser.parse_args()
+
+    ansi = not args.no_colour and sys.stdout.isatty()
+    display = Display(args.panels_x, args.panels_y, args.terminal_rows)
+    totals = Counts()
+    frames = []
+
+    def end_frame(counts):
+        frames.append((counts.spi_total(), counts.uart_bytes))
+        totals.add(counts)
+        if args.frames or args.show_frames:
+            print(frame_summary(len(frames), counts))
+        if args.show_frames:
+            print_matrix(display, ansi)
+
+    differences = []
+    if args.spi_raw or args.uart_raw:
+        counts = Counts()
+        if args.spi_raw:
+            with open(args.spi_raw, "rb") as f:
+                display.spi(f.read(), counts)
+        if args.uart_raw:
+            with open(args.uart_raw, "rb") as f:
+                display.uart(f.read(), counts)
+        end_frame(counts)
+    elif args.capture:
+        with open(args.capture) as f:
+            differences = run_capture(f, display, end_frame)
+    else:
+        differences = run_capture(sys.stdin, display, end_frame)
+
+    max_spi = max((spi for spi, _ in frames), default=0)
+    max_uart = max((uart for _, uart in frames), default=0)
+    if not args.summary:
+        print_matrix(display, ansi)
+        print_terminal(display)
+    print_totals(totals, len(frames), max_spi, max_uart)
+
+    failures = differences[:]
+    if args.max_spi_bytes is not None and max_spi > args.max_spi_bytes:
+        failures.append("a frame sent %d SPI bytes (limit %d)" % (max_spi, args.max_spi_bytes))
+    if args.max_uart_bytes is not None and max_uart > args.max_uart_bytes:
+        failures.append("a frame sent %d UART bytes (limit %d)" % (max_uart, args.max_uart_bytes))
+    if args.max_redundant is not None and totals.redundant_total() > args.max_redundant:
+        failures.append("%d redundant pixel writes (limit %d)"
+                        % (totals.redundant_total(), args.max_redundant))
+    for failure in failures:
+        print("FAIL: " + failure, file=sys.stderr)
+    if failures:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
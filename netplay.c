@@ -0,0 +1,493 @@
+/*
+ * netplay.c
+ *
+ * Two player games over the serial link - see netplay.h
+ *
+ * Ticks are numbered from 0 at the start of the game, in 16 bits
+ * (about 20 minutes at 20ms a tick) - tick numbers are compared by
+ * their difference so they can wrap around.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <avr/pgmspace.h>
+#include <util/crc16.h>
+
+#include "netplay.h"
+#include "serial_link.h"
+#include "game.h"
+#include "score.h"
+#include "timer0.h"
+
+// Message types. Offers and acceptances carry GAME_ID in place of the
+// tick number (so boards with different field sizes don't play each
+// other) and the random number seed as their data.
+#define MESSAGE_START	0xA5
+#define MESSAGE_OFFER	1
+#define MESSAGE_ACCEPT	2
+#define MESSAGE_INPUT	3	// The sender's input for the tick, and its
+							// localLead in the high byte
+#define MESSAGE_HASH	4	// CRC16 of the sender's snapshot at the tick
+#define GAME_ID			((FIELD_WIDTH << 8) | FIELD_HEIGHT)
+
+// Inputs are kept for INPUT_RING ticks, enough for the ticks since the
+// snapshot and those the other board can send ahead. Hashes are kept
+// for HASH_RING ticks. Both must be powers of two.
+#define INPUT_RING		32
+#define HASH_RING		8
+#if INPUT_RING < 2 * (NETPLAY_MAX_ROLLBACK + NETPLAY_INPUT_DELAY) + 2
+#error "INPUT_RING is too small for NETPLAY_MAX_ROLLBACK"
+#endif
+
+// How often (in ticks) the boards check whether one is ahead of the
+// other. Must be a power of two.
+#define SYNC_TICKS		16
+
+// a is before b
+#define BEFORE(a, b)	((int16_t)((a) - (b)) < 0)
+
+static uint8_t		state;
+static uint8_t		localPlayer;
+static uint16_t		gameSeed;
+static uint32_t		lastOfferTime;
+static uint32_t		lastReceiveTime;
+static uint32_t		nextTickTime;
+static uint32_t		lastTaskTime;
+static uint8_t		stalled;
+
+// localLead - how many ticks this board was ahead of the other one when
+// the other board's last input arrived (the ticks the input took to
+// get here, plus how far this board's ticks are ahead). remoteLead -
+// the same, measured by the other board. With the same delay in each
+// direction, this board is (localLead - remoteLead) / 2 ticks ahead.
+static int8_t		localLead;
+static int8_t		remoteLead;
+static uint16_t		lastSyncTick;
+
+// tick - the next tick to run (the game is at the start of it).
+// remoteTick - the next tick the other player's input is waited for.
+// inputs - each player's input for each tick. The other player's input
+// for ticks from remoteTick on is a guess (no input).
+// localInput - input given so far during this tick.
+// mispredicted - the other player's input for a tick which has been
+// run turned out not to be what was guessed.
+static uint16_t		tick;
+static uint16_t		remoteTick;
+static uint8_t		inputs[GAME_MAX_PLAYERS][INPUT_RING];
+static uint8_t		localInput;
+static uint8_t		mispredicted;
+static GameTimers	timers;
+
+// The snapshot of the game at the start of tick confirmedTick - the
+// latest tick for which the inputs for every tick before it are known.
+// The buffer is given to netplay_start().
+static uint8_t*		confirmed;
+static uint16_t		confirmedLength;
+static uint16_t		confirmedTick;
+
+// CRCs of the snapshots of each board, by tick
+typedef struct {
+	uint16_t	tick;
+	uint16_t	hash;
+	uint8_t		valid;
+} TickHash;
+static TickHash		localHashes[HASH_RING];
+static TickHash		remoteHashes[HASH_RING];
+
+// The message being received
+static uint8_t		message[NETPLAY_MESSAGE_BYTES];
+static uint8_t		messageLength;
+
+// Statistics
+static uint32_t		ticksRun;
+static uint32_t		rollbacks;
+static uint32_t		ticksRunAgain;
+static uint8_t		longestRollback;
+static uint32_t		stalls;
+static uint32_t		syncWaits;
+static uint16_t		hashesCompared;
+static uint16_t		badMessages;
+static uint16_t		desyncTick;
+
+static void send_message(uint8_t type, uint16_t messageTick, uint16_t data);
+static uint8_t receive_message(void);
+static void handle_messages(uint32_t now);
+static void check_hash(uint16_t hashTick);
+static void save_confirmed(uint16_t atTick);
+static void run_tick(uint16_t runTick);
+static void advance_tick(void);
+static void roll_back(void);
+
+void netplay_offer(uint16_t seed) {
+	state = NETPLAY_OFFERED;
+	localPlayer = 0;
+	gameSeed = seed;
+	lastOfferTime = 0;
+	messageLength = 0;
+	send_message(MESSAGE_OFFER, GAME_ID, gameSeed);
+}
+
+uint8_t netplay_poll(uint32_t now) {
+	if(state == NETPLAY_OFFERED && (int32_t)(now - lastOfferTime) >= NETPLAY_OFFER_MS) {
+		send_message(MESSAGE_OFFER, GAME_ID, gameSeed);
+		lastOfferTime = now;
+	}
+	// Stop reading once the game is agreed - the messages after that
+	// are for the game
+	while(state != NETPLAY_AGREED && receive_message()) {
+		uint16_t id = message[2] | ((uint16_t)message[3] << 8);
+		uint16_t seed = message[4] | ((uint16_t)message[5] << 8);
+		if(id != GAME_ID) {
+			continue;
+		}
+		if(message[1] == MESSAGE_OFFER && (state == NETPLAY_OFF ||
+				(state == NETPLAY_OFFERED && seed > gameSeed))) {
+			// Accept the offer (if both boards offered at once, the
+			// higher seed wins)
+			localPlayer = 1;
+			gameSeed = seed;
+			send_message(MESSAGE_ACCEPT, GAME_ID, gameSeed);
+			state = NETPLAY_AGREED;
+		} else if(message[1] == MESSAGE_ACCEPT && state == NETPLAY_OFFERED &&
+				seed == gameSeed) {
+			state = NETPLAY_AGREED;
+		}
+	}
+	return state == NETPLAY_AGREED;
+}
+
+void netplay_start(uint32_t now, uint8_t* buffer) {
+	uint8_t player, i;
+
+	// Both boards set up the game in exactly the same way
+	game_over(0);
+	init_score();
+	init_lives();
+	game_seed_random(((uint32_t)gameSeed << 16) | gameSeed);
+	game_set_players(2);
+	initialise_game();
+	game_start_timers(&timers);
+
+	// Nobody gives any input in the first NETPLAY_INPUT_DELAY ticks
+	for(player = 0; player < GAME_MAX_PLAYERS; player++) {
+		for(i = 0; i < INPUT_RING; i++) {
+			inputs[player][i] = 0;
+		}
+	}
+	for(i = 0; i < HASH_RING; i++) {
+		localHashes[i].valid = 0;
+		remoteHashes[i].valid = 0;
+	}
+	tick = 0;
+	remoteTick = NETPLAY_INPUT_DELAY;
+	localInput = 0;
+	mispredicted = 0;
+	stalled = 0;
+	localLead = remoteLead = 0;
+	lastSyncTick = 0;
+	ticksRun = rollbacks = ticksRunAgain = stalls = syncWaits = 0;
+	longestRollback = 0;
+	hashesCompared = badMessages = 0;
+
+	state = NETPLAY_RUNNING;
+	confirmed = buffer;
+	save_confirmed(0);
+	nextTickTime = now + NETPLAY_TICK_MS;
+	lastReceiveTime = now;
+}
+
+void netplay_input(uint8_t input) {
+	localInput |= input;
+}
+
+void netplay_task(uint32_t now) {
+	uint8_t wasStalled;
+	int8_t ahead;
+
+	if(state != NETPLAY_RUNNING) {
+		return;
+	}
+	lastTaskTime = now;
+	handle_messages(now);
+	if(state != NETPLAY_RUNNING) {
+		return;
+	}
+	if(mispredicted) {
+		roll_back();
+	} else if(!BEFORE(remoteTick, tick) && confirmedTick != tick) {
+		// The guesses were right
+		save_confirmed(tick);
+	}
+	if((int32_t)(now - lastReceiveTime) >= NETPLAY_TIMEOUT_MS) {
+		state = NETPLAY_LINK_LOST;
+		return;
+	}
+
+	// Run the ticks which are due. If we have fallen a long way behind
+	// (e.g. after waiting for the other board) we carry on from now
+	// rather than rushing to catch up.
+	if((int32_t)(now - nextTickTime) >= NETPLAY_MAX_ROLLBACK * NETPLAY_TICK_MS) {
+		nextTickTime = now;
+	}
+	wasStalled = stalled;
+	stalled = 0;
+	while((int32_t)(now - nextTickTime) >= 0 && !is_game_over()) {
+		if((uint16_t)(tick - confirmedTick) >= NETPLAY_MAX_ROLLBACK) {
+			// Too far ahead of the other board - wait for its input
+			stalled = 1;
+			if(!wasStalled) {
+				stalls++;
+			}
+			break;
+		}
+		if((tick & (SYNC_TICKS - 1)) == 0 && tick != lastSyncTick) {
+			// If this board is ahead of the other one, hold back for
+			// the ticks it is ahead by, so that the other board's
+			// input isn't always late
+			lastSyncTick = tick;
+			ahead = (localLead - remoteLead) / 2;
+			if(ahead > 0) {
+				nextTickTime += ahead * NETPLAY_TICK_MS;
+				syncWaits += ahead;
+				continue;
+			}
+		}
+		advance_tick();
+		nextTickTime += NETPLAY_TICK_MS;
+	}
+	if(is_game_over()) {
+		// The game may not really be over - wait for the input which
+		// shows whether it is
+		stalled = 1;
+	}
+}
+
+uint32_t netplay_next_time(void) {
+	if(stalled) {
+		// Look for messages again a tick from now
+		return lastTaskTime + NETPLAY_TICK_MS;
+	}
+	return nextTickTime;
+}
+
+uint8_t netplay_state(void) {
+	return state;
+}
+
+uint8_t netplay_player(void) {
+	return localPlayer;
+}
+
+void netplay_timers(GameTimers* current) {
+	*current = timers;
+}
+
+void netplay_stop(void) {
+	state = NETPLAY_OFF;
+	game_set_players(1);
+}
+
+void netplay_report(void) {
+	printf_P(PSTR("Linked game: player %u, %lu ticks, %lu rollbacks (%lu ticks run again, longest %u), %lu stalls, %lu ticks held back\n"),
+			localPlayer, ticksRun, rollbacks, ticksRunAgain, longestRollback, stalls, syncWaits);
+	printf_P(PSTR("Link: %lu bytes sent, %lu received, %u overruns, %u bad messages, %u hashes checked\n"),
+			serial_link_bytes_sent(), serial_link_bytes_received(), serial_link_overruns(),
+			badMessages, hashesCompared);
+	if(state == NETPLAY_DESYNC) {
+		printf_P(PSTR("Desync at tick %u\n"), desyncTick);
+	}
+}
+
+static void send_message(uint8_t type, uint16_t messageTick, uint16_t data) {
+	uint8_t bytes[NETPLAY_MESSAGE_BYTES - 2] = {
+		type, (uint8_t)messageTick, (uint8_t)(messageTick >> 8),
+		(uint8_t)data, (uint8_t)(data >> 8)
+	};
+	uint8_t crc = 0;
+	serial_link_send(MESSAGE_START);
+	for(uint8_t i = 0; i < sizeof(bytes); i++) {
+		serial_link_send(bytes[i]);
+		crc = _crc8_ccitt_update(crc, bytes[i]);
+	}
+	serial_link_send(crc);
+}
+
+// Read received bytes until a whole message has arrived. Returns 1 if
+// one has (in message[]), 0 if there are no more bytes yet.
+static uint8_t receive_message(void) {
+	uint8_t byte, crc, i;
+	while(serial_link_input_available()) {
+		byte = serial_link_get();
+		if(messageLength == 0 && byte != MESSAGE_START) {
+			// Wait for the start of a message
+			continue;
+		}
+		message[messageLength++] = byte;
+		if(messageLength < NETPLAY_MESSAGE_BYTES) {
+			continue;
+		}
+		messageLength = 0;
+		crc = 0;
+		for(i = 1; i < NETPLAY_MESSAGE_BYTES - 1; i++) {
+			crc = _crc8_ccitt_update(crc, message[i]);
+		}
+		if(crc == message[NETPLAY_MESSAGE_BYTES - 1]) {
+			return 1;
+		}
+		badMessages++;
+	}
+	return 0;
+}
+
+static void handle_messages(uint32_t now) {
+	uint8_t remotePlayer = 1 - localPlayer;
+	uint16_t messageTick, data;
+	int16_t lead;
+	TickHash* hash;
+
+	while(state == NETPLAY_RUNNING && receive_message()) {
+		lastReceiveTime = now;
+		messageTick = message[2] | ((uint16_t)message[3] << 8);
+		data = message[4] | ((uint16_t)message[5] << 8);
+		switch(message[1]) {
+			case MESSAGE_INPUT:
+				if(messageTick != remoteTick) {
+					// Lost or out of order - the link will time out
+					badMessages++;
+					break;
+				}
+				inputs[remotePlayer][messageTick & (INPUT_RING - 1)] = (uint8_t)data;
+				if(BEFORE(messageTick, tick) && (uint8_t)data != 0) {
+					// The tick was run guessing there was no input
+					mispredicted = 1;
+				}
+				remoteTick++;
+				// The other board sent this during tick
+				// messageTick - NETPLAY_INPUT_DELAY
+				lead = (int16_t)(tick - (messageTick - NETPLAY_INPUT_DELAY));
+				localLead = lead > INT8_MAX ? INT8_MAX : lead < INT8_MIN ? INT8_MIN : lead;
+				remoteLead = (int8_t)(data >> 8);
+				break;
+			case MESSAGE_HASH:
+				hash = &remoteHashes[messageTick & (HASH_RING - 1)];
+				hash->tick = messageTick;
+				hash->hash = data;
+				hash->valid = 1;
+				check_hash(messageTick);
+				break;
+			default:
+				// e.g. a repeated offer
+				break;
+		}
+	}
+}
+
+// Compare the two boards' hashes for the given tick, if both are known
+static void check_hash(uint16_t hashTick) {
+	TickHash* local = &localHashes[hashTick & (HASH_RING - 1)];
+	TickHash* remote = &remoteHashes[hashTick & (HASH_RING - 1)];
+	if(!local->valid || !remote->valid || local->tick != hashTick ||
+			remote->tick != hashTick) {
+		return;
+	}
+	hashesCompared++;
+	if(local->hash != remote->hash) {
+		state = NETPLAY_DESYNC;
+		desyncTick = hashTick;
+	}
+	local->valid = 0;
+	remote->valid = 0;
+}
+
+// Save the game (which is at the start of tick atTick, with the inputs
+// for all the ticks before it known) and send its hash to the other
+// board
+static void save_confirmed(uint16_t atTick) {
+	TickHash* hash = &localHashes[atTick & (HASH_RING - 1)];
+	confirmedLength = game_snapshot_save(confirmed, &timers);
+	confirmedTick = atTick;
+	if(is_game_over()) {
+		// With all the inputs known, the game really is over
+		state = NETPLAY_FINISHED;
+	}
+	// The snapshot ends with its CRC16
+	hash->tick = atTick;
+	hash->hash = confirmed[confirmedLength - 2] |
+			((uint16_t)confirmed[confirmedLength - 1] << 8);
+	hash->valid = 1;
+	send_message(MESSAGE_HASH, atTick, hash->hash);
+	check_hash(atTick);
+}
+
+// Apply both players' inputs for the given tick and run the steps
+// which are due
+static void run_tick(uint16_t runTick) {
+	uint8_t player, input;
+
+	for(player = 0; player < GAME_MAX_PLAYERS; player++) {
+		input = inputs[player][runTick & (INPUT_RING - 1)];
+		if(input & NETPLAY_INPUT_LEFT) {
+			move_player_base(player, MOVE_LEFT);
+		}
+		if(input & NETPLAY_INPUT_RIGHT) {
+			move_player_base(player, MOVE_RIGHT);
+		}
+		if(input & NETPLAY_INPUT_FIRE) {
+			fire_player_projectile(player);
+		}
+	}
+
+	game_run_steps(&timers, NETPLAY_TICK_MS, 0);
+}
+
+// Send this tick's input (for use NETPLAY_INPUT_DELAY ticks from now)
+// and run the tick
+static void advance_tick(void) {
+	uint16_t inputTick = tick + NETPLAY_INPUT_DELAY;
+	inputs[localPlayer][inputTick & (INPUT_RING - 1)] = localInput;
+	send_message(MESSAGE_INPUT, inputTick, localInput | ((uint16_t)(uint8_t)localLead << 8));
+	localInput = 0;
+	if(!BEFORE(tick, remoteTick)) {
+		// Not here yet - guess there was no input
+		inputs[1 - localPlayer][tick & (INPUT_RING - 1)] = 0;
+	}
+	run_tick(tick);
+	tick++;
+	ticksRun++;
+	if(!BEFORE(remoteTick, tick)) {
+		save_confirmed(tick);
+	}
+}
+
+// Go back to the snapshot and run the ticks since then again with the
+// inputs now known, saving the game again at the last tick for which
+// all the inputs are known. Nothing is drawn until the game has caught
+// up.
+static void roll_back(void) {
+	uint16_t fromTick, runTick, known;
+	uint8_t ticksAgain;
+
+	fromTick = confirmedTick;
+	known = BEFORE(remoteTick, tick) ? remoteTick : tick;
+	game_set_quiet(1);
+	game_snapshot_restore(confirmed, confirmedLength, &timers);
+	for(runTick = fromTick; runTick != tick && !is_game_over(); ) {
+		run_tick(runTick);
+		runTick++;
+		if(runTick == known || (is_game_over() && !BEFORE(known, runTick))) {
+			save_confirmed(runTick);
+		}
+	}
+	// If the game ended sooner this time, the ticks after that are
+	// never run
+	ticksAgain = (uint8_t)(runTick - fromTick);
+	tick = runTick;
+	game_set_quiet(0);
+
+	mispredicted = 0;
+	rollbacks++;
+	ticksRunAgain += ticksAgain;
+	if(ticksAgain > longestRollback) {
+		longestRollback = ticksAgain;
+	}
+}
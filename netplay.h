@@ -0,0 +1,120 @@
+/*
+ * netplay.h
+ *
+ * Two player games between two boards joined by the serial link (see
+ * serial_link.h). Each player has their own base on a shared field and
+ * both boards run the whole game. The game moves on in fixed ticks of
+ * NETPLAY_TICK_MS - in each tick the inputs of both players are
+ * applied (player 0 first) and then the projectile and asteroid steps
+ * which are due are run. The game only depends on the inputs and the
+ * random number seed agreed at the start, so both boards play exactly
+ * the same game.
+ *
+ * Lockstep: the input a player gives during tick t is used in tick
+ * t + NETPLAY_INPUT_DELAY, and is sent to the other board straight
+ * away (an input message is sent for every tick, even when there is no
+ * input, so the other board knows it has everything).
+ *
+ * Rollback: when the other player's input for a tick hasn't arrived in
+ * time, the tick is run as if they gave no input, rather than waiting.
+ * The state after the last tick for which both inputs are known is
+ * kept as a snapshot (see game_snapshot_save()). If the input turns out
+ * to have been different, the snapshot is restored and the ticks since
+ * then are run again (quietly - see game_set_quiet()) with the right
+ * input, all within the current tick. A board which gets
+ * NETPLAY_MAX_ROLLBACK ticks ahead of the input it has waits for the
+ * other board to catch up. The boards also tell each other how late
+ * the inputs arrive, and one which is running ahead of the other (e.g.
+ * because it started first) holds back for a few ticks.
+ *
+ * Desync detection: whenever a board moves its snapshot on, it sends
+ * the snapshot's CRC16 along with the tick number. If the other board
+ * saved a different CRC for the same tick, the boards have stopped
+ * playing the same game and the linked game ends.
+ *
+ * Messages are NETPLAY_MESSAGE_BYTES long - a start byte, the type, a
+ * 16 bit tick number, 16 bits of data and a CRC8 of the type to the
+ * data. Multi-byte values are least significant byte first.
+ *
+ * The module only uses the serial link, the game and the time passed
+ * to netplay_task(), so it can be run (e.g. on a PC) with any link
+ * which provides the functions in serial_link.h.
+ */
+
+#ifndef NETPLAY_H_
+#define NETPLAY_H_
+
+#include <stdint.h>
+#include "game.h"
+
+// Length of a tick, and the number of ticks before input is used
+#define NETPLAY_TICK_MS			20
+#define NETPLAY_INPUT_DELAY		2
+
+// Most ticks that can be run on a guess of the other player's input
+#define NETPLAY_MAX_ROLLBACK	8
+
+// The linked game ends if nothing is received for this long
+#define NETPLAY_TIMEOUT_MS		2000
+
+// How often an offer of a game is sent until it is accepted
+#define NETPLAY_OFFER_MS		250
+
+// Input given by a player during a tick (any combination)
+#define NETPLAY_INPUT_LEFT		0x01
+#define NETPLAY_INPUT_RIGHT		0x02
+#define NETPLAY_INPUT_FIRE		0x04
+
+#define NETPLAY_MESSAGE_BYTES	7
+
+// States (see netplay_state())
+#define NETPLAY_OFF				0	// No linked game
+#define NETPLAY_OFFERED			1	// Waiting for the other board to accept
+#define NETPLAY_AGREED			2	// Both boards are ready to start
+#define NETPLAY_RUNNING			3	// Playing
+#define NETPLAY_FINISHED		4	// Ended - game over
+#define NETPLAY_DESYNC			5	// Ended - the boards disagreed
+#define NETPLAY_LINK_LOST		6	// Ended - nothing received for too long
+
+// Offer a linked game to the other board, as player 0, starting from the
+// given random number seed. The offer is repeated by netplay_poll()
+// until it is accepted.
+void netplay_offer(uint16_t seed);
+
+// Deal with any messages received over the link when no linked game
+// is running, accepting an offer from the other board (as player 1).
+// Returns 1 if both boards have agreed to start a game, 0 if not.
+uint8_t netplay_poll(uint32_t now);
+
+// Start the agreed game - set up the score, lives and game field.
+// now is the current time (ms). The snapshot is kept in buffer, which
+// must be GAME_SNAPSHOT_MAX_BYTES long and not be used for anything
+// else until the game ends.
+void netplay_start(uint32_t now, uint8_t* buffer);
+
+// Add to the input this player has given during the current tick
+void netplay_input(uint8_t input);
+
+// Deal with received messages, roll back if needed and run the ticks
+// which are due by time now. Call this often while the game runs.
+void netplay_task(uint32_t now);
+
+// Time (ms) at which the next tick is due
+uint32_t netplay_next_time(void);
+
+// The current state (NETPLAY_...) and this board's player number
+uint8_t netplay_state(void);
+uint8_t netplay_player(void);
+
+// Copy the game's step timers, as they are after the last tick run,
+// into *current
+void netplay_timers(GameTimers* current);
+
+// Stop the linked game
+void netplay_stop(void);
+
+// Print the tick, rollback, desync and link statistics to standard
+// output
+void netplay_report(void);
+
+#endif /* NETPLAY_H_ */
@@ -0,0 +1,82 @@
+/*
+ * profile.c
+ *
+ * Named timing counters - see profile.h
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#include "profile.h"
+#include "timer0.h"
+
+typedef struct {
+	uint32_t total;		// timer counts
+	uint16_t calls;
+	uint16_t max;		// timer counts
+} ProfileCounter;
+
+static volatile ProfileCounter counters[PROFILE_NUM_COUNTERS];
+
+// Time (ms) the counters were cleared
+static uint32_t start_time;
+
+static PGM_P const counter_names[PROFILE_NUM_COUNTERS] PROGMEM = {
+	"spi_send_byte", "advance_projectiles", "advance_asteroids",
+	"timer ISR", "button ISR", "serial rx ISR", "autopilot_decide", "audio ISR"
+};
+
+void profile_record(uint8_t counter, uint16_t counts) {
+	volatile ProfileCounter* c = &counters[counter];
+	if(c->calls == UINT16_MAX) {
+		// Full - stop counting so the mean stays correct
+		return;
+	}
+	c->calls++;
+	c->total += counts;
+	if(counts > c->max) {
+		c->max = counts;
+	}
+}
+
+void profile_reset(void) {
+	uint8_t interrupts_were_enabled = bit_is_set(SREG, SREG_I);
+	cli();
+	for(uint8_t i = 0; i < PROFILE_NUM_COUNTERS; i++) {
+		counters[i].total = 0;
+		counters[i].calls = 0;
+		counters[i].max = 0;
+	}
+	if(interrupts_were_enabled) {
+		sei();
+	}
+	start_time = get_current_time();
+}
+
+void profile_report(void) {
+	ProfileCounter c;
+	uint32_t elapsed = get_current_time() - start_time;
+	uint32_t permille;
+	for(uint8_t i = 0; i < PROFILE_NUM_COUNTERS; i++) {
+		// Take a copy - the counter may be updated by an interrupt handler
+		uint8_t interrupts_were_enabled = bit_is_set(SREG, SREG_I);
+		cli();
+		c = counters[i];
+		if(interrupts_were_enabled) {
+			sei();
+		}
+		if(c.calls == 0) {
+			continue;
+		}
+		// Microseconds per millisecond is parts per thousand
+		permille = elapsed ? FAST_TIME_TO_US(c.total) / elapsed : 0;
+		printf_P(PSTR("%-20S n=%u mean=%luus max=%luus total=%lums share=%lu.%lu%%\n"),
+				(PGM_P)pgm_read_word(&counter_names[i]), c.calls,
+				FAST_TIME_TO_US(c.total / c.calls), FAST_TIME_TO_US(c.max),
+				FAST_TIME_TO_US(c.total) / 1000, permille / 10, permille % 10);
+	}
+}
@@ -0,0 +1,78 @@
+/*
+ * profile.h
+ *
+ * Named timing counters. Code to be timed is wrapped in
+ * PROFILE_BEGIN()/PROFILE_END() or PROFILE_SCOPE() and the time taken
+ * (using the timer 0 fast clock - see timer0.h) is added to the
+ * counter. The total, count and maximum for each counter, and its
+ * share of the time since the counters were cleared, can be printed
+ * with profile_report().
+ *
+ * Profiling is compiled out of Release builds (where NDEBUG is
+ * defined).
+ */
+
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <stdint.h>
+#include "timer0.h"
+
+// Counters
+#define PROFILE_SPI_SEND			0
+#define PROFILE_ADVANCE_PROJECTILES	1
+#define PROFILE_ADVANCE_ASTEROIDS	2
+#define PROFILE_TIMER_ISR			3
+#define PROFILE_BUTTON_ISR			4
+#define PROFILE_SERIAL_RX_ISR		5
+#define PROFILE_AUTOPILOT			6
+#define PROFILE_AUDIO_ISR			7
+#define PROFILE_NUM_COUNTERS		8
+
+#ifndef NDEBUG
+
+// Start timing. Declares a variable so can only be used once per
+// counter in each block.
+#define PROFILE_BEGIN(counter) \
+		uint16_t profile_start_##counter = get_fast_time()
+
+// Stop timing and add the time taken to the counter
+#define PROFILE_END(counter) \
+		profile_record((counter), get_fast_time() - profile_start_##counter)
+
+// Time the statement or block that follows, e.g.
+//		PROFILE_SCOPE(PROFILE_SPI_SEND) {
+//			...
+//		}
+// Leaving the block with break, return or goto skips the recording.
+#define PROFILE_SCOPE(counter) \
+		for(uint16_t profile_start = get_fast_time(), profile_once = 1; \
+				profile_once; \
+				profile_record((counter), get_fast_time() - profile_start), \
+				profile_once = 0)
+
+// Add a time measured some other way (in timer counts) to the counter
+#define PROFILE_RECORD(counter, counts) \
+		profile_record((counter), (counts))
+
+#else
+
+#define PROFILE_BEGIN(counter)
+#define PROFILE_END(counter)
+#define PROFILE_SCOPE(counter)
+#define PROFILE_RECORD(counter, counts)
+
+#endif
+
+// Add a time (in timer counts) to a counter. Safe to call from an
+// interrupt handler (as long as each counter is only used either from
+// interrupt handlers or from the main loop, not both).
+void profile_record(uint8_t counter, uint16_t counts);
+
+// Clear all counters
+void profile_reset(void);
+
+// Print the counters to standard output
+void profile_report(void);
+
+#endif /* PROFILE_H_ */
@@ -10,7 +10,6 @@
 #include <avr/interrupt.h>
 #include <avr/pgmspace.h>
 #include <stdio.h>
-#include <avr/eeprom.h>
 
 
 
@@ -22,6 +21,21 @@
 #include "score.h"
 #include "timer0.h"
 #include "game.h"
+#include "latency.h"
+#include "frame_timing.h"
+#include "idle.h"
+#include "profile.h"
+#include "ram_monitor.h"
+#include "display_encoder.h"
+#include "highscore.h"
+#include "eeprom_queue.h"
+#include "serial_link.h"
+#include "netplay.h"
+#include "autopilot.h"
+#include "env.h"
+#include "audio.h"
+#include "coroutine.h"
+#include <avr/eeprom.h>
 
 
 #define F_CPU 8000000L
@@ -34,17 +48,71 @@ void splash_screen(void);
 void new_game(void);
 void play_game(void);
 void handle_game_over(void);
+void start_splash_text(void);
+void start_game_over_text(void);
+void start_hud_text(void);
+void run_screen(CoroutineTask task);
+uint8_t splash_task(Coroutine* c);
+uint8_t game_over_task(Coroutine* c);
+uint8_t pause_task(Coroutine* c);
+uint8_t button_pushed_ignoring_serial(void);
+uint8_t high_score_name_entered(void);
+uint8_t resume_requested(void);
+void save_snapshot(uint8_t to_eeprom);
+void print_snapshot(void);
+void restore_snapshot(void);
+void play_linked_game(void);
+uint8_t autopilot_due(uint32_t now);
+void run_autopilot(void);
+void run_env_benchmark(void);
 
 // ASCII code for Escape character
 #define ESCAPE_CHAR 27
 
-volatile int speed = 500;
-volatile uint32_t  asteroid_speed = 1000;
-volatile int saveScore;
-volatile char playerName[12];
+// Size of the buffer (on the stack) used to hold the columns of the
+// splash screen and game over messages while they scroll
+#define MESSAGE_COLUMNS 128
+
+// Steps run by the training environment benchmark
+#define ENV_BENCHMARK_STEPS 1000
+
+// Saved games (see game_snapshot_save()) go in the EEPROM after the
+// high score table
+#define SNAPSHOT_EEPROM_ADDRESS HIGHSCORE_EEPROM_END
+#if defined(E2END) && SNAPSHOT_EEPROM_ADDRESS + GAME_SNAPSHOT_MAX_BYTES > E2END + 1
+#error "No room in the EEPROM for a saved game"
+#endif
+
+char playerName[HIGHSCORE_NAME_LENGTH + 1];
+// Length of the name typed so far, and 1 if a button was pushed to
+// finish it (see high_score_name_entered())
+uint8_t name_length;
+uint8_t name_button;
+// Characters of an escape sequence read while paused
+uint8_t pause_escape;
+// The last snapshot of the game saved or loaded, and its length (0 if
+// there isn't one). It is also what is written to the EEPROM, so it
+// isn't changed while a write is in progress.
+uint8_t snapshot[GAME_SNAPSHOT_MAX_BYTES];
+uint16_t snapshot_length;
+// 1 if the player has asked for a new game straight away
+uint8_t fast_restart;
+// 1 while the autopilot is playing (one game after another), and the
+// time its next move is due
+uint8_t autopilot;
+uint32_t autopilot_time;
+// 1 if music is played during games
+uint8_t music = 1;
+#if AUTOPILOT_LEFT != NETPLAY_INPUT_LEFT || AUTOPILOT_RIGHT != NETPLAY_INPUT_RIGHT || \
+		AUTOPILOT_FIRE != NETPLAY_INPUT_FIRE
+#error "The autopilot's moves are passed to netplay_input() as they are"
+#endif
 volatile int8_t paused = 0; // 1 = paused 
 uint32_t timePaused;
-volatile uint32_t current_time, last_move_time, pause_time, asteroid_move_time;
+volatile uint32_t current_time, last_frame_time, pause_time;
+// The step periods, and the time (ms) that has passed but not yet been
+// used up by projectile and asteroid steps (see game_run_steps())
+GameTimers timers;
 //a function which outputs the direction of joystic
 void serial_check_pause(void);
 
@@ -52,20 +120,29 @@ void serial_check_pause(void);
 int main(void) {
 	// Setup hardware and call backs. This will turn on
 	// interrupts.
-	asteroid_speed = 1200;
+	game_start_timers(&timers);
+	timers.asteroidPeriod = 1200;
 	DDRA = 0b01111100;
 	DDRD = 0b11111000;
 	// Make pin OC1B be an output (port D, pin 4)
 	
 	initialise_hardware();
-	//eeprom_read_word(0);
 	// Show the splash screen message. Returns when display
 	// is complete
 	splash_screen();
 	while(1) {
 		new_game();
 		play_game();
-		handle_game_over();
+		if(netplay_state() == NETPLAY_AGREED) {
+			// The other board has agreed to a linked game
+			play_linked_game();
+		}
+		if(fast_restart || autopilot) {
+			// Skip the game over screen
+			fast_restart = 0;
+		} else {
+			handle_game_over();
+		}
 		
 		}
 	}
@@ -78,8 +155,23 @@ void initialise_hardware(void) {
 	// Setup serial port for 19200 baud communication with no echo
 	// of incoming characters
 	init_serial_stdio(19200,0);
+	// and the serial link to another board (for linked games)
+	serial_link_init(19200);
 	
 	init_timer0();
+	audio_init();
+	
+	// Clear the input-to-display latency and frame statistics
+	latency_reset();
+	frame_timing_reset();
+	idle_reset_stats();
+	profile_reset();
+	display_encoder_reset();
+	autopilot_reset_stats();
+	audio_reset_stats();
+	
+	// Load the high score table from the EEPROM
+	highscore_init();
 	
 	// Turn on global interrupts
 	
@@ -87,29 +179,80 @@ void initialise_hardware(void) {
 }
 
 void splash_screen(void) {
+	uint8_t columns[MESSAGE_COLUMNS];
+	scrolling_display_set_cache(columns, sizeof(columns));
+	run_screen(splash_task);
+	scrolling_display_set_cache(0, 0);
+}
+
+// The splash screen, until a button is pushed
+uint8_t splash_task(Coroutine* c) {
+	CORO_BEGIN(c);
 	// Clear terminal screen and output a message
 	clear_terminal();
 	move_cursor(10,10);
 	printf_P(PSTR("Asteroids"));
 	move_cursor(10,12);
 	printf_P(PSTR("CSSE2010/7201 project by Pacifique Rukikza; S4521717"));
+	highscore_print(14);
 	
 	// Output the scrolling message to the LED matrix
 	// and wait for a push button to be pushed.
 	ledmatrix_clear();
-	while(1) {
-		set_scrolling_display_text("45217171", COLOUR_GREEN);
-		// Scroll the message until it has scrolled off the 
-		// display or a button is pushed
-		while(scroll_display()) {
-			_delay_ms(150);
-			if(button_pushed() != NO_BUTTON_PUSHED) {
-				return;
+	start_splash_text();
+	CORO_WAIT_UNTIL(c, button_pushed_ignoring_serial());
+	scrolling_display_stop();
+	CORO_END(c);
+}
+
+// Scroll the splash screen message - over and over again, as this is
+// called again each time it has scrolled off
+void start_splash_text(void) {
+	scrolling_display_start_P(PSTR("45217171"), COLOUR_GREEN, SCROLL_TO_DISPLAY,
+			start_splash_text);
+}
+
+// Run one of the screens which come between (or interrupt) games - a
+// coroutine (see coroutine.h) - until it has finished. The message
+// scrolling in the background (or in the HUD band) keeps moving, and
+// we sleep whenever the coroutine is waiting or sleeping, waking up
+// straight away for input.
+void run_screen(CoroutineTask task) {
+	Coroutine c;
+	uint8_t state;
+	uint32_t deadline;
+	
+	coro_init(&c);
+	while((state = task(&c)) != CORO_DONE) {
+		if(scrolling_display_task()) {
+			redraw_hud();
+		}
+		audio_task();
+		highscore_task();
+		if(state == CORO_YIELDED) {
+			continue;
+		}
+		if(scrolling_display_active()) {
+			deadline = scrolling_display_next_time();
+			if(state == CORO_SLEEPING && (int32_t)(c.deadline - deadline) < 0) {
+				deadline = c.deadline;
 			}
+			idle_until(deadline);
+		} else if(state == CORO_SLEEPING) {
+			idle_until(c.deadline);
+		} else {
+			idle_until_input();
 		}
 	}
 }
 
+// Returns 1 if a button has been pushed, 0 if not. Serial input isn't
+// used - it is thrown away so that it doesn't keep waking us up.
+uint8_t button_pushed_ignoring_serial(void) {
+	clear_serial_input_buffer();
+	return button_pushed() != NO_BUTTON_PUSHED;
+}
+
 void new_game(void) {
 	// Initialise the game and display
 	initialise_game();
@@ -123,6 +266,22 @@ void new_game(void) {
 	// (The cast to void means the return value is ignored.)
 	(void)button_pushed();
 	clear_serial_input_buffer();
+	
+	if(music) {
+		audio_play(AUDIO_SOUND_MUSIC);
+	}
+	
+	// Scroll the score in the HUD band (if there is room for one)
+#ifdef GAME_HUD_ROW
+	start_hud_text();
+#endif
+}
+
+// Scroll the current score in the HUD band. This is called again each
+// time the message has scrolled off, to show the new score.
+void start_hud_text(void) {
+	scrolling_display_start_number_P(PSTR("SCORE "), get_score(), COLOUR_YELLOW,
+			SCROLL_TO_HUD, start_hud_text);
 }
 
 void play_game(void) {
@@ -132,16 +291,18 @@ void play_game(void) {
 	uint8_t characters_into_escape_sequence = 0;
 	
 	
-	// Get the current time and remember this as the last time the projectiles
-	// were moved.
+	GameSteps steps;
+	uint32_t elapsed, next_step_time;
+	
+	// Get the current time and remember this as the start of the first
+	// frame. No time is owed to the projectile or asteroid steps yet.
 	current_time = get_current_time();
-	last_move_time = current_time;
-	asteroid_move_time = current_time;
+	last_frame_time = current_time;
+	timers.projectileOwed = 0;
+	timers.asteroidOwed = 0;
 	
 	if(is_game_over()){
-		speed = 500;
-		asteroid_speed = 1000;
-		//eeprom_write_word(0, ("Pacifique d%", get_score()));
+		game_start_timers(&timers);
 		//ledmatrix_clear();
 		
 		
@@ -160,6 +321,7 @@ void play_game(void) {
 	
 	// We play the game until it's over
 	while(!is_game_over()) {
+		frame_stage_begin(FRAME_STAGE_INPUT);
 		DDRD = (1<<4 | 1<<5 | 1<<6);
 		// Check for input - which could be a button push or serial input.
 		// Serial input may be part of an escape sequence, e.g. ESC [ D
@@ -174,6 +336,13 @@ void play_game(void) {
 		button = button_pushed();
 		current_time = get_current_time();
 		
+		// Move the text in the HUD band, the life lost flash and the
+		// explosions on if they are due
+		if(scrolling_display_task()) {
+			redraw_hud();
+		}
+		game_task();
+		
 		if(button == NO_BUTTON_PUSHED) {
 			// No push button was pushed, see if there is any serial input
 			if(serial_input_available()) {
@@ -203,6 +372,13 @@ void play_game(void) {
 			}
 		}
 		
+		// Start timing the input (if any) that we're about to act on
+		if(button != NO_BUTTON_PUSHED) {
+			latency_input_begin(LATENCY_SOURCE_BUTTON);
+		} else if(serial_input != -1 || escape_sequence_char != -1) {
+			latency_input_begin(LATENCY_SOURCE_SERIAL);
+		}
+		
 		// Process the input.
 		if(button==3 || escape_sequence_char=='D' || serial_input=='L' || serial_input=='l') {
 			// Button 3 pressed OR left cursor key escape sequence completed OR
@@ -229,57 +405,125 @@ void play_game(void) {
 				DDRD = ~(1 << 4);
 				
 			}
+		} else if(serial_input == 'm' || serial_input == 'M') {
+			// Print the performance measurements below the score
+			move_cursor(1,18);
+			latency_report();
+			frame_timing_report();
+			idle_report();
+			profile_report();
+			ram_report();
+			display_encoder_report();
+			game_report();
+			autopilot_report();
+			audio_report();
+		} else if(serial_input == 'v' || serial_input == 'V') {
+			// Save the game (in RAM and the EEPROM)
+			save_snapshot(1);
+		} else if(serial_input == 'x' || serial_input == 'X') {
+			// Save the game in RAM and send it over the serial port
+			save_snapshot(0);
+			print_snapshot();
+		} else if(serial_input == 'u' || serial_input == 'U') {
+			// Go back to the saved game
+			restore_snapshot();
+		} else if(serial_input == 'n' || serial_input == 'N') {
+			// Start a new game straight away
+			fast_restart = 1;
+			game_over(1);
+		} else if(serial_input == 'k' || serial_input == 'K') {
+			// Offer a linked game to the board at the other end of the
+			// serial link
+			netplay_offer((uint16_t)get_current_time());
+			move_cursor(10,16);
+			printf_P(PSTR("Waiting for the other board..."));
+		} else if(serial_input == 'a' || serial_input == 'A') {
+			// Let the autopilot play, or take over from it
+			autopilot = !autopilot;
+			autopilot_time = current_time;
+		} else if(serial_input == 'g' || serial_input == 'G') {
+			// Time the training environment, then carry on with this
+			// game
+			run_env_benchmark();
+		} else if(serial_input == 'o' || serial_input == 'O') {
+			// Turn the music on or off
+			music = !music;
+			if(music) {
+				audio_play(AUDIO_SOUND_MUSIC);
+			} else {
+				audio_stop(0);
+			}
 		}
 		// else - invalid input or we're part way through an escape sequence -
 		// do nothing
-		while(paused){
-			serial_input = fgetc(stdin);
-			if(serial_input == 'p' || serial_input == 'P' || button==1 || escape_sequence_char=='B'){
-				timePaused = get_current_time() - pause_time;
-				current_time = get_current_time() + timePaused;
-				paused = 0;
-				DDRD = (1 << 4);
-				
-			}
-			
-		}
-		
-		if(!is_game_over() && current_time >= last_move_time + ((uint32_t) speed)) {
-			// 500ms (0.5 second) has passed since the last time we moved
-			// the projectiles - move them - and keep track of the time we
-			// moved them
-			advance_projectiles();
-	
-			game_playing();
-			joy_stick();
-			
-			//crease the speed of the game as the score increases
-			if(get_score() >= 10) {
-				speed =  500 - get_score();
-			}
-			
-			last_move_time = current_time;
-		} 
-		
-		if(!is_game_over() && current_time >= asteroid_move_time + asteroid_speed) {
-		// 500ms (0.5 second) has passed since the last time we moved
-		// the projectiles - move them - and keep track of the time we
-		// moved them
-		//we descend the asteroids from top to bottom
-		advance_asteroids();
-		game_playing();
-		joy_stick();
 		
-		//crease the speed of the game as the score increases
-		if(get_score() >= 10) {
-			asteroid_speed =  1000 - 2*(get_score());
+		// Finished acting on the input - record how long it took to
+		// reach the display. (The autopilot's search and the serial link
+		// below aren't part of the user's input.)
+		latency_input_end();
+		run_autopilot();
+		// Save the high score table if the save had to wait for other
+		// EEPROM writes (see highscore_add())
+		highscore_task();
+		// End this game if a linked game has been agreed (offered by
+		// either board)
+		if(netplay_poll(current_time)) {
+			game_over(1);
+		}
+		if(paused){
+			// Wait until the game is resumed (see pause_task())
+			run_screen(pause_task);
+			timePaused = get_current_time() - pause_time;
+			current_time = get_current_time();
+			// Time spent paused is not owed to the game
+			last_frame_time = current_time;
+			paused = 0;
+			DDRD = (1 << 4);
 		}
 		
-		asteroid_move_time = current_time;
-		
+		// Work out how much time has passed since the last frame and
+		// add it to the time owed to each of the simulation steps.
+		// Steps are then run for as long as a whole step period is owed,
+		// so time lost to slow frames is caught up rather than silently
+		// slowing the game down. If we fall too far behind we give up
+		// on the excess rather than stalling the game while catching up.
+		current_time = get_current_time();
+		elapsed = current_time - last_frame_time;
+		last_frame_time = current_time;
+		game_run_steps(&timers, elapsed < UINT16_MAX ? elapsed : UINT16_MAX, &steps);
 		
-	}
+		// The sound and joystick are updated once per frame in which the
+		// game moved on, no matter how many steps were run.
+		if(!is_game_over() && steps.run) {
+			frame_stage_begin(FRAME_STAGE_SOUND);
+			audio_task();
+#if LEDMATRIX_JOYSTICK_USED
+			frame_stage_begin(FRAME_STAGE_JOYSTICK);
+			joy_stick();
+#endif
+		}
+		frame_end(steps.late, steps.dropped);
 		
+		// Sleep until the next step is due or there is input to deal
+		// with.
+		if(!is_game_over()) {
+			next_step_time = last_frame_time + (timers.projectilePeriod - timers.projectileOwed);
+			if(timers.asteroidPeriod - timers.asteroidOwed <
+					timers.projectilePeriod - timers.projectileOwed) {
+				next_step_time = last_frame_time + (timers.asteroidPeriod - timers.asteroidOwed);
+			}
+			if(scrolling_display_active() &&
+					(int32_t)(scrolling_display_next_time() - next_step_time) < 0) {
+				next_step_time = scrolling_display_next_time();
+			}
+			if(autopilot && (int32_t)(autopilot_time - next_step_time) < 0) {
+				next_step_time = autopilot_time;
+			}
+			if(game_task_active() && (int32_t)(game_next_time() - next_step_time) < 0) {
+				next_step_time = game_next_time();
+			}
+			idle_until(next_step_time);
+		}
 	}
 
 	// We get here if the game is over.
@@ -288,22 +532,327 @@ void play_game(void) {
 
 
 void handle_game_over() {
+	// Stop the score scrolling in the HUD band - the game over message
+	// takes its place
+	uint8_t columns[MESSAGE_COLUMNS];
+	scrolling_display_stop();
+	scrolling_display_set_cache(columns, sizeof(columns));
+	run_screen(game_over_task);
+	scrolling_display_set_cache(0, 0);
+}
+
+// The game over screen. If the score has got into the high score table,
+// the player's name is read from the terminal (while the game over
+// message scrolls) until they press Enter or push a button, then they
+// are added to the table and it is shown. (The table is saved in the
+// background.) The screen finishes when a button is pushed.
+uint8_t game_over_task(Coroutine* c) {
+	static Coroutine visual;
+	
+	CORO_BEGIN(c);
+	// Let the flash for the last life lost and the explosions finish
+	// first
+	game_task();
+	while(game_task_active()) {
+		CORO_SLEEP_UNTIL(c, game_next_time());
+		game_task();
+	}
+	
+	audio_play(AUDIO_SOUND_GAME_OVER);
 	move_cursor(10,14);
 	printf_P(PSTR("GAME OVER"));
 	move_cursor(10,15);
 	printf_P(PSTR("Press a button to start again"));
-	game_visual();
+	CORO_RUN(c, &visual, game_visual_task(&visual));
+	
+	start_game_over_text();
+	name_button = 0;
+	if(highscore_qualifies(get_score())) {
+		move_cursor(10,17);
+		printf_P(PSTR("New high score! Type your name and press Enter: "));
+		clear_serial_input_buffer();
+		name_length = 0;
+		CORO_WAIT_UNTIL(c, high_score_name_entered());
+		playerName[name_length] = 0;
+		highscore_add(playerName, get_score());
+		highscore_print(19);
+	}
+	// A button pushed to finish the name also finishes the screen
+	if(!name_button) {
+		CORO_WAIT_UNTIL(c, button_pushed_ignoring_serial());
+	}
+	scrolling_display_stop();
+	CORO_END(c);
+}
+
+// Read the characters of the player's name waiting at the terminal.
+// Returns 1 once they have pressed Enter or pushed a button (setting
+// name_button), 0 if not.
+uint8_t high_score_name_entered(void) {
+	char c;
 	
-	while(button_pushed() == NO_BUTTON_PUSHED) {
-		set_scrolling_display_text("GAME OVER", COLOUR_RED);
-		// Scroll the message until it has scrolled off the
-		// display or a button is pushed
-		while(scroll_display()) {
-			_delay_ms(150);
-			if(button_pushed() != NO_BUTTON_PUSHED) {
-				return;
+	if(button_pushed() != NO_BUTTON_PUSHED) {
+		name_button = 1;
+		return 1;
+	}
+	while(serial_input_available()) {
+		c = fgetc(stdin);
+		if(c == '\r' || c == '\n') {
+			return 1;
+		} else if((c == '\b' || c == 127) && name_length > 0) {
+			// Backspace - rub out the last character
+			name_length--;
+			printf_P(PSTR("\b \b"));
+		} else if(c >= ' ' && c <= '~' && name_length < HIGHSCORE_NAME_LENGTH) {
+			playerName[name_length++] = c;
+			putchar(c);
+		}
+	}
+	return 0;
+}
+
+// Paused, until button 1, the down cursor key or 'p'/'P' resumes the
+// game
+uint8_t pause_task(Coroutine* c) {
+	CORO_BEGIN(c);
+	pause_escape = 0;
+	CORO_WAIT_UNTIL(c, resume_requested());
+	CORO_END(c);
+}
+
+// Read a button push or serial input, if there is one. Returns 1 if it
+// resumes the game, 0 if not.
+uint8_t resume_requested(void) {
+	int8_t button;
+	char serial_input = -1;
+	char escape_sequence_char = -1;
+	
+	button = button_pushed();
+	if(button == NO_BUTTON_PUSHED && serial_input_available()) {
+		serial_input = fgetc(stdin);
+		if(serial_input == ESCAPE_CHAR) {
+			pause_escape = 1;
+		} else if(pause_escape == 1 && serial_input == '[') {
+			pause_escape = 2;
+		} else if(pause_escape == 2) {
+			escape_sequence_char = serial_input;
+			pause_escape = 0;
+		} else {
+			pause_escape = 0;
+		}
+	}
+	return serial_input == 'p' || serial_input == 'P' || button == 1 ||
+			escape_sequence_char == 'B';
+}
+
+// Save the state of the game in the snapshot buffer and, if to_eeprom
+// is 1, write it to the EEPROM in the background
+void save_snapshot(uint8_t to_eeprom) {
+	if(eeprom_queue_pending()) {
+		// The buffer may still be being written to the EEPROM
+		return;
+	}
+	snapshot_length = game_snapshot_save(snapshot, &timers);
+	if(to_eeprom) {
+		eeprom_queue_write(SNAPSHOT_EEPROM_ADDRESS, snapshot, snapshot_length);
+	}
+}
+
+// Send the snapshot over the serial port, in hex
+void print_snapshot(void) {
+	move_cursor(1,18);
+	printf_P(PSTR("Snapshot: "));
+	for(uint16_t i = 0; i < snapshot_length; i++) {
+		printf_P(PSTR("%02X"), snapshot[i]);
+	}
+}
+
+// Restore the game from the snapshot buffer - or, if nothing has been
+// saved since the reset, from the EEPROM. This takes a single frame.
+void restore_snapshot(void) {
+	if(snapshot_length == 0) {
+		if(eeprom_queue_pending()) {
+			return;
+		}
+		eeprom_read_block(snapshot, (const void*)SNAPSHOT_EEPROM_ADDRESS, sizeof(snapshot));
+		snapshot_length = sizeof(snapshot);
+	}
+	if(!game_snapshot_restore(snapshot, snapshot_length, &timers)) {
+		// Nothing usable saved
+		snapshot_length = 0;
+		return;
+	}
+	// The time since the last frame isn't owed to the restored game
+	current_time = get_current_time();
+	last_frame_time = current_time;
+}
+
+// Play a game with the board at the other end of the serial link, once
+// both boards have agreed to one. Each player moves their own base
+// (player 1's is on the left). The input is collected for netplay,
+// which runs the game on both boards in step. The joystick isn't used,
+// as it moves the base outside the game.
+void play_linked_game(void) {
+	int8_t button;
+	char serial_input, escape_sequence_char;
+	uint8_t characters_into_escape_sequence = 0;
+	uint32_t deadline;
+	GameTimers linked_timers;
+	
+	clear_terminal();
+	// The snapshot buffer is borrowed for the game's own snapshots (the
+	// game can't be saved and restored while linked), once any saved
+	// game in it has been written to the EEPROM
+	while(eeprom_queue_pending()) {
+		;
+	}
+	snapshot_length = 0;
+	netplay_start(get_current_time(), snapshot);
+	move_cursor(10,16);
+	printf_P(PSTR("Linked game - you are player %u"), netplay_player() + 1);
+	(void)button_pushed();
+	clear_serial_input_buffer();
+	
+	while(netplay_state() == NETPLAY_RUNNING) {
+		serial_input = -1;
+		escape_sequence_char = -1;
+		button = button_pushed();
+		if(button == NO_BUTTON_PUSHED && serial_input_available()) {
+			serial_input = fgetc(stdin);
+			if(characters_into_escape_sequence == 0 && serial_input == ESCAPE_CHAR) {
+				characters_into_escape_sequence = 1;
+				serial_input = -1;
+			} else if(characters_into_escape_sequence == 1 && serial_input == '[') {
+				characters_into_escape_sequence = 2;
+				serial_input = -1;
+			} else if(characters_into_escape_sequence == 2) {
+				escape_sequence_char = serial_input;
+				serial_input = -1;
+				characters_into_escape_sequence = 0;
+			} else {
+				characters_into_escape_sequence = 0;
 			}
 		}
+		if(button==3 || escape_sequence_char=='D' || serial_input=='L' || serial_input=='l') {
+			netplay_input(NETPLAY_INPUT_LEFT);
+		} else if(button==2 || escape_sequence_char=='A' || serial_input==' ') {
+			netplay_input(NETPLAY_INPUT_FIRE);
+		} else if(button==0 || escape_sequence_char=='C' || serial_input=='R' || serial_input=='r') {
+			netplay_input(NETPLAY_INPUT_RIGHT);
+		} else if(serial_input == 'm' || serial_input == 'M') {
+			move_cursor(1,18);
+			netplay_report();
+			autopilot_report();
+			audio_report();
+		} else if(serial_input == 'a' || serial_input == 'A') {
+			autopilot = !autopilot;
+			autopilot_time = get_current_time();
+		}
+		if(autopilot_due(get_current_time())) {
+			// Let the autopilot play for this board
+			netplay_timers(&linked_timers);
+			netplay_input(autopilot_decide(netplay_player(), &linked_timers,
+					AUTOPILOT_PERIOD_MS));
+		}
+		
+		netplay_task(get_current_time());
+		audio_task();
+		if(scrolling_display_task()) {
+			redraw_hud();
+		}
+		game_task();
+		
+		// Sleep until the next tick (or input)
+		deadline = netplay_next_time();
+		if(scrolling_display_active() &&
+				(int32_t)(scrolling_display_next_time() - deadline) < 0) {
+			deadline = scrolling_display_next_time();
+		}
+		if(autopilot && (int32_t)(autopilot_time - deadline) < 0) {
+			deadline = autopilot_time;
+		}
+		if(game_task_active() && (int32_t)(game_next_time() - deadline) < 0) {
+			deadline = game_next_time();
+		}
+		idle_until(deadline);
+	}
+	
+	move_cursor(10,16);
+	if(netplay_state() == NETPLAY_DESYNC) {
+		printf_P(PSTR("The boards are out of step - game abandoned"));
+	} else if(netplay_state() == NETPLAY_LINK_LOST) {
+		printf_P(PSTR("Lost contact with the other board"));
+	}
+	netplay_stop();
+	game_over(1);
+}
+
+// Returns 1 if the autopilot is on and its next move is due by time
+// now, and moves the time of the move after on. It moves every
+// AUTOPILOT_PERIOD_MS - moves missed while the game was held up are
+// skipped rather than made all at once.
+uint8_t autopilot_due(uint32_t now) {
+	if(!autopilot || (int32_t)(now - autopilot_time) < 0) {
+		return 0;
+	}
+	autopilot_time += AUTOPILOT_PERIOD_MS;
+	if((int32_t)(now - autopilot_time) >= 0) {
+		autopilot_time = now + AUTOPILOT_PERIOD_MS;
+	}
+	return 1;
+}
+
+// Let the autopilot make a move for player 0, if one is due
+void run_autopilot(void) {
+	GameTimers due = timers;
+	uint8_t move;
+	if(!autopilot_due(current_time)) {
+		return;
+	}
+	// The timers as they will be once the time since the last frame is
+	// added on
+	due.projectileOwed += current_time - last_frame_time;
+	due.asteroidOwed += current_time - last_frame_time;
+	move = autopilot_decide(0, &due, AUTOPILOT_PERIOD_MS);
+	if(move == AUTOPILOT_LEFT) {
+		move_base(MOVE_LEFT);
+	} else if(move == AUTOPILOT_RIGHT) {
+		move_base(MOVE_RIGHT);
+	} else if(move == AUTOPILOT_FIRE) {
+		fire_projectile();
+	}
+}
+
+// Run the training environment benchmark (see env_benchmark()) on a
+// single environment and print the result below the score. There isn't
+// the RAM for the environment to have a game of its own, so it plays
+// boardGame and the game being played is kept in the snapshot buffer
+// meanwhile. The benchmark isn't run if a game has been saved there
+// (there isn't the RAM for a second buffer either). The game is
+// restored while still quiet so that the score isn't shown again, which
+// would clear the result.
+void run_env_benchmark(void) {
+	GameEnv env;
+	if(eeprom_queue_pending()) {
+		return;
 	}
+	move_cursor(1,18);
+	if(snapshot_length) {
+		printf_P(PSTR("env: not run - a saved game is in the snapshot buffer"));
+		return;
+	}
+	save_snapshot(0);
+	env_init(&env, 0);
+	env_benchmark(&env, 1, ENV_BENCHMARK_STEPS, get_current_time);
+	restore_snapshot();
+	env_close();
+	// Nothing has been saved by the player
+	snapshot_length = 0;
+}
 
+// Scroll the game over message and the final score, over and over
+// again
+void start_game_over_text(void) {
+	scrolling_display_start_number_P(PSTR("GAME OVER - SCORE "), get_score(),
+			COLOUR_RED, SCROLL_TO_DISPLAY, start_game_over_text);
 }
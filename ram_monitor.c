@@ -0,0 +1,75 @@
+/*
+ * ram_monitor.c
+ *
+ * Stack high-water mark and free RAM - see ram_monitor.h
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+#include "ram_monitor.h"
+
+/* Value painted over unused RAM at start up */
+#define STACK_PAINT 0xC5
+
+/* Symbols provided by the linker. _end is the end of the static
+ * variables (the start of the heap), __stack is the initial stack
+ * pointer (the top of RAM), __data_start is the start of the static
+ * variables and __brkval is the top of the heap (0 if malloc() has
+ * never been used).
+ */
+extern uint8_t _end;
+extern uint8_t __stack;
+extern uint8_t __data_start;
+extern char* __brkval;
+
+/* Paint the unused RAM. This is placed in the .init3 section so it is
+ * run after the stack pointer and zero register have been set up but
+ * before main() is called. (It is naked and has no locals that need
+ * the stack, so the code is just placed inline in the start up code.)
+ */
+void ram_paint(void) __attribute__((naked, used, section(".init3")));
+void ram_paint(void) {
+	uint8_t* p = &_end;
+	while(p <= &__stack) {
+		*p++ = STACK_PAINT;
+	}
+}
+
+/* Lowest address at or above the end of the static variables (or the
+ * heap) which is no longer painted
+ */
+static uint8_t* lowest_used(void) {
+	uint8_t* p = __brkval ? (uint8_t*)__brkval : &_end;
+	while(p <= &__stack && *p == STACK_PAINT) {
+		p++;
+	}
+	return p;
+}
+
+uint16_t ram_static_size(void) {
+	return &_end - &__data_start;
+}
+
+uint16_t ram_stack_high_water(void) {
+	return &__stack - lowest_used() + 1;
+}
+
+uint16_t ram_free_now(void) {
+	uint8_t* heap_top = __brkval ? (uint8_t*)__brkval : &_end;
+	return (uint8_t*)SP - heap_top;
+}
+
+uint16_t ram_never_used(void) {
+	uint8_t* heap_top = __brkval ? (uint8_t*)__brkval : &_end;
+	return lowest_used() - heap_top;
+}
+
+void ram_report(void) {
+	printf_P(PSTR("RAM: static=%u stack max=%u free now=%u never used=%u of %u\n"),
+			ram_static_size(), ram_stack_high_water(), ram_free_now(),
+			ram_never_used(), RAMEND - RAMSTART + 1);
+}
@@ -0,0 +1,36 @@
+/*
+ * ram_monitor.h
+ *
+ * Keeping an eye on how much of the 2KB of SRAM is in use. At start
+ * up (before main() is called) all of the RAM between the end of the
+ * static variables and the top of the stack is filled with a known
+ * value. The stack high-water mark is then found by looking for the
+ * lowest address which no longer holds that value.
+ *
+ * The static RAM used by each module can be found from the build's
+ * map file with ram_report.py.
+ */
+
+#ifndef RAM_MONITOR_H_
+#define RAM_MONITOR_H_
+
+#include <stdint.h>
+
+// Bytes of RAM used by static variables (.data and .bss)
+uint16_t ram_static_size(void);
+
+// Largest number of bytes the stack has ever used
+uint16_t ram_stack_high_water(void);
+
+// Bytes between the top of the heap (or static variables) and the
+// current stack pointer, i.e. the RAM free right now
+uint16_t ram_free_now(void);
+
+// Bytes which have never been used by the stack (or heap) - the
+// smallest the free RAM has ever been
+uint16_t ram_never_used(void);
+
+// Print the RAM figures to standard output
+void ram_report(void);
+
+#endif /* RAM_MONITOR_H_ */
@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+#
+# ram_report.py
+#
+# Print the static RAM (.data and .bss) used by each module, using the
+# map file written by the linker (Debug/CSSSE2010.map by default), and
+# how much of the ATmega324A's 2KB of SRAM is left for the stack.
+#
+# Usage: python ram_report.py [mapfile]
+
+import os
+import re
+import sys
+
+RAM_SIZE = 2048
+
+# An input section line in the map file, e.g.
+#  .bss.paused    0x00800172        0x1 project.o
+#  COMMON         0x00800180       0x1c game.o
+# Long section names put the address, size and file on the next line.
+# Constant data (e.g. string literals not in PROGMEM) is placed in the
+# .data section too, so is counted as data.
+SECTION = re.compile(r"^ (\.data\S*|\.rodata\S*|\.bss\S*|COMMON)\s*$|"
+                     r"^ (\.data\S*|\.rodata\S*|\.bss\S*|COMMON)\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(.+)$")
+CONTINUATION = re.compile(r"^\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(.+)$")
+OUTPUT_SECTION = re.compile(r"^\.(data|bss|noinit)\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)")
+
+
+def module_name(path):
+    # Library members look like ...\libc.a(random.o)
+    path = path.strip().replace("\\", "/")
+    match = re.search(r"([^/]+\.a)\(([^)]+)\)$", path)
+    if match:
+        return "%s(%s)" % match.groups()
+    return os.path.basename(path)
+
+
+def parse(lines):
+    usage = {}
+    in_ram_section = False
+    pending = None
+    for line in lines:
+        line = line.rstrip("\r\n")
+        output = OUTPUT_SECTION.match(line)
+        if output:
+            in_ram_section = output.group(1) in ("data", "bss")
+            continue
+        if line and not line[0].isspace():
+            in_ram_section = False
+        if not in_ram_section:
+            continue
+        if pending:
+            cont = CONTINUATION.match(line)
+            pending_kind = pending
+            pending = None
+            if cont:
+                size = int(cont.group(2), 16)
+                add(usage, cont.group(3), pending_kind, size)
+                continue
+        match = SECTION.match(line)
+        if not match:
+            continue
+        if match.group(1):
+            pending = kind(match.group(1))
+        else:
+            size = int(match.group(4), 16)
+            add(usage, match.group(5), kind(match.group(2)), size)
+    return usage
+
+
+def kind(section):
+    return "bss" if section.startswith(".bss") or section == "COMMON" else "data"
+
+
+def add(usage, path, section_kind, size):
+    if size == 0:
+        return
+    entry = usage.setdefault(module_name(path), {"data": 0, "bss": 0})
+    entry[section_kind] += size
+
+
+def main():
+    map_file = sys.argv[1] if len(sys.argv) > 1 else os.path.join("Debug", "CSSSE2010.map")
+    with open(map_file) as f:
+        usage = parse(f)
+
+    total = 0
+    print("%-28s %6s %6s %6s" % ("module", "data", "bss", "total"))
+    for module, entry in sorted(usage.items(), key=lambda item: -(item[1]["data"] + item[1]["bss"])):
+        module_total = entry["data"] + entry["bss"]
+        total += module_total
+        print("%-28s %6d %6d %6d" % (module, entry["data"], entry["bss"], module_total))
+    print("%-28s %20d" % ("static total", total))
+    print("%-28s %20d" % ("left for stack and heap", RAM_SIZE - total))
+
+
+if __name__ == "__main__":
+    main()
@@ -12,21 +12,16 @@
 #include <util/delay.h>
 #include <stdint.h>
 #include "game.h"
+#include "game_state.h"
 #include "score.h"
 #include "terminalio.h"
 #include "timer0.h"
 
-volatile uint32_t score;
-
 void init_score(void) {
-	score = 0;
-	clear_terminal();
-	move_cursor(10,10);
-
-	printf("Score : %" PRIu32 , get_score());
-	move_cursor(10,12);
-	printf("Lives : %d" , (int8_t)get_lives());
-	
+	gameState->score = 0;
+	if(!game_is_quiet()) {
+		score_show();
+	}
 }
 
 
@@ -36,7 +31,12 @@ void add_to_score(uint16_t value) {
 		PORTD |= 0b01111100;
 	}
 	
-	score += value;
+	gameState->score += value;
+	if(game_is_quiet()) {
+		// Shown when quiet mode is turned off
+		return;
+	}
+	score_display_update();
 	clear_terminal();
 	move_cursor(10,10);
 	if(value < 9){
@@ -59,7 +59,23 @@ void add_to_score(uint16_t value) {
 }
 
 uint32_t get_score(void) {
-	return score;
+	return gameState->score;
+}
+
+void set_score(uint32_t value) {
+	gameState->score = value;
+	if(!game_is_quiet()) {
+		score_show();
+	}
+}
+
+void score_show(void) {
+	score_display_update();
+	clear_terminal();
+	move_cursor(10,10);
+	printf("Score : %" PRIu32 , get_score());
+	move_cursor(10,12);
+	printf("Lives : %d" , (int8_t)get_lives());
 }
 
 
@@ -13,5 +13,13 @@ void init_score(void);
 void add_to_score(uint16_t value);
 uint32_t get_score(void);
 
+// Set the score to the given value (e.g. when a saved game is restored)
+void set_score(uint32_t value);
+
+// Show the score on the seven segment display, and the score and lives
+// on the terminal. (add_to_score() and set_score() do this themselves,
+// except in quiet mode - see game_set_quiet().)
+void score_show(void);
+
 
 #endif /* SCORE_H_ */
\ No newline at end of file
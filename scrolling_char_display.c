@@ -7,9 +7,9 @@
  * This program scrolls a message from right to left on the
  * board. The font used is defined below and is 7 dots high and
  * varies between 3 and 5 dots wide, depending on the character.
- * Letters and numbers can be handled (though lower case
- * letters are displayed as upper case). All other characters
- * display as a blank column.
+ * Letters, numbers and common punctuation can be handled (though
+ * lower case letters are displayed as upper case). All other
+ * characters display as a blank column.
  * 
  * The program also demonstrates how data can be stored in the
  * program (flash) memory, without also taking up space in RAM.
@@ -21,16 +21,31 @@
  * constants can live just in the program memory and not be 
  * copied to RAM. (This saves several hundred bytes of RAM.)
  *
+ * Messages can also be scrolled in the background - see
+ * scrolling_display_start(). The main loop calls scrolling_display_task()
+ * as it goes round, which shifts in a column whenever one is due
+ * according to the timer, so the main loop can get on with other work
+ * (and sleep) in between. The SPI commands for a column take over 1ms,
+ * so they are sent from the main loop rather than the timer interrupt
+ * (which would also clash with display updates from the main loop).
+ *
+ * Messages can come from RAM or program memory (the _P functions), and
+ * can end with a number, whose digits are worked out as they are
+ * needed. If the caller gives us a buffer (scrolling_display_set_cache())
+ * the font data for every column of the message is looked up once, when
+ * the message is started, so each shift only has to read the buffer.
  */
 
 #include "scrolling_char_display.h"
 #include "ledmatrix.h"
+#include "framebuffer.h"
+#include "timer0.h"
 #include <avr/pgmspace.h>
 
 /* FONT DEFINITION
  *
  * The following define the columns of data to be displayed
- * for each character (a-z and 0-9). The most significant
+ * for each character (a-z, 0-9 and punctuation). The most significant
  * 7 bits (bit 7 to bit 1) represent the data for rows 7 to 1 
  * (top to bottom). The least significant bit is 1 only for
  * the last column of letter data. (This is how the software
@@ -89,20 +104,42 @@ static const uint8_t cols_7[] PROGMEM = {128, 158, 160, 193};
 static const uint8_t cols_8[] PROGMEM = {108, 146, 146, 109};
 static const uint8_t cols_9[] PROGMEM = {100, 146, 146, 125};
 
-/* The following two arrays point to the font data above. 
- * We store pointers to the beginning of the column data
- * for each letter 
-*/
-static const uint8_t* const letters[26] PROGMEM = {
+/* Data for punctuation. A space is one blank column (plus the blank
+ * column between characters).
+ */
+static const uint8_t cols_space[] PROGMEM = {1};
+static const uint8_t cols_exclamation[] PROGMEM = {251};
+static const uint8_t cols_apostrophe[] PROGMEM = {193};
+static const uint8_t cols_open_bracket[] PROGMEM = {124, 131};
+static const uint8_t cols_close_bracket[] PROGMEM = {130, 125};
+static const uint8_t cols_plus[] PROGMEM = {16, 56, 17};
+static const uint8_t cols_comma[] PROGMEM = {7};
+static const uint8_t cols_minus[] PROGMEM = {16, 16, 17};
+static const uint8_t cols_full_stop[] PROGMEM = {3};
+static const uint8_t cols_slash[] PROGMEM = {6, 24, 225};
+static const uint8_t cols_colon[] PROGMEM = {37};
+static const uint8_t cols_equals[] PROGMEM = {40, 40, 41};
+static const uint8_t cols_question[] PROGMEM = {64, 138, 144, 97};
+
+/* The following array points to the font data above, for each
+ * character from ' ' to 'Z' in ASCII order. We store pointers to the
+ * beginning of the column data for each character, or 0 for characters
+ * which have no font data.
+ */
+#define FIRST_GLYPH ' '
+#define LAST_GLYPH 'Z'
+static const uint8_t* const glyphs[LAST_GLYPH - FIRST_GLYPH + 1] PROGMEM = {
+		cols_space, cols_exclamation, 0, 0, 0, 0, 0, cols_apostrophe,
+		cols_open_bracket, cols_close_bracket, 0, cols_plus,
+		cols_comma, cols_minus, cols_full_stop, cols_slash,
+		cols_0, cols_1, cols_2, cols_3, cols_4, 
+		cols_5, cols_6, cols_7, cols_8, cols_9,
+		cols_colon, 0, 0, cols_equals, 0, cols_question, 0,
 		cols_A, cols_B, cols_C, cols_D, cols_E, cols_F,
 		cols_G, cols_H, cols_I, cols_J, cols_K, cols_L,
 		cols_M, cols_N, cols_O, cols_P, cols_Q, cols_R, 
 		cols_S, cols_T, cols_U, cols_V, cols_W, cols_X,
 		cols_Y, cols_Z };
-		
-static const uint8_t* const numbers[10] PROGMEM = {
-		cols_0, cols_1, cols_2, cols_3, cols_4, 
-		cols_5, cols_6, cols_7, cols_8, cols_9 };
 
 /* Keep track of the pixel colour to be used */
 static PixelColour colour = COLOUR_RED;
@@ -111,49 +148,203 @@ static PixelColour colour = COLOUR_RED;
  * next_col_ptr points to that column, or is 0 if there is
  * no next column.
  */
-static volatile const uint8_t* next_col_ptr = 0;
+static const uint8_t* next_col_ptr = 0;
 
 /* String to be displayed. 
  * next_char_to_display will be used to point to the next
  * character from this string to be displayed.
+ * message_string is the string the message starts with and
+ * string_in_progmem is 1 if it is in program memory, 0 if it is in
+ * RAM.
  */
-static char* display_string;
+static const char* display_string;
+
+static const char* next_char_to_display = 0;
 
-static volatile char* next_char_to_display = 0;
+static const char* message_string;
+static uint8_t string_in_progmem;
+
+/* Number shown after the string (if any). number_divisor is the
+ * power of 10 of the next digit to be displayed, or 0 if there are no
+ * more digits. first_divisor is that of the first digit, or 0 if there
+ * is no number.
+ */
+static uint32_t number;
+static uint32_t number_divisor;
+static uint32_t first_divisor;
+
+/* Font data for each column of the message (see
+ * scrolling_display_set_cache()). cache_length is the number of
+ * columns in the cache for the current message (0 if it didn't fit)
+ * and cache_position is the next one to be shifted in.
+ */
+static uint8_t* cache;
+static uint8_t cache_size;
+static uint8_t cache_length;
+static uint8_t cache_position;
+
+/* Number of columns still to be shifted before the end of the message
+ * has scrolled off
+ */
+static uint8_t shift_countdown = 0;
+
+/* Background scrolling (see scrolling_display_start()).
+ * scroll_active - 1 while a message is being scrolled in the background
+ * scroll_target - where it is being scrolled (SCROLL_TO_DISPLAY or
+ *		SCROLL_TO_HUD)
+ * scroll_done - called when it has scrolled off
+ * column_period - time between columns (ms)
+ * next_column_time - when the next column is due
+ */
+static uint8_t scroll_active = 0;
+static uint8_t scroll_target;
+static ScrollDoneCallback scroll_done;
+static uint16_t column_period = SCROLL_COLUMN_MS;
+static uint32_t next_column_time;
+
+/* The font data of the columns scrolled in so far - shown_columns[x] is
+ * column x of the HUD band or of the display. When scrolling to the
+ * display this is needed to carry columns from one panel to the next.
+ */
+static uint8_t shown_columns[MATRIX_NUM_COLUMNS];
+
+/* The last column sent to the display, and the font data it was built
+ * from. The column is only built again when the font data changes, i.e.
+ * once per font column rather than once per shift.
+ */
+static MatrixColumn column_colour_data;
+static uint8_t column_font_data = 0;
+
+static uint8_t next_column(uint8_t* finished);
+
+/*
+ * Reset the pointers to ensure the next column to be displayed
+ * comes from the first character of the message.
+ */
+static void rewind_message(void) {
+	display_string = message_string;
+	next_col_ptr = 0;
+	next_char_to_display = 0;
+	shift_countdown = 0;
+	number_divisor = first_divisor;
+}
+
+/*
+ * Look up the font data for every column of the message, up to the
+ * point where the end of the message has been shifted in, and store
+ * it in the cache. If it doesn't fit, the cache isn't used for this
+ * message. Either way the next column to be shifted in is the first.
+ */
+static void build_cache(void) {
+	uint8_t finished = 0;
+	
+	rewind_message();
+	cache_length = 0;
+	cache_position = 0;
+	if(!cache) {
+		return;
+	}
+	while(shift_countdown == 0 && !finished) {
+		if(cache_length == cache_size) {
+			// Doesn't fit - look the font data up as we go instead
+			rewind_message();
+			cache_length = 0;
+			return;
+		}
+		cache[cache_length++] = next_column(&finished);
+	}
+}
 
 /*
  * Set the message to be displayed - we just copy the 
  * pointer not the string it points to, so it is important
  * that the original string not change after this function
  * is called while the string is still being displayed.
- * We reset the pointers to ensure the next column to be displayed
- * comes from the first character of this string.
+ * The number (if has_number is 1) is displayed after the string.
  */
-void set_scrolling_display_text(char* string_to_display, PixelColour c) {
+static void set_message(const char* string_to_display, uint8_t in_progmem,
+		uint8_t has_number, uint32_t value, PixelColour c) {
 	colour = c;
-	display_string = string_to_display;
-	next_col_ptr = 0;
-	next_char_to_display = 0;
+	message_string = string_to_display;
+	string_in_progmem = in_progmem;
+	number = value;
+	first_divisor = 0;
+	if(has_number) {
+		for(first_divisor = 1; value / first_divisor >= 10; first_divisor *= 10) {
+			;
+		}
+	}
+	build_cache();
+	// The colour may have changed, so rebuild the column next time
+	column_font_data = 0;
+	set_matrix_column_to_colour(column_colour_data, 0);
+	for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+		shown_columns[x] = 0;
+	}
+}
+
+void set_scrolling_display_text(const char* string_to_display, PixelColour c) {
+	set_message(string_to_display, 0, 0, 0, c);
+}
+
+void set_scrolling_display_text_P(const char* string_to_display, PixelColour c) {
+	set_message(string_to_display, 1, 0, 0, c);
+}
+
+void scrolling_display_set_cache(uint8_t* buffer, uint8_t size) {
+	cache = buffer;
+	cache_size = size;
+	cache_length = 0;
 }
 
 /*
- * Scroll the display. Should be called whenever the display
- * is to be scrolled. 
- * Returns 1 if still scrolling display.
+ * Get the next character of the message - from the string, then the
+ * digits of the number. Returns 0 at the end of the message.
  */
-uint8_t scroll_display(void) {
-	static uint8_t shift_countdown = 0;
-	uint8_t i;
+static char next_message_char(void) {
+	char c;
+	c = string_in_progmem ? pgm_read_byte(next_char_to_display) : *next_char_to_display;
+	if(c) {
+		next_char_to_display++;
+		return c;
+	}
+	if(number_divisor) {
+		c = '0' + (number / number_divisor) % 10;
+		number_divisor /= 10;
+	}
+	return c;
+}
+
+/*
+ * Find the font data for the given character. Returns 0 if there
+ * isn't any.
+ */
+static const uint8_t* glyph_for(char c) {
+	if(c >= 'a' && c <= 'z') {
+		/* Lower case letters are displayed as upper case */
+		c -= 'a' - 'A';
+	}
+	if(c < FIRST_GLYPH || c > LAST_GLYPH) {
+		return 0;
+	}
+	return (const uint8_t*)pgm_read_word(&glyphs[c - FIRST_GLYPH]);
+}
+
+/*
+ * Work out the font data for the next column to be shifted in. 
+ * Bit 7 of this column data corresponds to row 7 of the message etc.
+ * Sets *finished to 1 if the whole message (if any) has been
+ * shifted in and then off again.
+ */
+static uint8_t next_column(uint8_t* finished) {
 	uint8_t col_data;
 	char next_char;
-	uint8_t finished = 0;
 
 	/* Data to be displayed in the next column - by 
-	 * default we show a blank column. Bit 7 of this
-	 * column data corresponds to row 7 of the display
-	 * etc.
+	 * default we show a blank column.
 	 */
 	col_data = 0;
+	*finished = 0;
 
 	if(next_col_ptr) {
 		/* We're currently outputting a character and next_col_ptr
@@ -184,7 +375,7 @@ uint8_t scroll_display(void) {
 		 * (next_char_to_display) so that it points to the character 
 		 * after.
 		 */
-		next_char = *(next_char_to_display++);
+		next_char = next_message_char();
 		if(next_char == 0) {
 			/* We reached the null character at the end of the string.
 			 * There is no next character, reset our pointer to 
@@ -192,19 +383,12 @@ uint8_t scroll_display(void) {
 			 * message disappears from the display.
 			 */
 			next_char_to_display = 0;
-			shift_countdown = 16;
-		} else if (next_char >= 'a' && next_char <= 'z') {
-			/* Character is a lower case letter - the next column to 
-			 * be displayed will be the first column of the letter
-			 * data for that letter
+			shift_countdown = MATRIX_NUM_COLUMNS;
+		} else {
+			/* The next column to be displayed will be the first
+			 * column of the font data for that character (if any)
 			 */
-			next_col_ptr = (const uint8_t*)pgm_read_word(&letters[next_char - 'a']);
-		} else if (next_char >= 'A' && next_char <= 'Z') {
-			/* Upper case character */
-			next_col_ptr = (const uint8_t*)pgm_read_word(&letters[next_char - 'A']);
-		} else if (next_char >= '0' && next_char <= '9') {
-			/* Digit */
-			next_col_ptr = (const uint8_t*)pgm_read_word(&numbers[next_char - '0']);
+			next_col_ptr = glyph_for(next_char);
 		}
 	} else {
 		/* We're not outputting a column of dots and there is 
@@ -215,33 +399,186 @@ uint8_t scroll_display(void) {
 			/* May be finished - flag this and adjust below if we're still
 			 * showing pixels
 			 */
-			finished = 1;
+			*finished = 1;
 		}
 		next_char_to_display = display_string;
 		display_string = 0;
 	}
 	
-	/* Shift the current display one pixel to the left and insert the 
-	 * new column data at column 15.
-	 * Adjust our "finished" variable if we've finished scrolling the
+	/* Adjust our "finished" variable if we've finished scrolling the
 	 * message off the display
 	 */
-	ledmatrix_shift_display_left();
-	MatrixColumn column_colour_data;
-	for(i=7; i>=1; i--) {
-		// If the relevant font bit is set, we make this a red pixel, otherwise blank
+	if(shift_countdown > 0) {
+		shift_countdown--;
+	}
+	*finished = *finished && (shift_countdown == 0);
+	return col_data & 0xFE;
+}
+
+/*
+ * Get the font data for the next column - from the cache if the
+ * message is in it.
+ */
+static uint8_t next_cached_column(uint8_t* finished) {
+	if(cache_position < cache_length) {
+		*finished = 0;
+		return cache[cache_position++];
+	}
+	return next_column(finished);
+}
+
+/*
+ * Set the given column to the message colour where the font data has
+ * a bit set, and blank elsewhere. (Only the bottom 8 rows are used if
+ * there is more than one panel.)
+ */
+static void build_column(uint8_t col_data, MatrixColumn column) {
+	for(uint8_t i=7; i>=1; i--) {
 		if(col_data & 0x80) {
-			column_colour_data[i] = colour;
+			column[i] = colour;
 		} else {
-			column_colour_data[i] = 0;
+			column[i] = 0;
 		}
 		col_data <<= 1;
 	}
-	column_colour_data[0] = 0;
-	ledmatrix_update_column(15, column_colour_data);
-	if(shift_countdown > 0) {
-		shift_countdown--;
+}
+
+/*
+ * Shift the font data of the columns one column to the left and insert
+ * the given column data at the right hand end.
+ */
+static void shift_columns(uint8_t col_data) {
+	for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS - 1; x++) {
+		shown_columns[x] = shown_columns[x+1];
+	}
+	shown_columns[MATRIX_NUM_COLUMNS - 1] = col_data;
+}
+
+/*
+ * Shift the current display one pixel to the left and insert the 
+ * given column data at the right hand column.
+ * Each panel shifts on its own, so the column which has moved off the
+ * left of a panel is lost. It is sent again to the right hand column of
+ * the panel to the left. Anything else which was on the display (rather
+ * than scrolled in) is blanked as it crosses a panel boundary.
+ */
+static void shift_display(uint8_t col_data) {
+	MatrixColumn boundary;
+	
+	ledmatrix_shift_display_left();
+	shift_columns(col_data);
+	set_matrix_column_to_colour(boundary, 0);
+	for(uint8_t x = PANEL_NUM_COLUMNS - 1; x < MATRIX_NUM_COLUMNS - 1;
+			x += PANEL_NUM_COLUMNS) {
+		build_column(shown_columns[x], boundary);
+		ledmatrix_update_column(x, boundary);
+	}
+	if(col_data != column_font_data) {
+		column_font_data = col_data;
+		build_column(col_data, column_colour_data);
 	}
-	finished = finished && (shift_countdown == 0);
+	ledmatrix_update_column(MATRIX_NUM_COLUMNS - 1, column_colour_data);
+}
+
+/*
+ * Scroll the display. Should be called whenever the display
+ * is to be scrolled. 
+ * Returns 1 if still scrolling display.
+ */
+uint8_t scroll_display(void) {
+	uint8_t finished;
+	shift_display(next_cached_column(&finished));
 	return !finished;
 }
+
+/*
+ * Start scrolling the message which has been set in the background
+ */
+static void start(uint8_t target, ScrollDoneCallback done) {
+	scroll_target = target;
+	scroll_done = done;
+	scroll_active = 1;
+	next_column_time = get_current_time();
+}
+
+void scrolling_display_start(const char* string, PixelColour c, uint8_t target,
+		ScrollDoneCallback done) {
+	set_message(string, 0, 0, 0, c);
+	start(target, done);
+}
+
+void scrolling_display_start_P(const char* string, PixelColour c, uint8_t target,
+		ScrollDoneCallback done) {
+	set_message(string, 1, 0, 0, c);
+	start(target, done);
+}
+
+void scrolling_display_start_number_P(const char* string, uint32_t value, PixelColour c,
+		uint8_t target, ScrollDoneCallback done) {
+	set_message(string, 1, 1, value, c);
+	start(target, done);
+}
+
+void scrolling_display_stop(void) {
+	scroll_active = 0;
+}
+
+uint8_t scrolling_display_active(void) {
+	return scroll_active;
+}
+
+void scrolling_display_set_period(uint16_t ms) {
+	column_period = ms;
+}
+
+uint32_t scrolling_display_next_time(void) {
+	return next_column_time;
+}
+
+uint8_t scrolling_display_task(void) {
+	uint8_t col_data, finished;
+	ScrollDoneCallback done;
+	uint32_t now;
+	
+	if(!scroll_active) {
+		return 0;
+	}
+	now = get_current_time();
+	if((int32_t)(now - next_column_time) < 0) {
+		// Next column isn't due yet
+		return 0;
+	}
+	// If we're late the columns due are not caught up - the message
+	// just scrolls more slowly
+	next_column_time = now + column_period;
+	
+	col_data = next_cached_column(&finished);
+	if(finished) {
+		// The message has scrolled off. The callback may start another
+		// message.
+		scroll_active = 0;
+		done = scroll_done;
+		if(done) {
+			done();
+		}
+		return 0;
+	}
+	if(scroll_target == SCROLL_TO_HUD) {
+		// Nothing is sent to the display - the HUD is drawn by
+		// scrolling_display_draw_hud()
+		shift_columns(col_data);
+		return 1;
+	}
+	shift_display(col_data);
+	return 0;
+}
+
+void scrolling_display_draw_hud(PackedFrame frame, uint8_t y0, uint8_t index,
+		uint8_t background) {
+	for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+		MatrixColumnMask font = (MatrixColumnMask)shown_columns[x] << y0;
+		MatrixColumnMask band = (MatrixColumnMask)0xFF << y0;
+		frame_blit_column(frame, x, band & ~font, background);
+		frame_blit_column(frame, x, font, index);
+	}
+}
@@ -9,6 +9,29 @@
 
 #include <stdint.h>
 #include "pixel_colour.h"
+#include "ledmatrix.h"
+
+/* Time between columns (ms) when scrolling in the background, unless
+ * changed with scrolling_display_set_period()
+ */
+#ifndef SCROLL_COLUMN_MS
+#define SCROLL_COLUMN_MS 150
+#endif
+
+/* Where a message is scrolled in the background. SCROLL_TO_DISPLAY
+ * shifts the whole display (so nothing else should be shown).
+ * SCROLL_TO_HUD scrolls in a band PANEL_NUM_ROWS high which is drawn
+ * into a packed frame by its owner (see scrolling_display_draw_hud()),
+ * so it can be shown while the game runs.
+ */
+#define SCROLL_TO_DISPLAY	0
+#define SCROLL_TO_HUD		1
+
+/* Function called when a message scrolled in the background has
+ * scrolled off. It is called from scrolling_display_task() (not from
+ * an interrupt) and may start another message.
+ */
+typedef void (*ScrollDoneCallback)(void);
 
 /* Sets the text to be displayed and the colour it will be
  * scrolled with. The message will start displaying immediately
@@ -20,7 +43,11 @@
  * after this function is called while the string is still
  * being displayed.
  */
-void set_scrolling_display_text(char* string, PixelColour colour);
+void set_scrolling_display_text(const char* string, PixelColour colour);
+
+/* As above, for a string in program memory (e.g. from PSTR())
+ */
+void set_scrolling_display_text_P(const char* string, PixelColour colour);
 
 /* Scroll the display. Should be called whenever the display
  * is to be scrolled one pixel to the left. It is recommended that
@@ -30,5 +57,71 @@ void set_scrolling_display_text(char* string, PixelColour colour);
  * Returns 1 while a message is still scrolling, 0 when done.
  */
 uint8_t scroll_display(void);
+
+/* Start scrolling a message in the background, to the given target
+ * (SCROLL_TO_DISPLAY or SCROLL_TO_HUD). The colour is only used on
+ * the display - the HUD band is drawn with a palette index given to
+ * scrolling_display_draw_hud(). The first column is shifted in
+ * by the next call to scrolling_display_task(), then one every column
+ * period. done (which may be 0) is called once the message has
+ * scrolled off. As for set_scrolling_display_text(), the string is not
+ * copied.
+ */
+void scrolling_display_start(const char* string, PixelColour colour, uint8_t target,
+		ScrollDoneCallback done);
+
+/* As above, for a string in program memory, and for a string in
+ * program memory followed by the given number (e.g. PSTR("SCORE ") and
+ * the score). The digits of the number are worked out as they are
+ * needed, so nothing has to be kept in RAM.
+ */
+void scrolling_display_start_P(const char* string, PixelColour colour, uint8_t target,
+		ScrollDoneCallback done);
+void scrolling_display_start_number_P(const char* string, uint32_t value, PixelColour colour,
+		uint8_t target, ScrollDoneCallback done);
+
+/* Give the scroller a buffer of size bytes to hold the font data of
+ * each column of a message (one byte per column - about 5 per
+ * character). When a message is set or started, its columns are looked
+ * up once and stored here, so each shift is a single lookup. Messages
+ * which don't fit are looked up a column at a time as before. The
+ * buffer must not be used for anything else until this is called again
+ * with a null buffer (which stops the cache being used).
+ */
+void scrolling_display_set_cache(uint8_t* buffer, uint8_t size);
+
+/* Stop scrolling in the background (without calling the done
+ * function). Whatever has been shifted in stays on the display.
+ */
+void scrolling_display_stop(void);
+
+/* Returns 1 while a message is being scrolled in the background, 0 if
+ * not.
+ */
+uint8_t scrolling_display_active(void);
+
+/* Set the time between columns (ms)
+ */
+void scrolling_display_set_period(uint16_t ms);
+
+/* The time (as returned by get_current_time()) at which the next
+ * column is due - e.g. for idle_until(). Only meaningful while
+ * scrolling_display_active() returns 1.
+ */
+uint32_t scrolling_display_next_time(void);
+
+/* Shift in the next column if it is due. Should be called from the
+ * main loop (not an interrupt service routine) at least once per
+ * column period. Returns 1 if the HUD band has changed and needs to be
+ * drawn again, 0 otherwise.
+ */
+uint8_t scrolling_display_task(void);
+
+/* Draw the HUD band into rows y0 to y0+PANEL_NUM_ROWS-1 of the given
+ * frame, using palette index index for the message and background for
+ * the rest of the band.
+ */
+void scrolling_display_draw_hud(PackedFrame frame, uint8_t y0, uint8_t index,
+		uint8_t background);
 	
-#endif /* SCROLLING_CHAR_DISPLAY_H_ */
\ No newline at end of file
+#endif /* SCROLLING_CHAR_DISPLAY_H_ */
@@ -0,0 +1,135 @@
+/*
+ * serial_link.c
+ *
+ * Serial link to another board over USART 1 - see serial_link.h
+ *
+ * Both buffers are circular, with a power of two size so the positions
+ * can simply be masked. The head is where the next byte goes in and
+ * the tail where the next byte comes out - the ISRs only change the
+ * tail of the output buffer and the head of the input buffer.
+ */
+
+#include <stdint.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#include "serial_link.h"
+
+/* System clock rate in Hz */
+#define SYSCLK 8000000L
+
+#define LINK_BUFFER_SIZE 64
+#define LINK_BUFFER_MASK (LINK_BUFFER_SIZE - 1)
+
+static volatile uint8_t outBuffer[LINK_BUFFER_SIZE];
+static volatile uint8_t outHead;
+static volatile uint8_t outTail;
+
+static volatile uint8_t inBuffer[LINK_BUFFER_SIZE];
+static volatile uint8_t inHead;
+static volatile uint8_t inTail;
+
+static volatile uint32_t bytesSent;
+static volatile uint32_t bytesReceived;
+static volatile uint16_t overruns;
+
+void serial_link_init(long baudrate) {
+	outHead = outTail = 0;
+	inHead = inTail = 0;
+	bytesSent = bytesReceived = 0;
+	overruns = 0;
+
+	/* Baud rate, rounded to the nearest (as in serialio.c) */
+	UBRR1 = ((SYSCLK / (8 * baudrate)) + 1)/2 - 1;
+
+	/* Enable transmit and receive, and the receive complete interrupt.
+	 * The data register empty interrupt is enabled when there is
+	 * something to send.
+	 */
+	UCSR1B = (1<<RXEN1)|(1<<TXEN1)|(1<<RXCIE1);
+}
+
+void serial_link_send(uint8_t byte) {
+	uint8_t interruptsOn = bit_is_set(SREG, SREG_I);
+	while(((outHead + 1) & LINK_BUFFER_MASK) == outTail) {
+		if(!interruptsOn) {
+			return;
+		}
+		/* Wait for the ISR to make room */
+	}
+	cli();
+	outBuffer[outHead] = byte;
+	outHead = (outHead + 1) & LINK_BUFFER_MASK;
+	bytesSent++;
+	UCSR1B |= (1<<UDRIE1);
+	if(interruptsOn) {
+		sei();
+	}
+}
+
+uint8_t serial_link_input_available(void) {
+	return inHead != inTail;
+}
+
+uint8_t serial_link_get(void) {
+	uint8_t byte = inBuffer[inTail];
+	inTail = (inTail + 1) & LINK_BUFFER_MASK;
+	return byte;
+}
+
+uint32_t serial_link_bytes_sent(void) {
+	uint32_t count;
+	uint8_t interruptsOn = bit_is_set(SREG, SREG_I);
+	cli();
+	count = bytesSent;
+	if(interruptsOn) {
+		sei();
+	}
+	return count;
+}
+
+uint32_t serial_link_bytes_received(void) {
+	uint32_t count;
+	uint8_t interruptsOn = bit_is_set(SREG, SREG_I);
+	cli();
+	count = bytesReceived;
+	if(interruptsOn) {
+		sei();
+	}
+	return count;
+}
+
+uint16_t serial_link_overruns(void) {
+	uint16_t count;
+	uint8_t interruptsOn = bit_is_set(SREG, SREG_I);
+	cli();
+	count = overruns;
+	if(interruptsOn) {
+		sei();
+	}
+	return count;
+}
+
+ISR(USART1_UDRE_vect) {
+	if(outTail != outHead) {
+		UDR1 = outBuffer[outTail];
+		outTail = (outTail + 1) & LINK_BUFFER_MASK;
+	} else {
+		/* Nothing left to send */
+		UCSR1B &= ~(1<<UDRIE1);
+	}
+}
+
+ISR(USART1_RX_vect) {
+	uint8_t byte = UDR1;
+	uint8_t next = (inHead + 1) & LINK_BUFFER_MASK;
+	if(next == inTail) {
+		/* No room - the byte is lost */
+		overruns++;
+		return;
+	}
+	inBuffer[inHead] = byte;
+	inHead = next;
+	bytesReceived++;
+}
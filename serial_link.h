@@ -0,0 +1,37 @@
+/*
+ * serial_link.h
+ *
+ * A serial link to another board over USART 1 (RXD1 = D2, TXD1 = D3 -
+ * connect each board's TXD1 to the other's RXD1, and the grounds). Both
+ * directions are buffered and interrupt driven, like serial port 0 (see
+ * serialio.h), but bytes are sent and received as they are - the link
+ * is not a stdio stream. Interrupts must be enabled globally for the
+ * link to work.
+ */
+
+#ifndef SERIAL_LINK_H_
+#define SERIAL_LINK_H_
+
+#include <stdint.h>
+
+// Set up USART 1 for the given baud rate (e.g. 19200) and empty the
+// buffers
+void serial_link_init(long baudrate);
+
+// Queue a byte to be sent. If the output buffer is full this waits for
+// room (or, if interrupts are off, throws the byte away).
+void serial_link_send(uint8_t byte);
+
+// Returns 1 if a received byte is waiting to be read, 0 if not
+uint8_t serial_link_input_available(void);
+
+// Read the next received byte. There must be one waiting.
+uint8_t serial_link_get(void);
+
+// Bytes sent and received, and received bytes lost because the input
+// buffer was full
+uint32_t serial_link_bytes_sent(void);
+uint32_t serial_link_bytes_received(void);
+uint16_t serial_link_overruns(void);
+
+#endif /* SERIAL_LINK_H_ */
@@ -26,6 +26,9 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 
+#include "latency.h"
+#include "profile.h"
+
 /* System clock rate in Hz. (L at the end indicates this is a long constant) */
 #define SYSCLK 8000000L
 
@@ -261,6 +264,7 @@ ISR(USART0_UDRE_vect)
 
 ISR(USART0_RX_vect) 
 {
+	PROFILE_BEGIN(PROFILE_SERIAL_RX_ISR);
 	/* Read the character - we ignore the possibility of overrun. */
 	char c;
 	c = UDR0;
@@ -295,9 +299,11 @@ ISR(USART0_RX_vect)
 		 */
 		input_buffer[input_insert_pos++] = c;
 		bytes_in_input_buffer++;
+		latency_input_event(LATENCY_SOURCE_SERIAL);
 		if(input_insert_pos == INPUT_BUFFER_SIZE) {
 			/* Wrap around buffer pointer if necessary */
 			input_insert_pos = 0;
 		}
 	}
+	PROFILE_END(PROFILE_SERIAL_RX_ISR);
 }
@@ -6,6 +6,7 @@
 
 #include <avr/io.h>
 #include "spi.h"
+#include "profile.h"
 
 void spi_setup_master(uint8_t clockdivider) {
 	// Set up SPI communication as a master
@@ -61,9 +62,11 @@ uint8_t spi_send_byte(uint8_t byte) {
 	// complete. (The final read of SPSR0 followed by a read of SPDR0
 	// will cause the SPIF bit to be reset to 0. See page 173 of the 
 	// ATmega324A datasheet.)
+	PROFILE_BEGIN(PROFILE_SPI_SEND);
 	SPDR0 = byte;
 	while((SPSR0 & (1<<SPIF0)) == 0) {
 		; // wait
 	}
+	PROFILE_END(PROFILE_SPI_SEND);
 	return SPDR0;
 }
\ No newline at end of file
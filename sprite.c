@@ -0,0 +1,108 @@
+/*
+ * sprite.c
+ *
+ * Sprites and the sprite blitter - see sprite.h
+ *
+ * The game field and LED matrix are at right angles - row y of the
+ * field is column y of the matrix and column x of the field is row
+ * (FIELD_WIDTH-1-x) of the matrix. Each row of a sprite therefore ends
+ * up in one matrix column, with its bits reversed.
+ */
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+#include "sprite.h"
+#include "framebuffer.h"
+#include "ledmatrix.h"
+
+const Sprite spriteBase PROGMEM = { 2, 1, { 0b111, 0b010 } };
+
+// Row 1 across the width of the base - an asteroid reaching any of
+// these positions costs a life
+const Sprite spriteBaseHitZone PROGMEM = { 1, 1, { 0b111 } };
+
+// The explosion builds up one pixel at a time
+const Sprite spriteExplosion[EXPLOSION_FRAMES] PROGMEM = {
+	{ 1, 1, { 0b001 } },
+	{ 1, 1, { 0b011 } },
+	{ 1, 1, { 0b111 } },
+	{ 2, 1, { 0b111, 0b010 } }
+};
+
+const Sprite spriteLifeLost PROGMEM = { 2, 1, { 0b111, 0b010 } };
+
+const Sprite spriteAsteroid[ASTEROID_MAX_SIZE] PROGMEM = {
+	{ 1, 0, { 0b1 } },
+	{ 2, 0, { 0b11, 0b11 } },
+	{ 3, 0, { 0b111, 0b111, 0b111 } }
+};
+
+/* Return the pixels of the sprite (a RAM copy) drawn at (x,y) which
+ * fall in field row fieldY, clipped to the field
+ */
+static FieldRowMask row_mask(Sprite* sprite, int8_t x, int8_t y, int8_t fieldY) {
+	int8_t row = fieldY - y;
+	if(row < 0 || row >= sprite->height || fieldY < 0 || fieldY >= FIELD_HEIGHT) {
+		return 0;
+	}
+	int8_t shift = x - sprite->anchorX;
+	uint32_t bits = sprite->rows[row];
+	if(shift >= 0) {
+		bits <<= shift;
+	} else {
+		bits >>= -shift;
+	}
+	return bits & FIELD_ROW_MASK;
+}
+
+/* Convert a field row mask (bit x for column x) into a matrix column
+ * mask (bit FIELD_WIDTH-1-x)
+ */
+static MatrixColumnMask to_matrix_mask(FieldRowMask fieldMask) {
+	MatrixColumnMask matrixMask = 0;
+	for(uint8_t x = 0; x < FIELD_WIDTH; x++) {
+		if(fieldMask & FIELD_COLUMN_BIT(x)) {
+			matrixMask |= (MatrixColumnMask)1 << (FIELD_WIDTH - 1 - x);
+		}
+	}
+	return matrixMask;
+}
+
+void sprite_blit(PackedFrame frame, const Sprite* sprite, int8_t x, int8_t y,
+		uint8_t index) {
+	Sprite s;
+	memcpy_P(&s, sprite, sizeof(Sprite));
+	for(int8_t fieldY = y; fieldY < y + s.height; fieldY++) {
+		sprite_blit_row(frame, fieldY, row_mask(&s, x, y, fieldY), index);
+	}
+}
+
+void sprite_blit_row(PackedFrame frame, int8_t y, FieldRowMask mask, uint8_t index) {
+	if(y >= 0 && y < FIELD_HEIGHT && mask) {
+		frame_blit_column(frame, y, to_matrix_mask(mask), index);
+	}
+}
+
+uint8_t sprite_covers(const Sprite* sprite, int8_t x, int8_t y,
+		int8_t px, int8_t py) {
+	Sprite s;
+	if(px < 0 || px >= FIELD_WIDTH) {
+		return 0;
+	}
+	memcpy_P(&s, sprite, sizeof(Sprite));
+	return (row_mask(&s, x, y, py) >> px) & 1;
+}
+
+uint8_t sprite_collides(const Sprite* sprite, int8_t x, int8_t y,
+		const Bitboard board) {
+	Sprite s;
+	memcpy_P(&s, sprite, sizeof(Sprite));
+	for(int8_t fieldY = y; fieldY < y + s.height; fieldY++) {
+		FieldRowMask mask = row_mask(&s, x, y, fieldY);
+		if(mask && (mask & board[fieldY])) {
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,71 @@
+/*
+ * sprite.h
+ *
+ * Small bitmaps (sprites) for objects on the game field which are
+ * more than one pixel in size. Sprites are stored in program memory
+ * (PROGMEM) and are drawn into a packed frame (see framebuffer.h),
+ * which display_encoder.h then sends to the LED matrix.
+ *
+ * Sprites use game field coordinates (x from 0 to FIELD_WIDTH-1, left
+ * to right, and y from 0 to FIELD_HEIGHT-1, bottom to top). Each row
+ * of a sprite is one byte - bit 0 is the left-most pixel. A sprite
+ * drawn at (x,y) has its bottom row at y and column anchorX of the
+ * sprite at x. Parts of a sprite which fall off the field are clipped.
+ */
+
+#ifndef SPRITE_H_
+#define SPRITE_H_
+
+#include <stdint.h>
+#include <avr/pgmspace.h>
+
+#include "ledmatrix.h"
+#include "game.h"
+
+#define SPRITE_MAX_HEIGHT 4
+
+typedef struct {
+	uint8_t height;
+	int8_t anchorX;
+	uint8_t rows[SPRITE_MAX_HEIGHT];	// bottom row first
+} Sprite;
+
+// One mask per row of the game field, bit x set if there is something
+// at (x,y). Used for collision checks.
+typedef FieldRowMask Bitboard[FIELD_HEIGHT];
+
+// The sprites. These are in program memory - only pass pointers to
+// them to the functions below.
+#define EXPLOSION_FRAMES 4
+extern const Sprite spriteBase PROGMEM;
+extern const Sprite spriteBaseHitZone PROGMEM;
+extern const Sprite spriteExplosion[EXPLOSION_FRAMES] PROGMEM;
+extern const Sprite spriteLifeLost PROGMEM;
+
+// Asteroid shapes - spriteAsteroid[s-1] is an asteroid of size s (s by
+// s, anchored at its bottom left corner). These drive both drawing and
+// collisions (through the game's bitboards).
+#define ASTEROID_MAX_SIZE 3
+extern const Sprite spriteAsteroid[ASTEROID_MAX_SIZE] PROGMEM;
+
+// Draw the sprite at (x,y) in the given palette index, into the frame
+// only
+void sprite_blit(PackedFrame frame, const Sprite* sprite, int8_t x, int8_t y,
+		uint8_t index);
+
+// Set the positions in field row y for which the corresponding bit of
+// mask is 1 (bit 0 is column 0) to the given palette index, in the
+// frame only
+void sprite_blit_row(PackedFrame frame, int8_t y, FieldRowMask mask, uint8_t index);
+
+// Return 1 if the sprite drawn at (x,y) covers position (px,py),
+// 0 otherwise
+uint8_t sprite_covers(const Sprite* sprite, int8_t x, int8_t y,
+		int8_t px, int8_t py);
+
+// Return 1 if the sprite drawn at (x,y) overlaps any position set in
+// the bitboard, 0 otherwise
+uint8_t sprite_collides(const Sprite* sprite, int8_t x, int8_t y,
+		const Bitboard board);
+
+#endif /* SPRITE_H_ */
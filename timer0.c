@@ -20,18 +20,26 @@
 #include "timer0.h"
 #include "score.h"
 #include "game.h"
+#include "game_state.h"
 #include "terminalio.h"
 #include "buttons.h"
 #include "ledmatrix.h"
 #include "scrolling_char_display.h"
+#include "latency.h"
+#include "idle.h"
+#include "profile.h"
 
 /* Our internal clock tick count - incremented every 
  * millisecond. Will overflow every ~49 days. */
 static volatile uint32_t clockTicks;
 
+/* 16 bit clock for get_fast_time() - incremented by the number of
+ * timer counts in each millisecond (125) on every tick.
+ */
+static volatile uint16_t fastTicks;
+
 //make some of port c output to display score above 99;
 int move;
-volatile uint32_t lives = 4;
 
 /* Set up timer 0 to generate an interrupt every 1ms. 
  * We will divide the clock by 64 and count up to 124.
@@ -62,24 +70,19 @@ void set_lives(void);
 int get_lives(void);
 void init_lives(void);
 
-//functions responsible for the sound
-uint16_t freq_to_clock_period(uint16_t freq);
-uint16_t duty_cycle_to_pulse_width(float dutycycle, uint16_t clockperiod);
-void game_playing(void);
-void game_start_tune(void);
-
-
 /* Seven segment display digit being displayed.
 ** 0 = right digit; 1 = left digit.
 */
 volatile uint8_t seven_seg_cc = 0;
 /* Seven segment display segment values for 0 to 9 */
 uint8_t seven_seg_data[10] = {63,6,91,79,102,109,125,7,127,111};
+#ifndef TIMER0_TICKLESS
 void init_timer0(void) {
 	/* Reset clock tick count. L indicates a long (32 bit) 
 	 * constant. 
 	 */
 	clockTicks = 0L;
+	fastTicks = 0;
 	
 	/* Make all bits of port A and the least significant
 	** bit of port C be output bits to support the 7 segment and lives of the player
@@ -122,11 +125,296 @@ uint32_t get_current_time(void) {
 	return returnValue;
 }
 
+/* The microsecond and fast clocks add the timer count (8us per count)
+ * to the tick count. If a compare match has happened but the interrupt
+ * hasn't been handled yet (e.g. because interrupts are off) the tick
+ * count is one behind. The count is read again in case it was read just
+ * before the match. (The count stays at 124 for one timer clock after
+ * the match, in which case the tick hasn't really happened yet.)
+ */
+uint32_t get_current_time_us(void) {
+	uint32_t ms;
+	uint8_t count;
+	uint8_t interruptsOn = bit_is_set(SREG, SREG_I);
+	cli();
+	ms = clockTicks;
+	count = TCNT0;
+	if(TIFR0 & (1<<OCF0A)) {
+		count = TCNT0;
+		if(count != 124) {
+			ms++;
+		}
+	}
+	if(interruptsOn) {
+		sei();
+	}
+	return ms * 1000 + (uint16_t)count * FAST_TIME_US_PER_COUNT;
+}
+
+uint16_t get_fast_time(void) {
+	uint16_t ticks;
+	uint8_t count;
+	uint8_t interruptsOn = bit_is_set(SREG, SREG_I);
+	cli();
+	ticks = fastTicks;
+	count = TCNT0;
+	if(TIFR0 & (1<<OCF0A)) {
+		count = TCNT0;
+		if(count != 124) {
+			ticks += 125;
+		}
+	}
+	if(interruptsOn) {
+		sei();
+	}
+	return ticks + count;
+}
+
 ISR(TIMER0_COMPA_vect) {
 	/* Increment our clock tick count */
 	score_display();
 	
 	clockTicks++;
+	fastTicks += 125;
+	
+	/* Sample whether the main loop is asleep */
+	idle_tick();
+	
+	/* The timer count is the time since the compare match - i.e. the
+	 * interrupt latency plus the time taken so far.
+	 */
+	PROFILE_RECORD(PROFILE_TIMER_ISR, TCNT0);
+}
+
+void timer0_set_deadline(uint32_t deadline) {
+	/* Nothing to do - the CPU is woken every millisecond anyway */
+	(void)deadline;
+}
+
+#else
+
+/* In tickless mode timer 0 counts freely (normal mode) with the clock
+ * divided by 256, i.e. 32 microseconds per count, and overflows every
+ * 256 counts (8.192ms). The overflow interrupt extends the 8 bit count
+ * into a 32 bit millisecond time base: overflowMs holds the whole
+ * milliseconds at the last overflow and overflowUs the microseconds
+ * left over (0 to 999).
+ *
+ * Output compare B fires half way through each period. It and the
+ * overflow interrupt just multiplex the seven segment display from
+ * the segment values cached by score_display_update().
+ *
+ * Output compare A is only enabled when the main loop is waiting for
+ * a deadline which falls before the next overflow.
+ */
+#define US_PER_COUNT 32
+#define US_PER_OVERFLOW (256 * US_PER_COUNT)
+static volatile uint32_t overflowMs;
+static volatile uint16_t overflowUs;
+static volatile uint32_t nextDeadline;
+static volatile uint8_t deadlineSet;
+
+/* Number of overflows - the high byte of get_fast_time() */
+static volatile uint8_t fastOverflows;
+
+/* Segment values for the right (0) and left (1) digits */
+static volatile uint8_t seven_seg_segments[2];
+
+static void arm_deadline(void);
+static void seven_seg_refresh(void);
+
+void init_timer0(void) {
+	overflowMs = 0L;
+	overflowUs = 0;
+	fastOverflows = 0;
+	deadlineSet = 0;
+	
+	/* Seven segment display (and lives LEDs) outputs */
+	DDRC = 0xFF;
+	score_display_update();
+	
+	/* Clear the timer, run it in normal mode and divide the clock
+	 * by 256. This starts the timer running.
+	 */
+	TCNT0 = 0;
+	OCR0B = 128;
+	TCCR0A = 0;
+	TCCR0B = (1<<CS02);
+	
+	/* Clear any pending flags (by writing 1s to them) and enable
+	 * the overflow and compare B interrupts.
+	 */
+	TIFR0 = (1<<TOV0)|(1<<OCF0A)|(1<<OCF0B);
+	TIMSK0 = (1<<TOIE0)|(1<<OCIE0B);
+}
+
+uint32_t get_current_time(void) {
+	uint32_t ms;
+	uint16_t us;
+	uint8_t count;
+	uint8_t interruptsOn = bit_is_set(SREG, SREG_I);
+	cli();
+	ms = overflowMs;
+	us = overflowUs;
+	count = TCNT0;
+	if(TIFR0 & (1<<TOV0)) {
+		/* The timer has overflowed but the interrupt hasn't been
+		 * handled yet. Read the count again in case we read it just
+		 * before the overflow.
+		 */
+		count = TCNT0;
+		us += US_PER_OVERFLOW;
+	}
+	if(interruptsOn) {
+		sei();
+	}
+	return ms + (us + (uint16_t)count * US_PER_COUNT) / 1000;
+}
+
+uint32_t get_current_time_us(void) {
+	uint32_t ms;
+	uint16_t us;
+	uint8_t count;
+	uint8_t interruptsOn = bit_is_set(SREG, SREG_I);
+	cli();
+	ms = overflowMs;
+	us = overflowUs;
+	count = TCNT0;
+	if(TIFR0 & (1<<TOV0)) {
+		count = TCNT0;
+		us += US_PER_OVERFLOW;
+	}
+	if(interruptsOn) {
+		sei();
+	}
+	return ms * 1000 + us + (uint16_t)count * US_PER_COUNT;
+}
+
+uint16_t get_fast_time(void) {
+	uint8_t overflows;
+	uint8_t count;
+	uint8_t interruptsOn = bit_is_set(SREG, SREG_I);
+	cli();
+	overflows = fastOverflows;
+	count = TCNT0;
+	if(TIFR0 & (1<<TOV0)) {
+		count = TCNT0;
+		overflows++;
+	}
+	if(interruptsOn) {
+		sei();
+	}
+	return ((uint16_t)overflows << 8) | count;
+}
+
+void timer0_set_deadline(uint32_t deadline) {
+	uint8_t interruptsOn = bit_is_set(SREG, SREG_I);
+	cli();
+	nextDeadline = deadline;
+	deadlineSet = 1;
+	arm_deadline();
+	if(interruptsOn) {
+		sei();
+	}
+}
+
+/* If the deadline falls before the next overflow, set up output
+ * compare A to wake us when it arrives. Must be called with interrupts
+ * off.
+ */
+static void arm_deadline(void) {
+	int32_t due_ms;
+	int32_t due_us;
+	uint16_t due_count;
+	uint8_t now_count;
+	
+	if(!deadlineSet) {
+		return;
+	}
+	due_ms = (int32_t)(nextDeadline - overflowMs);
+	if(due_ms < 0 || due_ms > (US_PER_OVERFLOW / 1000) + 1) {
+		/* Already passed, or not in this period. (If it is in a later
+		 * period we'll be back here when the timer overflows.)
+		 */
+		return;
+	}
+	due_us = due_ms * 1000 - overflowUs;
+	due_count = (due_us + US_PER_COUNT - 1) / US_PER_COUNT;
+	if(due_us < 0 || due_count > 255) {
+		return;
+	}
+	now_count = TCNT0;
+	if(due_count <= now_count) {
+		/* Became due while we were working this out - fire as soon
+		 * as possible
+		 */
+		if(now_count == 255) {
+			return;
+		}
+		due_count = now_count + 1;
+	}
+	OCR0A = due_count;
+	TIFR0 = (1<<OCF0A);
+	TIMSK0 |= (1<<OCIE0A);
+}
+
+ISR(TIMER0_OVF_vect) {
+	overflowUs += US_PER_OVERFLOW % 1000;
+	overflowMs += US_PER_OVERFLOW / 1000;
+	if(overflowUs >= 1000) {
+		overflowUs -= 1000;
+		overflowMs++;
+	}
+	fastOverflows++;
+	seven_seg_refresh();
+	arm_deadline();
+	PROFILE_RECORD(PROFILE_TIMER_ISR, TCNT0);
+}
+
+ISR(TIMER0_COMPA_vect) {
+	/* The deadline has arrived - the interrupt itself wakes the CPU.
+	 * We don't need another one until a new deadline is set.
+	 */
+	TIMSK0 &= ~(1<<OCIE0A);
+	deadlineSet = 0;
+}
+
+ISR(TIMER0_COMPB_vect) {
+	seven_seg_refresh();
+}
+
+/* Show the next digit of the cached score on the seven segment
+ * display. This is all the work done by the display interrupts.
+ */
+static void seven_seg_refresh(void) {
+	seven_seg_cc = 1 ^ seven_seg_cc;
+	PORTC = 0;
+	if(digits_displayed) {
+		if(seven_seg_cc == 0) {
+			PORTA &= ~(1 << PORTA2);
+		} else {
+			PORTA |= (1 << PORTA2);
+		}
+		PORTC = seven_seg_segments[seven_seg_cc];
+	}
+}
+
+#endif /* TIMER0_TICKLESS */
+
+void score_display_update(void) {
+#ifdef TIMER0_TICKLESS
+	/* Work out the segments for the last two digits of the score once
+	 * so the display interrupts don't have to.
+	 */
+	uint8_t last_two_digits = get_score() % 100;
+	uint8_t interruptsOn = bit_is_set(SREG, SREG_I);
+	cli();
+	seven_seg_segments[0] = seven_seg_data[last_two_digits % 10];
+	seven_seg_segments[1] = seven_seg_data[last_two_digits / 10];
+	if(interruptsOn) {
+		sei();
+	}
+#endif
 }
 
 void score_display(void){
@@ -151,22 +439,25 @@ void score_display(void){
 }
 
 int get_lives(void){
-	return lives;
+	return gameState->lives;
 }
 
 void set_lives(void){
 	
-	lives --;
+	gameState->lives--;
 	
-	if(lives == 3){
-		PORTA &= 0X3C;
-	} else if(lives == 2){
-		PORTA &= 0X34;
-	} else if(lives == 1) {
-		PORTA &= 0X24;
-	} else if(lives == 0) {
+	// Only the lives LEDs (A3 to A6) are turned off - the rest of port A
+	// may be slave selects (see ledmatrix.h)
+	
+	if(gameState->lives == 3){
+		PORTA &= ~0X40;
+	} else if(gameState->lives == 2){
+		PORTA &= ~0X48;
+	} else if(gameState->lives == 1) {
+		PORTA &= ~0X58;
+	} else if(gameState->lives == 0) {
 		add_to_score(0);
-		PORTA &= 0X4;
+		PORTA &= ~0X78;
 		game_over(1);
 		
 		
@@ -184,105 +475,18 @@ void set_lives(void){
 }
 
 void init_lives(void){
-	lives = 4;
-}
-// For a given frequency (Hz), return the clock period (in terms of the
-// number of clock cycles of a 1MHz clock)
-uint16_t freq_to_clock_period(uint16_t freq) {
-	return (1000000UL / freq);	// UL makes the constant an unsigned long (32 bits)
-	// and ensures we do 32 bit arithmetic, not 16
+	gameState->lives = 4;
 }
 
-// Return the width of a pulse (in clock cycles) given a duty cycle (%) and
-// the period of the clock (measured in clock cycles)
-uint16_t duty_cycle_to_pulse_width(float dutycycle, uint16_t clockperiod) {
-	return (dutycycle * clockperiod) / 100;
-}
-
-
-void game_playing(void){
-	uint16_t freq = 50;	// Hz
-	float dutycycle = 2;	// %
-	uint16_t clockperiod = freq_to_clock_period(freq);
-	uint16_t pulsewidth = duty_cycle_to_pulse_width(dutycycle, clockperiod);
-	
-	
-	
-	// Set the maximum count value for timer/counter 1 to be one less than the clockperiod
-	OCR1A = clockperiod - 1;
-	
-	// Set the count compare value based on the pulse width. The value will be 1 less
-	// than the pulse width - unless the pulse width is 0.
-	if(pulsewidth == 0) {
-		OCR1B = 0;
-		} else {
-		OCR1B = pulsewidth - 1;
+void set_lives_count(uint8_t count){
+	// LEDs (port A) lit for 0 to 4 lives - the LED for each life is
+	// turned off in the same order as set_lives() does
+	static const uint8_t lives_leds[5] = {0x00, 0x20, 0x30, 0x38, 0x78};
+	if(count > 4) {
+		count = 4;
 	}
-	
-	// Set up timer/counter 1 for Fast PWM, counting from 0 to the value in OCR1A
-	// before reseting to 0. Count at 1MHz (CLK/8).
-	// Configure output OC1B to be clear on compare match and set on timer/counter
-	// overflow (non-inverting mode).
-	TCCR1A = (1 << COM1B1) | (0 <<COM1B0) | (1 <<WGM11) | (1 << WGM10);
-	TCCR1B = (1 << WGM13) | (1 << WGM12) | (0 << CS12) | (1 << CS11) | (0 << CS10);
-
-	// PWM output should now be happening - at the frequency and pulse width set above
-	
-	// Check the state of the buttons (on port C) every 100ms.
-	if(button_pushed() == NO_BUTTON_PUSHED) {
-		_delay_ms(100);
-		
-		if(PINB & 0x01) { // increase frequency by 5%, but highest frequency is 10000Hz
-			freq = freq*105UL/100UL;	// Constants made 32 bit to ensure 32 bit arithmetic
-			if(freq > 100) {
-				freq = 100;
-			}
-		}
-		if(PINB & 0x02) { // decrease frequency by 5%, but lowest frequency is 20Hz
-			freq = freq*95UL/100UL;		// Constants made 32 bits to ensure 32 bit arithmetic
-			if(freq < 10) {
-				freq = 10;
-			}
-		}
-		if(PINB & 0x04) { // increase duty cycle by 0.1 if less than 10% or 1 if 10% or higher
-			if(dutycycle < 10) {
-				dutycycle += 0.1;
-				} else {
-				dutycycle += 1.0;
-				if(dutycycle > 10) {
-					dutycycle = 10;
-				}
-			}
-		}
-		if(PINB & 0x08) { // decrease duty cycle by 0.1 if less than 10% or 1 if 10% or higher
-			if(dutycycle < 10) {
-				dutycycle -= 0.1;
-				if(dutycycle < 0) {
-					dutycycle = 0;
-				}
-				} else {
-				dutycycle -= 1.0;
-			}
-		}
-		
-		// Work out the clock period and pulse width
-		clockperiod = freq_to_clock_period(freq);
-		pulsewidth = duty_cycle_to_pulse_width(dutycycle, clockperiod);
-		
-		// Update the PWM registers
-		if(pulsewidth > 0) {
-			// The compare value is one less than the number of clock cycles in the pulse width
-			OCR1B = pulsewidth - 1;
-			} else {
-			OCR1B = 0;
-		}
-		// Note that a compare value of 0 results in special behaviour - see page 130 of the
-		// datasheet (2018 version)
-		
-		// Set the maximum count value for timer/counter 1 to be one less than the clockperiod
-		OCR1A = clockperiod - 1;
-	}
-	
+	gameState->lives = count;
+	PORTA = (PORTA & ~0x78) | lives_leds[count];
 }
 
 
@@ -318,15 +522,24 @@ void joy_stick(void){
 	//temp = x_or_y ^ 1;
 	if(x_or_y == 0) {
 		if(value < 515){
+			latency_input_event(LATENCY_SOURCE_JOYSTICK);
+			latency_input_begin(LATENCY_SOURCE_JOYSTICK);
 			move_base(MOVE_LEFT);
+			latency_input_end();
 		
 		} else if(value > 530) {
+			latency_input_event(LATENCY_SOURCE_JOYSTICK);
+			latency_input_begin(LATENCY_SOURCE_JOYSTICK);
 			move_base(MOVE_RIGHT);
+			latency_input_end();
 		}
 		
 	} else {
 		if(value < 500  || value > 520){
+			latency_input_event(LATENCY_SOURCE_JOYSTICK);
+			latency_input_begin(LATENCY_SOURCE_JOYSTICK);
 			fire_projectile();
+			latency_input_end();
 		}
 	}
 	
@@ -20,6 +20,14 @@
 
 #include <stdint.h>
 
+/* Define TIMER0_TICKLESS to stop the timer interrupting every
+ * millisecond. Instead the timer counts freely and only interrupts
+ * when it overflows (every 8.192ms), to multiplex the seven segment
+ * display, and when the deadline given to timer0_set_deadline()
+ * arrives. get_current_time() works the same in both modes.
+ */
+//#define TIMER0_TICKLESS
+
 /* Set up our timer to give us an interrupt every millisecond
  * and update our time reference.
  */
@@ -30,22 +38,51 @@ void init_timer0(void);
  */
 uint32_t get_current_time(void);
 
+/* Return the number of microseconds since the timer was initialised.
+ * This wraps around every ~71 minutes. The resolution is one timer
+ * count - FAST_TIME_US_PER_COUNT microseconds.
+ */
+uint32_t get_current_time_us(void);
+
+/* Return a cheap 16 bit timestamp for timing short intervals. The
+ * difference between two timestamps is the elapsed time in timer
+ * counts (see FAST_TIME_TO_US()). Intervals must be less than 65536
+ * counts (~0.5s, or ~2s in tickless mode).
+ */
+uint16_t get_fast_time(void);
+
+#ifdef TIMER0_TICKLESS
+#define FAST_TIME_US_PER_COUNT 32
+#else
+#define FAST_TIME_US_PER_COUNT 8
+#endif
+#define FAST_TIME_TO_US(counts) ((uint32_t)(counts) * FAST_TIME_US_PER_COUNT)
+
+/* Tell the timer when the main loop next has something to do (a time
+ * as returned by get_current_time()) so that it can wake the CPU then.
+ * Only needed in tickless mode - otherwise the CPU is woken every
+ * millisecond anyway.
+ */
+void timer0_set_deadline(uint32_t deadline);
+
 /*
 *A method which displays the score on seven segment
 */
 void score_display(void);
 
+/*
+*Update the seven segment display after the score has changed
+*/
+void score_display_update(void);
+
 //methods which return and set life of the player
 int get_lives(void);
 void set_lives(void);
 void init_lives(void);
+// Set the number of lives (0 to 4) and the lives LEDs to match, e.g.
+// when a saved game is restored
+void set_lives_count(uint8_t count);
 
-//functions responsible for the sound
-uint16_t freq_to_clock_period(uint16_t freq);
-uint16_t duty_cycle_to_pulse_width(float dutycycle, uint16_t clockperiod);
-void game_playing(void);
-void game_start_tune(void);
 void joy_stick(void);
-void game_visual(void);
 
 #endif
\ No newline at end of file